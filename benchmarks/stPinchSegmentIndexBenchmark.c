@@ -0,0 +1,124 @@
+/*
+ * stPinchSegmentIndexBenchmark.c
+ *
+ *  Compares the B+-tree segment index against the sorted set it replaced as the
+ *  store of a thread's segments, on threads with many segments.
+ *
+ *  Usage: stPinchSegmentIndexBenchmark [segmentNumber [queryNumber]]
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "sonLib.h"
+#include "stPinchSegmentIndex.h"
+
+typedef struct _benchmarkSegment {
+    int64_t start;
+} benchmarkSegment;
+
+static int benchmarkSegment_cmp(const benchmarkSegment *segment1, const benchmarkSegment *segment2) {
+    return segment1->start < segment2->start ? -1 : (segment1->start > segment2->start ? 1 : 0);
+}
+
+static double secondsSince(clock_t startTime) {
+    return ((double) (clock() - startTime)) / CLOCKS_PER_SEC;
+}
+
+/*
+ * Segments with starts 0, 10, 20, ..., in random order, so that insertion order does not favour either structure.
+ */
+static benchmarkSegment *getSegments(int64_t segmentNumber) {
+    benchmarkSegment *segments = st_malloc(segmentNumber * sizeof(benchmarkSegment));
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        segments[i].start = i * 10;
+    }
+    for (int64_t i = segmentNumber - 1; i > 0; i--) {
+        int64_t j = st_randomInt(0, i + 1);
+        benchmarkSegment segment = segments[i];
+        segments[i] = segments[j];
+        segments[j] = segment;
+    }
+    return segments;
+}
+
+static void benchmarkSortedSet(benchmarkSegment *segments, int64_t segmentNumber, int64_t *queries, int64_t queryNumber) {
+    clock_t startTime = clock();
+    stSortedSet *sortedSet = stSortedSet_construct3((int(*)(const void *, const void *)) benchmarkSegment_cmp, NULL);
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        stSortedSet_insert(sortedSet, &segments[i]);
+    }
+    double insertTime = secondsSince(startTime);
+
+    startTime = clock();
+    int64_t checksum = 0;
+    benchmarkSegment query;
+    for (int64_t i = 0; i < queryNumber; i++) {
+        query.start = queries[i];
+        checksum += ((benchmarkSegment *) stSortedSet_searchLessThanOrEqual(sortedSet, &query))->start;
+    }
+    double searchTime = secondsSince(startTime);
+
+    startTime = clock();
+    for (int64_t i = 0; i < segmentNumber; i += 2) {
+        stSortedSet_remove(sortedSet, &segments[i]);
+    }
+    for (int64_t i = 0; i < segmentNumber; i += 2) {
+        stSortedSet_insert(sortedSet, &segments[i]);
+    }
+    double churnTime = secondsSince(startTime);
+    stSortedSet_destruct(sortedSet);
+
+    fprintf(stdout, "stSortedSet:         insert %.3fs, searchLessThanOrEqual %.3fs, remove/reinsert %.3fs (checksum %" PRIi64 ")\n",
+            insertTime, searchTime, churnTime, checksum);
+}
+
+static void benchmarkSegmentIndex(benchmarkSegment *segments, int64_t segmentNumber, int64_t *queries, int64_t queryNumber) {
+    clock_t startTime = clock();
+    stPinchSegmentIndex *index = stPinchSegmentIndex_construct();
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        stPinchSegmentIndex_insert(index, segments[i].start, &segments[i]);
+    }
+    double insertTime = secondsSince(startTime);
+
+    startTime = clock();
+    int64_t checksum = 0;
+    for (int64_t i = 0; i < queryNumber; i++) {
+        checksum += ((benchmarkSegment *) stPinchSegmentIndex_searchLessThanOrEqual(index, queries[i]))->start;
+    }
+    double searchTime = secondsSince(startTime);
+
+    startTime = clock();
+    for (int64_t i = 0; i < segmentNumber; i += 2) {
+        stPinchSegmentIndex_remove(index, segments[i].start);
+    }
+    for (int64_t i = 0; i < segmentNumber; i += 2) {
+        stPinchSegmentIndex_insert(index, segments[i].start, &segments[i]);
+    }
+    double churnTime = secondsSince(startTime);
+    stPinchSegmentIndex_destruct(index);
+
+    fprintf(stdout, "stPinchSegmentIndex: insert %.3fs, searchLessThanOrEqual %.3fs, remove/reinsert %.3fs (checksum %" PRIi64 ")\n",
+            insertTime, searchTime, churnTime, checksum);
+}
+
+int main(int argc, char *argv[]) {
+    int64_t segmentNumber = argc > 1 ? atol(argv[1]) : 2000000;
+    int64_t queryNumber = argc > 2 ? atol(argv[2]) : 10000000;
+    if (segmentNumber < 1 || queryNumber < 0) {
+        st_errAbort("Usage: %s [segmentNumber [queryNumber]]", argv[0]);
+    }
+    benchmarkSegment *segments = getSegments(segmentNumber);
+    int64_t *queries = st_malloc(queryNumber * sizeof(int64_t));
+    for (int64_t i = 0; i < queryNumber; i++) {
+        queries[i] = st_randomInt(0, segmentNumber * 10);
+    }
+    fprintf(stdout, "%" PRIi64 " segments, %" PRIi64 " queries\n", segmentNumber, queryNumber);
+    benchmarkSortedSet(segments, segmentNumber, queries, queryNumber);
+    benchmarkSegmentIndex(segments, segmentNumber, queries, queryNumber);
+    free(queries);
+    free(segments);
+    return 0;
+}
@@ -8,55 +8,930 @@
 //Basic data structures
 //
 
+// For pthreads and mmap.
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sonLib.h"
 #include "stPinchGraphs.h"
+#include "stPinchSegmentIndex.h"
+
+typedef struct _stPinchSlabAllocator stPinchSlabAllocator;
+
+#ifdef ST_PINCH_COMPACT_HANDLES
+
+/*
+ * With ST_PINCH_COMPACT_HANDLES defined, segments, blocks and threads refer to one
+ * another by 32-bit handles rather than pointers. All three are then always slab
+ * allocated, each slab being a chunk of a fixed number of objects registered in a
+ * process wide table, so that a handle is a chunk number and an offset within the chunk.
+ */
+typedef uint32_t stPinchHandle;
+
+#define ST_PINCH_CHUNK_BITS 12
+#define ST_PINCH_CHUNK_OBJECTS (1 << ST_PINCH_CHUNK_BITS)
+#define ST_PINCH_ORIENTATION_BIT ((stPinchHandle) 1 << 31)
+
+typedef struct _stPinchHandleTable {
+    char **chunks; // Chunk 0 is never used, so that handle 0 can represent NULL. Allocated with the first chunk
+    int64_t maxChunks;
+    int64_t nextChunk; // Chunk numbers from here up have never been used
+    uint32_t *freeChunks; // Released chunk numbers, available for reuse, allocated with chunks
+    int64_t freeChunkNumber;
+    pthread_mutex_t mutex; // Guards adding and removing chunks, but not reading them
+} stPinchHandleTable;
+
+static stPinchHandleTable segmentHandles = { NULL, 1 << 20, 1, NULL, 0, PTHREAD_MUTEX_INITIALIZER };
+
+// Block handles are kept below 2^31 so that a segment can store its orientation in the top bit
+static stPinchHandleTable blockHandles = { NULL, 1 << 19, 1, NULL, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static stPinchHandleTable threadHandles = { NULL, 1 << 16, 1, NULL, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static uint32_t stPinchHandleTable_addChunk(stPinchHandleTable *table, char *chunk) {
+    pthread_mutex_lock(&table->mutex);
+    if (table->chunks == NULL) { //Only processes that build graphs pay for the tables, which last until exit
+        table->chunks = st_calloc(table->maxChunks, sizeof(char *));
+        table->freeChunks = st_malloc(table->maxChunks * sizeof(uint32_t));
+    }
+    uint32_t chunkNumber;
+    if (table->freeChunkNumber > 0) {
+        chunkNumber = table->freeChunks[--table->freeChunkNumber];
+    } else {
+        if (table->nextChunk == table->maxChunks) {
+            st_errAbort("Pinch graphs have run out of 32-bit handles");
+        }
+        chunkNumber = table->nextChunk++;
+    }
+    table->chunks[chunkNumber] = chunk;
+    pthread_mutex_unlock(&table->mutex);
+    return chunkNumber;
+}
+
+static void stPinchHandleTable_removeChunk(stPinchHandleTable *table, uint32_t chunkNumber) {
+    pthread_mutex_lock(&table->mutex);
+    free(table->chunks[chunkNumber]);
+    table->chunks[chunkNumber] = NULL;
+    table->freeChunks[table->freeChunkNumber++] = chunkNumber;
+    pthread_mutex_unlock(&table->mutex);
+}
+
+#endif
+
+/*
+ * The blocks whose modified flag is set, as a doubly linked list threaded through the blocks.
+ */
+typedef struct _stPinchModifiedBlocks {
+    stPinchBlock *head; // The most recently flagged block
+    int64_t length;
+    bool concurrent; // Set while blocks are pinched in parallel, when updates must hold the mutex
+    pthread_mutex_t mutex;
+} stPinchModifiedBlocks;
+
+/*
+ * The blocks of a graph, in an array of slots. Each block records its slot, so that it can be
+ * removed in constant time. Removal empties the slot without moving any other block, so that
+ * blocks can be destructed while iterating, and empty slots are reused by later blocks.
+ */
+typedef struct _stPinchBlockRegistry {
+    stPinchBlock **blocks; // NULL for an empty slot
+    int64_t length;
+    int64_t maxLength;
+    int64_t blockNumber;
+    int64_t *emptySlots; // Stack of the empty slots
+    int64_t emptySlotNumber;
+    int64_t maxEmptySlotNumber;
+    // While pinching in parallel, the registry of the thread set, whose blocks are removed
+    // by emptying their slots, see stPinchThreadSet_pinchBatchParallel
+    struct _stPinchBlockRegistry *parent;
+} stPinchBlockRegistry;
+
+/*
+ * The threads of a set keyed by name. While the names lie in a range not much larger than
+ * the number of threads the table is indexed directly by name, from minName, otherwise it is
+ * an open addressing table with linear probing that is kept at most half full.
+ */
+typedef struct _stPinchThreadNameIndex {
+    struct _stPinchThread **threads; // NULL for an empty entry
+    int64_t size; // Number of entries, a power of two if hashed
+    int64_t threadNumber;
+    int64_t minName; // The name of entry 0 if not hashed
+    bool hashed;
+} stPinchThreadNameIndex;
+
+/*
+ * The mutations made to a graph while a transaction is open, see stPinchThreadSet_beginTransaction.
+ * Each entry holds what is needed to reverse one mutation; the entries are reversed last first.
+ */
+typedef enum _stPinchJournalEntryType {
+    ST_PINCH_JOURNAL_SEGMENT, // The segment's block, orientation (value1) and next segment in the block
+    ST_PINCH_JOURNAL_BLOCK, // The block's head and tail segments, degree (value1) and support (value2)
+    ST_PINCH_JOURNAL_FILTER_FLAG, // The block's filter flag (value1)
+    ST_PINCH_JOURNAL_MODIFIED_FLAG, // The block's modified flag (value1), and if set its neighbours in the list
+    ST_PINCH_JOURNAL_ALLOCATE_BLOCK, // A block was made, in a reused slot if value1 is set
+    ST_PINCH_JOURNAL_FREE_BLOCK, // A block was destructed, its memory being kept until the transaction ends
+    ST_PINCH_JOURNAL_SPLIT, // The segment was made by a split of the segment 5' of it
+    ST_PINCH_JOURNAL_JOIN_3PRIME, // The segment was joined into the segment 5' of it, its memory being kept
+    ST_PINCH_JOURNAL_JOIN_5PRIME, // As above, but into the segment 3' of it (pointer1), which had start value1
+    ST_PINCH_JOURNAL_ADD_THREAD, // The thread was added to the set
+    ST_PINCH_JOURNAL_DIRTY_BOUNDARIES, // The thread's dirty boundaries (pointer1, value1 of them) were cleared
+    ST_PINCH_JOURNAL_TRACK_BOUNDARIES // Boundary tracking was switched on
+} stPinchJournalEntryType;
+
+typedef struct _stPinchJournalEntry {
+    stPinchJournalEntryType type;
+    void *object; // The segment, block or thread mutated
+    void *pointer1;
+    void *pointer2;
+    int64_t value1;
+    int64_t value2;
+} stPinchJournalEntry;
+
+typedef struct _stPinchJournal {
+    stPinchJournalEntry *entries;
+    int64_t entryNumber;
+    int64_t maxEntryNumber;
+} stPinchJournal;
+
+struct _stPinchThreadSet {
+    stList *threads;
+    stPinchThreadNameIndex threadNames;
+    bool trackBoundaries; // Set by the first incremental join, see stPinchThreadSet_joinTrivialBoundariesIncremental
+    stPinchModifiedBlocks modifiedBlocks;
+    stPinchBlockRegistry blockRegistry;
+    stPinchBatchStats batchStats; // Running totals of the segment splits and block merges made on the graph
+    stPinchJournal *journal; // NULL unless a transaction is open
+    stPinchSlabAllocator *segmentAllocator; // NULL unless the set was constructed to use slab allocation
+    stPinchSlabAllocator *blockAllocator;
+#ifdef ST_PINCH_COMPACT_HANDLES
+    stPinchSlabAllocator *threadAllocator;
+#endif
+};
+
+struct _stPinchThread {
+    int64_t name;
+    int64_t start;
+    int64_t length;
+    int64_t index; // Position in the thread set's list of threads
+    stPinchSegmentIndex *segments; // Segments keyed by start, excluding the terminator segment
+    stPinchSlabAllocator *segmentAllocator; // Shared with the thread set, or NULL if using the heap
+    stPinchSlabAllocator *blockAllocator;
+    stPinchModifiedBlocks *modifiedBlocks; // That of the thread set
+    stPinchBlockRegistry *blockRegistry; // That of the thread set, except while pinching in parallel
+    stPinchJournal *journal; // That of the thread set
+    stPinchBatchStats *batchStats; // That of the thread set, except while pinching in parallel
+    stPinchSegment *finger; // The segment last found by stPinchThread_getSegment, or NULL
+    int64_t fingerHits; // Running totals of lookups found by walking from the finger, and of those that were not
+    int64_t fingerMisses;
+    bool trackBoundaries; // If set, segment boundaries that may have become trivial are recorded
+    int64_t *dirtyBoundaries; // Starts of such segments, possibly repeated, since the last join
+    int64_t dirtyBoundaryNumber;
+    int64_t maxDirtyBoundaryNumber;
+    bool allBoundariesDirty; // Set in place of recording dirty boundaries once they outnumber the thread's segments
+#ifdef ST_PINCH_COMPACT_HANDLES
+    stPinchHandle handle;
+#endif
+};
+
+#ifdef ST_PINCH_COMPACT_HANDLES
+
+struct _stPinchSegment {
+    int64_t start;
+    stPinchHandle thread;
+    stPinchHandle pSegment;
+    stPinchHandle nSegment;
+    stPinchHandle nBlockSegment;
+    stPinchHandle block; // The top bit is the orientation of the segment in the block
+    stPinchHandle handle; // The segment's own handle
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+    stPinchHandle pBlockSegment; // The segment before this one in its block, 0 for the head
+#endif
+};
+
+struct _stPinchBlock {
+    uint64_t numSupportingHomologies : 62;
+    uint64_t flags : 2; // From least significant bit to highest: modified flag, filter flag
+    uint32_t degree;
+    stPinchHandle headSegment;
+    stPinchHandle tailSegment;
+    stPinchHandle pModifiedBlock;
+    stPinchHandle nModifiedBlock;
+    stPinchHandle handle;
+    uint32_t slot; // Index in the block registry
+};
+
+#else
+
+struct _stPinchSegment {
+    stPinchThread *thread;
+    int64_t start;
+    stPinchSegment *pSegment;
+    stPinchSegment *nSegment;
+    stPinchBlock *block;
+    bool blockOrientation;
+    stPinchSegment *nBlockSegment;
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+    stPinchSegment *pBlockSegment; // The segment before this one in its block, NULL for the head
+#endif
+};
+
+struct _stPinchBlock {
+    uint64_t degree;
+    uint64_t numSupportingHomologies : 62;
+    uint64_t flags : 2; // From least significant bit to highest: modified flag, filter flag
+    stPinchSegment *headSegment;
+    stPinchSegment *tailSegment;
+    stPinchBlock *pModifiedBlock; // Neighbours in the thread set's list of modified blocks
+    stPinchBlock *nModifiedBlock;
+    int64_t slot; // Index in the block registry
+};
+
+#endif
+
+//Links between segments, blocks and threads
+
+#ifdef ST_PINCH_COMPACT_HANDLES
+
+#define ST_PINCH_HANDLE_TO_OBJECT(table, type, handle) ((handle) == 0 ? NULL : \
+        (type *) ((table).chunks[(handle) >> ST_PINCH_CHUNK_BITS] + ((handle) & (ST_PINCH_CHUNK_OBJECTS - 1)) * sizeof(type)))
+
+static inline stPinchSegment *getSegmentFromHandle(stPinchHandle handle) {
+    return ST_PINCH_HANDLE_TO_OBJECT(segmentHandles, stPinchSegment, handle);
+}
+
+static inline stPinchBlock *getBlockFromHandle(stPinchHandle handle) {
+    return ST_PINCH_HANDLE_TO_OBJECT(blockHandles, stPinchBlock, handle);
+}
+
+static inline stPinchThread *getThreadFromHandle(stPinchHandle handle) {
+    return ST_PINCH_HANDLE_TO_OBJECT(threadHandles, stPinchThread, handle);
+}
+
+static inline stPinchHandle getSegmentHandle(const stPinchSegment *segment) {
+    return segment == NULL ? 0 : segment->handle;
+}
+
+static inline stPinchHandle getBlockHandle(const stPinchBlock *block) {
+    return block == NULL ? 0 : block->handle;
+}
+
+static inline stPinchThread *getSegmentThread(const stPinchSegment *segment) {
+    return getThreadFromHandle(segment->thread);
+}
+
+static inline void setSegmentThread(stPinchSegment *segment, stPinchThread *thread) {
+    segment->thread = thread->handle;
+}
+
+static inline stPinchSegment *getPSegment(const stPinchSegment *segment) {
+    return getSegmentFromHandle(segment->pSegment);
+}
+
+static inline void setPSegment(stPinchSegment *segment, stPinchSegment *pSegment) {
+    segment->pSegment = getSegmentHandle(pSegment);
+}
+
+static inline stPinchSegment *getNSegment(const stPinchSegment *segment) {
+    return getSegmentFromHandle(segment->nSegment);
+}
+
+static inline void setNSegment(stPinchSegment *segment, stPinchSegment *nSegment) {
+    segment->nSegment = getSegmentHandle(nSegment);
+}
+
+static inline stPinchSegment *getNBlockSegment(const stPinchSegment *segment) {
+    return getSegmentFromHandle(segment->nBlockSegment);
+}
+
+static inline void setNBlockSegment(stPinchSegment *segment, stPinchSegment *nBlockSegment) {
+    segment->nBlockSegment = getSegmentHandle(nBlockSegment);
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+    if (nBlockSegment != NULL) {
+        nBlockSegment->pBlockSegment = segment->handle;
+    }
+#endif
+}
+
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+static inline stPinchSegment *getPBlockSegment(const stPinchSegment *segment) {
+    return getSegmentFromHandle(segment->pBlockSegment);
+}
+#endif
+
+static inline stPinchBlock *getSegmentBlock(const stPinchSegment *segment) {
+    return getBlockFromHandle(segment->block & ~ST_PINCH_ORIENTATION_BIT);
+}
+
+static inline void setSegmentBlock(stPinchSegment *segment, stPinchBlock *block) {
+    segment->block = (segment->block & ST_PINCH_ORIENTATION_BIT) | getBlockHandle(block);
+}
+
+static inline bool getSegmentOrientation(const stPinchSegment *segment) {
+    return (segment->block & ST_PINCH_ORIENTATION_BIT) != 0;
+}
+
+static inline void setSegmentOrientation(stPinchSegment *segment, bool orientation) {
+    segment->block = (segment->block & ~ST_PINCH_ORIENTATION_BIT) | (orientation ? ST_PINCH_ORIENTATION_BIT : 0);
+}
+
+static inline stPinchSegment *getHeadSegment(const stPinchBlock *block) {
+    return getSegmentFromHandle(block->headSegment);
+}
+
+static inline void setHeadSegment(stPinchBlock *block, stPinchSegment *segment) {
+    block->headSegment = getSegmentHandle(segment);
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+    if (segment != NULL) {
+        segment->pBlockSegment = 0;
+    }
+#endif
+}
+
+static inline stPinchSegment *getTailSegment(const stPinchBlock *block) {
+    return getSegmentFromHandle(block->tailSegment);
+}
+
+static inline void setTailSegment(stPinchBlock *block, stPinchSegment *segment) {
+    block->tailSegment = getSegmentHandle(segment);
+}
+
+static inline stPinchBlock *getPModifiedBlock(const stPinchBlock *block) {
+    return getBlockFromHandle(block->pModifiedBlock);
+}
+
+static inline void setPModifiedBlock(stPinchBlock *block, stPinchBlock *pModifiedBlock) {
+    block->pModifiedBlock = getBlockHandle(pModifiedBlock);
+}
+
+static inline stPinchBlock *getNModifiedBlock(const stPinchBlock *block) {
+    return getBlockFromHandle(block->nModifiedBlock);
+}
+
+static inline void setNModifiedBlock(stPinchBlock *block, stPinchBlock *nModifiedBlock) {
+    block->nModifiedBlock = getBlockHandle(nModifiedBlock);
+}
+
+#else
+
+static inline stPinchThread *getSegmentThread(const stPinchSegment *segment) {
+    return segment->thread;
+}
+
+static inline void setSegmentThread(stPinchSegment *segment, stPinchThread *thread) {
+    segment->thread = thread;
+}
+
+static inline stPinchSegment *getPSegment(const stPinchSegment *segment) {
+    return segment->pSegment;
+}
+
+static inline void setPSegment(stPinchSegment *segment, stPinchSegment *pSegment) {
+    segment->pSegment = pSegment;
+}
+
+static inline stPinchSegment *getNSegment(const stPinchSegment *segment) {
+    return segment->nSegment;
+}
+
+static inline void setNSegment(stPinchSegment *segment, stPinchSegment *nSegment) {
+    segment->nSegment = nSegment;
+}
+
+static inline stPinchSegment *getNBlockSegment(const stPinchSegment *segment) {
+    return segment->nBlockSegment;
+}
+
+static inline void setNBlockSegment(stPinchSegment *segment, stPinchSegment *nBlockSegment) {
+    segment->nBlockSegment = nBlockSegment;
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+    if (nBlockSegment != NULL) {
+        nBlockSegment->pBlockSegment = segment;
+    }
+#endif
+}
+
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+static inline stPinchSegment *getPBlockSegment(const stPinchSegment *segment) {
+    return segment->pBlockSegment;
+}
+#endif
+
+static inline stPinchBlock *getSegmentBlock(const stPinchSegment *segment) {
+    return segment->block;
+}
+
+static inline void setSegmentBlock(stPinchSegment *segment, stPinchBlock *block) {
+    segment->block = block;
+}
+
+static inline bool getSegmentOrientation(const stPinchSegment *segment) {
+    return segment->blockOrientation;
+}
+
+static inline void setSegmentOrientation(stPinchSegment *segment, bool orientation) {
+    segment->blockOrientation = orientation;
+}
+
+static inline stPinchSegment *getHeadSegment(const stPinchBlock *block) {
+    return block->headSegment;
+}
+
+static inline void setHeadSegment(stPinchBlock *block, stPinchSegment *segment) {
+    block->headSegment = segment;
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+    if (segment != NULL) {
+        segment->pBlockSegment = NULL;
+    }
+#endif
+}
+
+static inline stPinchSegment *getTailSegment(const stPinchBlock *block) {
+    return block->tailSegment;
+}
+
+static inline void setTailSegment(stPinchBlock *block, stPinchSegment *segment) {
+    block->tailSegment = segment;
+}
+
+static inline stPinchBlock *getPModifiedBlock(const stPinchBlock *block) {
+    return block->pModifiedBlock;
+}
+
+static inline void setPModifiedBlock(stPinchBlock *block, stPinchBlock *pModifiedBlock) {
+    block->pModifiedBlock = pModifiedBlock;
+}
+
+static inline stPinchBlock *getNModifiedBlock(const stPinchBlock *block) {
+    return block->nModifiedBlock;
+}
+
+static inline void setNModifiedBlock(stPinchBlock *block, stPinchBlock *nModifiedBlock) {
+    block->nModifiedBlock = nModifiedBlock;
+}
+
+#endif
+
+#ifndef ST_PINCH_DOUBLY_LINKED_BLOCKS
+
+/*
+ * Without ST_PINCH_DOUBLY_LINKED_BLOCKS defined the segments of a block are singly linked,
+ * so the segment before another is found by walking the block from its head.
+ */
+static inline stPinchSegment *getPBlockSegment(const stPinchSegment *segment) {
+    stPinchSegment *pBlockSegment = getHeadSegment(getSegmentBlock(segment));
+    if (pBlockSegment == segment) {
+        return NULL;
+    }
+    while (getNBlockSegment(pBlockSegment) != segment) {
+        pBlockSegment = getNBlockSegment(pBlockSegment);
+        assert(pBlockSegment != NULL);
+    }
+    return pBlockSegment;
+}
+
+#endif
+
+//Slab allocation
+
+/*
+ * Allocator for objects of a single size class. Objects are carved out of
+ * large slabs and recycled through a free list; the slabs are only released,
+ * all at once, when the allocator is destructed.
+ */
+struct _stPinchSlabAllocator {
+    size_t objectSize;
+    int64_t objectsPerSlab; // Size of the next slab, grows geometrically up to a maximum
+    stList *slabs; // With compact handles, the chunk numbers of the slabs
+    void *freeList; // Singly linked through the first word of each free object
+    char *nextObject; // Unused region at the end of the most recent slab
+    char *slabEnd;
+#ifdef ST_PINCH_COMPACT_HANDLES
+    stPinchHandleTable *handles;
+    size_t handleOffset; // Offset of the object's own handle within it
+#endif
+};
+
+#define ST_PINCH_SLAB_MIN_OBJECTS 256
+#define ST_PINCH_SLAB_MAX_OBJECTS 65536
+
+static stPinchSlabAllocator *stPinchSlabAllocator_construct(size_t objectSize) {
+    assert(objectSize >= sizeof(void *));
+    stPinchSlabAllocator *allocator = st_calloc(1, sizeof(stPinchSlabAllocator));
+    allocator->objectSize = objectSize;
+    allocator->objectsPerSlab = ST_PINCH_SLAB_MIN_OBJECTS;
+    allocator->slabs = stList_construct3(0, free);
+    return allocator;
+}
+
+#ifdef ST_PINCH_COMPACT_HANDLES
+static stPinchSlabAllocator *stPinchSlabAllocator_construct2(size_t objectSize, stPinchHandleTable *handles,
+        size_t handleOffset) {
+    assert(handleOffset >= sizeof(void *)); // The free list must not overwrite the handle
+    stPinchSlabAllocator *allocator = stPinchSlabAllocator_construct(objectSize);
+    allocator->objectsPerSlab = ST_PINCH_CHUNK_OBJECTS;
+    stList_setDestructor(allocator->slabs, NULL);
+    allocator->handles = handles;
+    allocator->handleOffset = handleOffset;
+    return allocator;
+}
+#endif
+
+static void stPinchSlabAllocator_destruct(stPinchSlabAllocator *allocator) {
+#ifdef ST_PINCH_COMPACT_HANDLES
+    for (int64_t i = 0; i < stList_length(allocator->slabs); i++) {
+        stPinchHandleTable_removeChunk(allocator->handles, (uint32_t) (intptr_t) stList_get(allocator->slabs, i));
+    }
+#endif
+    stList_destruct(allocator->slabs);
+    free(allocator);
+}
+
+static void stPinchSlabAllocator_addSlab(stPinchSlabAllocator *allocator) {
+    char *slab = st_malloc(allocator->objectSize * allocator->objectsPerSlab);
+    allocator->nextObject = slab;
+    allocator->slabEnd = slab + allocator->objectSize * allocator->objectsPerSlab;
+#ifdef ST_PINCH_COMPACT_HANDLES
+    //Each object permanently holds its own handle
+    uint32_t chunkNumber = stPinchHandleTable_addChunk(allocator->handles, slab);
+    for (int64_t i = 0; i < ST_PINCH_CHUNK_OBJECTS; i++) {
+        *((stPinchHandle *) (slab + i * allocator->objectSize + allocator->handleOffset)) = (chunkNumber
+                << ST_PINCH_CHUNK_BITS) | i;
+    }
+    stList_append(allocator->slabs, (void *) (intptr_t) chunkNumber);
+#else
+    stList_append(allocator->slabs, slab);
+    if (allocator->objectsPerSlab < ST_PINCH_SLAB_MAX_OBJECTS) {
+        allocator->objectsPerSlab *= 2;
+    }
+#endif
+}
+
+/*
+ * Returns a zeroed object.
+ */
+static void *stPinchSlabAllocator_allocate(stPinchSlabAllocator *allocator) {
+    char *object = allocator->freeList;
+    if (object != NULL) {
+        allocator->freeList = *((void **) object);
+    } else {
+        if (allocator->nextObject == allocator->slabEnd) {
+            stPinchSlabAllocator_addSlab(allocator);
+        }
+        object = allocator->nextObject;
+        allocator->nextObject += allocator->objectSize;
+    }
+#ifdef ST_PINCH_COMPACT_HANDLES
+    stPinchHandle handle = *((stPinchHandle *) (object + allocator->handleOffset));
+    memset(object, 0, allocator->objectSize);
+    *((stPinchHandle *) (object + allocator->handleOffset)) = handle;
+#else
+    memset(object, 0, allocator->objectSize);
+#endif
+    return object;
+}
+
+static void stPinchSlabAllocator_free(stPinchSlabAllocator *allocator, void *object) {
+    *((void **) object) = allocator->freeList;
+    allocator->freeList = object;
+}
+
+/*
+ * Moves the slabs, and so the objects allocated from them, of allocator2 into
+ * allocator, then destructs allocator2.
+ */
+static void stPinchSlabAllocator_merge(stPinchSlabAllocator *allocator, stPinchSlabAllocator *allocator2) {
+    assert(allocator->objectSize == allocator2->objectSize);
+    stList_appendAll(allocator->slabs, allocator2->slabs);
+    stList_setDestructor(allocator2->slabs, NULL);
+    stList_destruct(allocator2->slabs); //The slabs now belong to allocator
+    allocator2->slabs = stList_construct();
+    //The unused end of allocator2's last slab is not lost, but goes onto the free list
+    for (char *object = allocator2->nextObject; object < allocator2->slabEnd; object += allocator2->objectSize) {
+        stPinchSlabAllocator_free(allocator, object);
+    }
+    void *object = allocator2->freeList;
+    while (object != NULL) {
+        void *nObject = *((void **) object);
+        stPinchSlabAllocator_free(allocator, object);
+        object = nObject;
+    }
+    stPinchSlabAllocator_destruct(allocator2);
+}
+
+static stPinchSlabAllocator *constructSegmentAllocator() {
+#ifdef ST_PINCH_COMPACT_HANDLES
+    return stPinchSlabAllocator_construct2(sizeof(stPinchSegment), &segmentHandles, offsetof(stPinchSegment, handle));
+#else
+    return stPinchSlabAllocator_construct(sizeof(stPinchSegment));
+#endif
+}
+
+static stPinchSlabAllocator *constructBlockAllocator() {
+#ifdef ST_PINCH_COMPACT_HANDLES
+    return stPinchSlabAllocator_construct2(sizeof(stPinchBlock), &blockHandles, offsetof(stPinchBlock, handle));
+#else
+    return stPinchSlabAllocator_construct(sizeof(stPinchBlock));
+#endif
+}
+
+static stPinchSegment *allocateSegment(stPinchThread *thread) {
+    if (thread->segmentAllocator != NULL) {
+        return stPinchSlabAllocator_allocate(thread->segmentAllocator);
+    }
+    return st_calloc(1, sizeof(stPinchSegment));
+}
+
+static void freeSegment(stPinchSegment *segment) {
+    if (getSegmentThread(segment)->segmentAllocator != NULL) {
+        stPinchSlabAllocator_free(getSegmentThread(segment)->segmentAllocator, segment);
+    } else {
+        free(segment);
+    }
+}
+
+//Journal of the mutations made in a transaction
+
+static stPinchJournalEntry *stPinchJournal_append(stPinchJournal *journal, stPinchJournalEntryType type, void *object) {
+    if (journal->entryNumber == journal->maxEntryNumber) {
+        journal->maxEntryNumber = journal->maxEntryNumber * 2 + 64;
+        journal->entries = st_realloc(journal->entries, journal->maxEntryNumber * sizeof(stPinchJournalEntry));
+    }
+    stPinchJournalEntry *entry = &journal->entries[journal->entryNumber++];
+    entry->type = type;
+    entry->object = object;
+    return entry;
+}
+
+/*
+ * Records the block fields of the segment, before they are changed. Only the first record of
+ * an object in a transaction matters, that being the last one restored.
+ */
+static void journalSegment(stPinchSegment *segment) {
+    stPinchJournal *journal = getSegmentThread(segment)->journal;
+    if (journal != NULL) {
+        stPinchJournalEntry *entry = stPinchJournal_append(journal, ST_PINCH_JOURNAL_SEGMENT, segment);
+        entry->pointer1 = getSegmentBlock(segment);
+        entry->pointer2 = getNBlockSegment(segment);
+        entry->value1 = getSegmentOrientation(segment);
+    }
+}
+
+/*
+ * Records the fields of the block, which must have a head segment, before they are changed.
+ */
+static void journalBlock(stPinchBlock *block) {
+    stPinchJournal *journal = getSegmentThread(getHeadSegment(block))->journal;
+    if (journal != NULL) {
+        stPinchJournalEntry *entry = stPinchJournal_append(journal, ST_PINCH_JOURNAL_BLOCK, block);
+        entry->pointer1 = getHeadSegment(block);
+        entry->pointer2 = getTailSegment(block);
+        entry->value1 = block->degree;
+        entry->value2 = block->numSupportingHomologies;
+    }
+}
+
+/*
+ * Records that the block's modified flag is about to be flipped.
+ */
+static void journalModifiedFlag(stPinchJournal *journal, stPinchBlock *block, bool flag) {
+    stPinchJournalEntry *entry = stPinchJournal_append(journal, ST_PINCH_JOURNAL_MODIFIED_FLAG, block);
+    entry->value1 = flag;
+    if (flag) {
+        entry->pointer1 = getPModifiedBlock(block);
+        entry->pointer2 = getNModifiedBlock(block);
+    }
+}
+
+//Block registry
+
+static void stPinchBlockRegistry_add(stPinchBlockRegistry *registry, stPinchBlock *block) {
+    if (registry->emptySlotNumber > 0) {
+        block->slot = registry->emptySlots[--registry->emptySlotNumber];
+    } else {
+        if (registry->length == registry->maxLength) {
+            registry->maxLength = registry->maxLength == 0 ? 64 : registry->maxLength * 2;
+            registry->blocks = st_realloc(registry->blocks, registry->maxLength * sizeof(stPinchBlock *));
+        }
+        block->slot = registry->length++;
+    }
+    registry->blocks[block->slot] = block;
+    registry->blockNumber++;
+}
+
+static void stPinchBlockRegistry_remove(stPinchBlockRegistry *registry, stPinchBlock *block) {
+    if (block->slot >= registry->length || registry->blocks[block->slot] != block) {
+        //The block predates a parallel batch; each block is pinched by only one worker, so no other
+        //worker writes the slot, and the emptied slots are collected by stPinchBlockRegistry_compact
+        assert(registry->parent != NULL && registry->parent->blocks[block->slot] == block);
+        registry->parent->blocks[block->slot] = NULL;
+        return;
+    }
+    registry->blocks[block->slot] = NULL;
+    registry->blockNumber--;
+    if (registry->emptySlotNumber == registry->maxEmptySlotNumber) {
+        registry->maxEmptySlotNumber = registry->maxEmptySlotNumber == 0 ? 64 : registry->maxEmptySlotNumber * 2;
+        registry->emptySlots = st_realloc(registry->emptySlots, registry->maxEmptySlotNumber * sizeof(int64_t));
+    }
+    registry->emptySlots[registry->emptySlotNumber++] = block->slot;
+}
+
+/*
+ * Reverses the addition of the block, which must be the last change made to the registry.
+ */
+static void stPinchBlockRegistry_undoAdd(stPinchBlockRegistry *registry, stPinchBlock *block, bool reusedSlot) {
+    if (reusedSlot) {
+        stPinchBlockRegistry_remove(registry, block);
+    } else {
+        assert(block->slot == registry->length - 1 && registry->blocks[block->slot] == block);
+        registry->blocks[block->slot] = NULL;
+        registry->length--;
+        registry->blockNumber--;
+    }
+}
+
+/*
+ * Reverses the removal of the block, which must be the last change made to the registry.
+ */
+static void stPinchBlockRegistry_undoRemove(stPinchBlockRegistry *registry, stPinchBlock *block) {
+    assert(registry->emptySlotNumber > 0 && registry->emptySlots[registry->emptySlotNumber - 1] == block->slot);
+    registry->emptySlotNumber--;
+    registry->blocks[block->slot] = block;
+    registry->blockNumber++;
+}
+
+/*
+ * Removes the empty slots, keeping the order of the blocks.
+ */
+static void stPinchBlockRegistry_compact(stPinchBlockRegistry *registry) {
+    int64_t j = 0;
+    for (int64_t i = 0; i < registry->length; i++) {
+        stPinchBlock *block = registry->blocks[i];
+        if (block != NULL) {
+            block->slot = j;
+            registry->blocks[j++] = block;
+        }
+    }
+    registry->length = j;
+    registry->blockNumber = j;
+    registry->emptySlotNumber = 0;
+}
+
+/*
+ * Moves the blocks of registry2 to the end of registry, which has no empty slots.
+ */
+static void stPinchBlockRegistry_append(stPinchBlockRegistry *registry, stPinchBlockRegistry *registry2) {
+    assert(registry->emptySlotNumber == 0);
+    for (int64_t i = 0; i < registry2->length; i++) {
+        if (registry2->blocks[i] != NULL) {
+            stPinchBlockRegistry_add(registry, registry2->blocks[i]);
+        }
+    }
+    free(registry2->blocks);
+    free(registry2->emptySlots);
+    memset(registry2, 0, sizeof(stPinchBlockRegistry));
+}
+
+static stPinchBlock *allocateBlock(stPinchThread *thread) {
+    stPinchBlock *block;
+    if (thread->blockAllocator != NULL) {
+        block = stPinchSlabAllocator_allocate(thread->blockAllocator);
+    } else {
+        block = st_calloc(1, sizeof(stPinchBlock));
+    }
+    if (thread->journal != NULL) {
+        stPinchJournal_append(thread->journal, ST_PINCH_JOURNAL_ALLOCATE_BLOCK, block)->value1 =
+                thread->blockRegistry->emptySlotNumber > 0;
+    }
+    stPinchBlockRegistry_add(thread->blockRegistry, block);
+    return block;
+}
+
+static void releaseBlock(stPinchBlock *block, stPinchSlabAllocator *blockAllocator) {
+    if (blockAllocator != NULL) {
+        stPinchSlabAllocator_free(blockAllocator, block);
+    } else {
+        free(block);
+    }
+}
+
+//Modified blocks
+
+static void stPinchModifiedBlocks_add(stPinchModifiedBlocks *modifiedBlocks, stPinchBlock *block) {
+    if (modifiedBlocks->concurrent) {
+        pthread_mutex_lock(&modifiedBlocks->mutex);
+    }
+    setPModifiedBlock(block, NULL);
+    setNModifiedBlock(block, modifiedBlocks->head);
+    if (modifiedBlocks->head != NULL) {
+        setPModifiedBlock(modifiedBlocks->head, block);
+    }
+    modifiedBlocks->head = block;
+    modifiedBlocks->length++;
+    if (modifiedBlocks->concurrent) {
+        pthread_mutex_unlock(&modifiedBlocks->mutex);
+    }
+}
+
+static void stPinchModifiedBlocks_remove(stPinchModifiedBlocks *modifiedBlocks, stPinchBlock *block) {
+    if (modifiedBlocks->concurrent) {
+        pthread_mutex_lock(&modifiedBlocks->mutex);
+    }
+    if (getPModifiedBlock(block) != NULL) {
+        setNModifiedBlock(getPModifiedBlock(block), getNModifiedBlock(block));
+    } else {
+        assert(modifiedBlocks->head == block);
+        modifiedBlocks->head = getNModifiedBlock(block);
+    }
+    if (getNModifiedBlock(block) != NULL) {
+        setPModifiedBlock(getNModifiedBlock(block), getPModifiedBlock(block));
+    }
+    modifiedBlocks->length--;
+    if (modifiedBlocks->concurrent) {
+        pthread_mutex_unlock(&modifiedBlocks->mutex);
+    }
+}
+
+// The thread is that of any segment that was in the block; all threads in a set share an allocator.
+static void freeBlock(stPinchBlock *block, stPinchThread *thread) {
+    if (stPinchBlock_getModifiedFlag(block)) {
+        if (thread->journal != NULL) {
+            journalModifiedFlag(thread->journal, block, 1);
+        }
+        stPinchModifiedBlocks_remove(thread->modifiedBlocks, block);
+    }
+    stPinchBlockRegistry_remove(thread->blockRegistry, block);
+    if (thread->journal != NULL) {
+        stPinchJournal_append(thread->journal, ST_PINCH_JOURNAL_FREE_BLOCK, block);
+    } else {
+        releaseBlock(block, thread->blockAllocator);
+    }
+}
 
-struct _stPinchThreadSet {
-    stList *threads;
-    stHash *threadsHash;
-};
+//Dirty boundaries
 
-struct _stPinchThread {
-    int64_t name;
-    int64_t start;
-    int64_t length;
-    stSortedSet *segments;
-};
+static void markAllBoundariesDirty(stPinchThread *thread) {
+    free(thread->dirtyBoundaries);
+    thread->dirtyBoundaries = NULL;
+    thread->dirtyBoundaryNumber = 0;
+    thread->maxDirtyBoundaryNumber = 0;
+    thread->allBoundariesDirty = 1;
+}
 
-struct _stPinchSegment {
-    stPinchThread *thread;
-    int64_t start;
-    stPinchSegment *pSegment;
-    stPinchSegment *nSegment;
-    stPinchBlock *block;
-    bool blockOrientation;
-    stPinchSegment *nBlockSegment;
-};
+static void markBoundaryDirty(stPinchThread *thread, int64_t coordinate) {
+    if (thread->allBoundariesDirty) {
+        return;
+    }
+    if (thread->dirtyBoundaryNumber == thread->maxDirtyBoundaryNumber) {
+        //Past one per segment it is cheaper to examine every boundary of the thread at the next join
+        if (thread->dirtyBoundaryNumber >= stPinchSegmentIndex_size(thread->segments)) {
+            markAllBoundariesDirty(thread);
+            return;
+        }
+        thread->maxDirtyBoundaryNumber = thread->maxDirtyBoundaryNumber * 2 + 16;
+        thread->dirtyBoundaries = st_realloc(thread->dirtyBoundaries, thread->maxDirtyBoundaryNumber * sizeof(int64_t));
+    }
+    thread->dirtyBoundaries[thread->dirtyBoundaryNumber++] = coordinate;
+}
 
-struct _stPinchBlock {
-    uint64_t degree;
-    uint64_t numSupportingHomologies : 62;
-    uint64_t flags : 2; // From least significant bit to highest: modified flag, filter flag
-    stPinchSegment *headSegment;
-    stPinchSegment *tailSegment;
-};
+/*
+ * Records the boundaries either side of the segment, whose block, or whose block's degree or
+ * support, has changed. Whether a boundary is trivial depends on the whole block ends either
+ * side of it, so marking any one segment of a block marks both of its ends.
+ */
+static void markSegmentBoundariesDirty(stPinchSegment *segment) {
+    stPinchThread *thread = getSegmentThread(segment);
+    if (thread->trackBoundaries) {
+        markBoundaryDirty(thread, segment->start);
+        if (getNSegment(segment) != NULL) {
+            markBoundaryDirty(thread, getNSegment(segment)->start);
+        }
+    }
+}
 
 //Blocks
 
 static void connectBlockToSegment(stPinchSegment *segment, bool orientation, stPinchBlock *block, stPinchSegment *nBlockSegment) {
+    journalSegment(segment);
     if(block != NULL) { // This makes sure  the modified flag is set when the block is altered
         stPinchBlock_setModifiedFlag(block, true);
     }
-    segment->block = block;
-    segment->blockOrientation = orientation;
-    segment->nBlockSegment = nBlockSegment;
+    setSegmentBlock(segment, block);
+    setSegmentOrientation(segment, orientation);
+    setNBlockSegment(segment, nBlockSegment);
+    markSegmentBoundariesDirty(segment);
 }
 
 stPinchBlock *stPinchBlock_construct3(stPinchSegment *segment, bool orientation) {
-    stPinchBlock *block = st_calloc(1, sizeof(stPinchBlock)); // note, calloc will set flags and numSupportingHomologies to be 0
-    block->headSegment = segment;
-    block->tailSegment = segment;
+    stPinchBlock *block = allocateBlock(getSegmentThread(segment)); // note, allocation zeroes flags and numSupportingHomologies
+    setHeadSegment(block, segment);
+    setTailSegment(block, segment);
     connectBlockToSegment(segment, orientation, block, NULL); // this will set the modified flag
     block->degree = 1;
     return block;
@@ -68,9 +943,9 @@ stPinchBlock *stPinchBlock_construct2(stPinchSegment *segment) {
 
 stPinchBlock *stPinchBlock_construct(stPinchSegment *segment1, bool orientation1, stPinchSegment *segment2, bool orientation2) {
     assert(stPinchSegment_getLength(segment1) == stPinchSegment_getLength(segment2));
-    stPinchBlock *block = st_calloc(1, sizeof(stPinchBlock)); // note, calloc will set flags and numSupportingHomologies to be 0
-    block->headSegment = segment1;
-    block->tailSegment = segment2;
+    stPinchBlock *block = allocateBlock(getSegmentThread(segment1)); // note, allocation zeroes flags and numSupportingHomologies
+    setHeadSegment(block, segment1);
+    setTailSegment(block, segment2);
     connectBlockToSegment(segment1, orientation1, block, segment2);  // this will set the modified flag
     connectBlockToSegment(segment2, orientation2, block, NULL);
     block->degree = 2;
@@ -79,6 +954,7 @@ stPinchBlock *stPinchBlock_construct(stPinchSegment *segment1, bool orientation1
 }
 
 void stPinchBlock_destruct(stPinchBlock *block) {
+    stPinchThread *thread = getSegmentThread(getHeadSegment(block));
     stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(block);
     stPinchSegment *segment = stPinchBlockIt_getNext(&blockIt);
     while (segment != NULL) {
@@ -86,7 +962,7 @@ void stPinchBlock_destruct(stPinchBlock *block) {
         connectBlockToSegment(segment, 0, NULL, NULL);
         segment = nSegment;
     }
-    free(block);
+    freeBlock(block, thread);
 }
 
 // Same as stPinchBlock_pinch2, but doesn't increase the support value.
@@ -98,7 +974,9 @@ stPinchBlock *stPinchBlock_pinch2_noSupport(stPinchBlock *block, stPinchSegment
 
 stPinchBlock *stPinchBlock_pinch(stPinchBlock *block1, stPinchBlock *block2, bool orientation) {
     if (block1 == block2) { // in this case we don't modify the block
+        journalBlock(block1);
         block1->numSupportingHomologies++;
+        markSegmentBoundariesDirty(getHeadSegment(block1));
         return block1; //Already joined
     }
     if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) { //Avoid merging large blocks into small blocks
@@ -116,17 +994,27 @@ stPinchBlock *stPinchBlock_pinch(stPinchBlock *block1, stPinchBlock *block2, boo
         stPinchBlock_pinch2_noSupport(block1, segment, (segmentOrientation && orientation) || (!segmentOrientation && !orientation));
         segment = nSegment;
     }
+    journalBlock(block1);
     block1->numSupportingHomologies += block2->numSupportingHomologies + 1;
-    free(block2);
+    markSegmentBoundariesDirty(getHeadSegment(block1));
+    getSegmentThread(getHeadSegment(block1))->batchStats->merges++;
+    freeBlock(block2, getSegmentThread(getHeadSegment(block1)));
     return block1;
 }
 
 stPinchBlock *stPinchBlock_pinch2(stPinchBlock *block, stPinchSegment *segment, bool orientation) {
-    assert(block->tailSegment != NULL);
-    assert(block->tailSegment->nBlockSegment == NULL);
-    block->tailSegment->nBlockSegment = segment;
+    assert(getTailSegment(block) != NULL);
+    assert(getNBlockSegment(getTailSegment(block)) == NULL);
+    journalBlock(block);
+    journalSegment(getTailSegment(block));
+    setNBlockSegment(getTailSegment(block), segment);
     connectBlockToSegment(segment, orientation, block, NULL); // sets the modified flag
-    block->tailSegment = segment;
+    setTailSegment(block, segment);
+#ifdef ST_PINCH_COMPACT_HANDLES
+    if (block->degree == UINT32_MAX) {
+        st_errAbort("Pinch block degree exceeds the 32-bit limit of compact handles");
+    }
+#endif
     block->degree++;
     block->numSupportingHomologies++;
     return block;
@@ -134,14 +1022,14 @@ stPinchBlock *stPinchBlock_pinch2(stPinchBlock *block, stPinchSegment *segment,
 
 stPinchBlockIt stPinchBlock_getSegmentIterator(stPinchBlock *block) {
     stPinchBlockIt blockIt;
-    blockIt.segment = block->headSegment;
+    blockIt.segment = getHeadSegment(block);
     return blockIt;
 }
 
 stPinchSegment *stPinchBlockIt_getNext(stPinchBlockIt *blockIt) {
     stPinchSegment *segment = blockIt->segment;
     if (segment != NULL) {
-        blockIt->segment = segment->nBlockSegment;
+        blockIt->segment = getNBlockSegment(segment);
     }
     return segment;
 }
@@ -150,9 +1038,13 @@ uint64_t stPinchBlock_getDegree(stPinchBlock *block) {
     return block->degree;
 }
 
+int64_t stPinchBlock_getIndex(stPinchBlock *block) {
+    return block->slot;
+}
+
 stPinchSegment *stPinchBlock_getFirst(stPinchBlock *block) {
-    assert(block->headSegment != NULL);
-    return block->headSegment;
+    assert(getHeadSegment(block) != NULL);
+    return getHeadSegment(block);
 }
 
 int64_t stPinchBlock_getLength(stPinchBlock *block) {
@@ -185,7 +1077,19 @@ bool stPinchBlock_getModifiedFlag(stPinchBlock* block) {
 }
 
 void stPinchBlock_setModifiedFlag(stPinchBlock* block, bool flag) {
-    setFlag(block, 0, flag);
+    if (flag != getFlag(block, 0)) {
+        stPinchThread *thread = getSegmentThread(getHeadSegment(block));
+        if (thread->journal != NULL) {
+            journalModifiedFlag(thread->journal, block, !flag);
+        }
+        stPinchModifiedBlocks *modifiedBlocks = thread->modifiedBlocks;
+        if (flag) {
+            stPinchModifiedBlocks_add(modifiedBlocks, block);
+        } else {
+            stPinchModifiedBlocks_remove(modifiedBlocks, block);
+        }
+        setFlag(block, 0, flag);
+    }
 }
 
 bool stPinchBlock_getFilterFlag(stPinchBlock* block) {
@@ -193,6 +1097,10 @@ bool stPinchBlock_getFilterFlag(stPinchBlock* block) {
 }
 
 void stPinchBlock_setFilterFlag(stPinchBlock* block, bool flag) {
+    stPinchJournal *journal = getSegmentThread(getHeadSegment(block))->journal;
+    if (journal != NULL) {
+        stPinchJournal_append(journal, ST_PINCH_JOURNAL_FILTER_FLAG, block)->value1 = getFlag(block, 1);
+    }
     setFlag(block, 1, flag);
 }
 
@@ -201,20 +1109,11 @@ void stPinchBlock_trim(stPinchBlock *block, int64_t blockEndTrim) {
         return;
     }
     if (stPinchBlock_getLength(block) > 2 * blockEndTrim) {
-        stPinchSegment *segment = stPinchBlock_getFirst(block);
-        stPinchSegment_split(segment, stPinchSegment_getStart(segment) + blockEndTrim - 1);
-        block = stPinchSegment_getBlock(segment);
-        assert(block != NULL);
-        stPinchBlock_destruct(block);
-        segment = stPinchSegment_get3Prime(segment);
-        assert(segment != NULL);
-        assert(stPinchSegment_getBlock(segment) != NULL);
-        stPinchSegment_split(segment, stPinchSegment_getStart(segment) + stPinchSegment_getLength(segment) - 1 - blockEndTrim);
-        segment = stPinchSegment_get3Prime(segment);
-        assert(segment != NULL);
-        block = stPinchSegment_getBlock(segment);
-        assert(block != NULL);
-        stPinchBlock_destruct(block);
+        int64_t offsets[2] = { blockEndTrim, stPinchBlock_getLength(block) - blockEndTrim };
+        stPinchBlock *blocks[3];
+        stPinchBlock_splitAt(block, offsets, 2, blocks);
+        stPinchBlock_destruct(blocks[0]);
+        stPinchBlock_destruct(blocks[2]);
     } else { //Too short, so we just destroy it
         stPinchBlock_destruct(block);
     }
@@ -227,36 +1126,37 @@ int64_t stPinchSegment_getStart(stPinchSegment *segment) {
 }
 
 int64_t stPinchSegment_getLength(stPinchSegment *segment) {
-    assert(segment->nSegment != NULL);
-    return segment->nSegment->start - segment->start;
+    assert(getNSegment(segment) != NULL);
+    return getNSegment(segment)->start - segment->start;
 }
 
 stPinchBlock *stPinchSegment_getBlock(stPinchSegment *segment) {
-    return segment->block;
+    return getSegmentBlock(segment);
 }
 
 bool stPinchSegment_getBlockOrientation(stPinchSegment *segment) {
-    return segment->blockOrientation;
+    return getSegmentOrientation(segment);
 }
 
 void stPinchSegment_setBlockOrientation(stPinchSegment *segment, bool orientation) {
-    segment->blockOrientation = orientation;
+    journalSegment(segment);
+    setSegmentOrientation(segment, orientation);
 }
 
 stPinchSegment *stPinchSegment_get5Prime(stPinchSegment *segment) {
-    return segment->pSegment;
+    return getPSegment(segment);
 }
 
 stPinchSegment *stPinchSegment_get3Prime(stPinchSegment *segment) {
-    return segment->nSegment->nSegment != NULL ? segment->nSegment : NULL;
+    return getNSegment(getNSegment(segment)) != NULL ? getNSegment(segment) : NULL;
 }
 
 int64_t stPinchSegment_getName(stPinchSegment *segment) {
-    return stPinchThread_getName(segment->thread);
+    return stPinchThread_getName(getSegmentThread(segment));
 }
 
 stPinchThread *stPinchSegment_getThread(stPinchSegment *segment) {
-    return segment->thread;
+    return getSegmentThread(segment);
 }
 
 //Private segment functions
@@ -265,7 +1165,7 @@ void stPinchSegment_destruct(stPinchSegment *segment) {
     if (stPinchSegment_getBlock(segment) != NULL) {
         stPinchBlock_destruct(stPinchSegment_getBlock(segment));
     }
-    free(segment);
+    freeSegment(segment);
 }
 
 int stPinchSegment_compareBySequencePosition(const stPinchSegment *segment1, const stPinchSegment *segment2) {
@@ -273,28 +1173,35 @@ int stPinchSegment_compareBySequencePosition(const stPinchSegment *segment1, con
 }
 
 int stPinchSegment_compare(const stPinchSegment *segment1, const stPinchSegment *segment2) {
-    if(segment1->thread->name != segment2->thread->name) {
-        return segment1->thread->name > segment2->thread->name ? 1 : -1;
+    if(getSegmentThread(segment1)->name != getSegmentThread(segment2)->name) {
+        return getSegmentThread(segment1)->name > getSegmentThread(segment2)->name ? 1 : -1;
     }
     return stPinchSegment_compareBySequencePosition(segment1, segment2);
 }
 
 static stPinchSegment *stPinchSegment_construct(int64_t start, stPinchThread *thread) {
-    stPinchSegment *segment = st_calloc(1, sizeof(stPinchSegment));
+    stPinchSegment *segment = allocateSegment(thread);
     segment->start = start;
-    segment->thread = thread;
+    setSegmentThread(segment, thread);
     return segment;
 }
 
 static stPinchSegment *stPinchSegment_splitP(stPinchSegment *segment, int64_t leftBlockLength) {
-    stPinchSegment *nSegment = segment->nSegment;
+    stPinchSegment *nSegment = getNSegment(segment);
     assert(nSegment != NULL);
-    stPinchSegment *rightSegment = stPinchSegment_construct(stPinchSegment_getStart(segment) + leftBlockLength, segment->thread);
-    segment->nSegment = rightSegment;
-    rightSegment->pSegment = segment;
-    rightSegment->nSegment = nSegment;
-    nSegment->pSegment = rightSegment;
-    stSortedSet_insert(segment->thread->segments, rightSegment);
+    stPinchSegment *rightSegment = stPinchSegment_construct(stPinchSegment_getStart(segment) + leftBlockLength, getSegmentThread(segment));
+    setNSegment(segment, rightSegment);
+    setPSegment(rightSegment, segment);
+    setNSegment(rightSegment, nSegment);
+    setPSegment(nSegment, rightSegment);
+    stPinchSegmentIndex_insert(getSegmentThread(segment)->segments, rightSegment->start, rightSegment);
+    if (getSegmentThread(segment)->journal != NULL) {
+        stPinchJournal_append(getSegmentThread(segment)->journal, ST_PINCH_JOURNAL_SPLIT, rightSegment);
+    }
+    getSegmentThread(segment)->batchStats->splits++;
+    if (getSegmentThread(segment)->trackBoundaries) {
+        markBoundaryDirty(getSegmentThread(segment), rightSegment->start);
+    }
     return rightSegment;
 }
 
@@ -313,6 +1220,7 @@ void stPinchSegment_split(stPinchSegment *segment, int64_t leftSideOfSplitPoint)
             rightSegmentLength = leftSegmentLength;
             leftSegmentLength = i;
         }
+        journalBlock(block);
         stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(block);
         segment = stPinchBlockIt_getNext(&blockIt);
         assert(segment != NULL);
@@ -324,13 +1232,13 @@ void stPinchSegment_split(stPinchSegment *segment, int64_t leftSideOfSplitPoint)
             pSegment = segment;
         } else {
             stPinchSegment *segment2 = stPinchSegment_splitP(segment, rightSegmentLength);
-            block->headSegment = segment2;
-            connectBlockToSegment(segment2, 0, block, segment->nBlockSegment);
-            if (segment2->nBlockSegment == NULL) {
-                block->tailSegment = segment2;
+            setHeadSegment(block, segment2);
+            connectBlockToSegment(segment2, 0, block, getNBlockSegment(segment));
+            if (getNBlockSegment(segment2) == NULL) {
+                setTailSegment(block, segment2);
             }
             block2 = stPinchBlock_construct2(segment);
-            segment->blockOrientation = 0; //This gets sets positive by default.
+            setSegmentOrientation(segment, 0); //This gets sets positive by default.
             pSegment = segment2;
         }
         while ((segment = stPinchBlockIt_getNext(&blockIt)) != NULL) {
@@ -340,10 +1248,11 @@ void stPinchSegment_split(stPinchSegment *segment, int64_t leftSideOfSplitPoint)
                 pSegment = segment;
             } else {
                 stPinchSegment *segment2 = stPinchSegment_splitP(segment, rightSegmentLength);
-                pSegment->nBlockSegment = segment2;
-                connectBlockToSegment(segment2, 0, block, segment->nBlockSegment);
-                if (segment2->nBlockSegment == NULL) {
-                    block->tailSegment = segment2;
+                journalSegment(pSegment);
+                setNBlockSegment(pSegment, segment2);
+                connectBlockToSegment(segment2, 0, block, getNBlockSegment(segment));
+                if (getNBlockSegment(segment2) == NULL) {
+                    setTailSegment(block, segment2);
                 }
                 stPinchBlock_pinch2_noSupport(block2, segment, 0);
                 pSegment = segment2;
@@ -355,27 +1264,98 @@ void stPinchSegment_split(stPinchSegment *segment, int64_t leftSideOfSplitPoint)
     }
 }
 
-void stPinchSegment_putSegmentFirstInBlock(stPinchSegment *segment) {
-    if(segment->block != NULL) {
-        if(segment->block->headSegment != segment) {
-            stPinchSegment *pBlockSegment = segment->block->headSegment;
-            while(pBlockSegment->nBlockSegment != segment) {
-                pBlockSegment = pBlockSegment->nBlockSegment;
-                assert(pBlockSegment != NULL);
+/*
+ * Gets the length of the ith of the pieces a block of the given length is cut into at the offsets.
+ */
+static int64_t getPieceLength(const int64_t *offsets, int64_t offsetNumber, int64_t length, int64_t i) {
+    return (i < offsetNumber ? offsets[i] : length) - (i > 0 ? offsets[i - 1] : 0);
+}
+
+void stPinchBlock_splitAt(stPinchBlock *block, const int64_t *offsets, int64_t offsetNumber, stPinchBlock **blocks) {
+    int64_t length = stPinchBlock_getLength(block);
+    for (int64_t i = 0; i < offsetNumber; i++) {
+        if (offsets[i] <= (i > 0 ? offsets[i - 1] : 0) || offsets[i] >= length) {
+            st_errAbort("Offsets to split a block of length %" PRIi64 " at must be increasing and within it", length);
+        }
+    }
+    stPinchBlock **children = blocks != NULL ? blocks : st_malloc((offsetNumber + 1) * sizeof(stPinchBlock *));
+    children[0] = block;
+    if (offsetNumber > 0) {
+        journalBlock(block);
+        uint64_t numSupportingHomologies = block->numSupportingHomologies;
+        stPinchSegment **pieces = st_malloc((offsetNumber + 1) * sizeof(stPinchSegment *));
+        stPinchSegment *segment = getHeadSegment(block);
+        stPinchSegment *pSegment = NULL; //The last segment of the first piece of the block
+        while (segment != NULL) {
+            stPinchSegment *nBlockSegment = getNBlockSegment(segment);
+            bool orientation = getSegmentOrientation(segment);
+            //Cut the segment into pieces, listed in the order of the block
+            if (orientation) {
+                pieces[0] = segment;
+                for (int64_t i = 0; i < offsetNumber; i++) {
+                    pieces[i + 1] = stPinchSegment_splitP(pieces[i], getPieceLength(offsets, offsetNumber, length, i));
+                }
+            } else {
+                pieces[offsetNumber] = segment;
+                for (int64_t i = offsetNumber; i > 0; i--) {
+                    pieces[i - 1] = stPinchSegment_splitP(pieces[i], getPieceLength(offsets, offsetNumber, length, i));
+                }
+            }
+            //The first piece takes the place of the segment in the block, the others go to the new blocks
+            bool first = pSegment == NULL;
+            connectBlockToSegment(pieces[0], orientation, block, NULL);
+            if (first) {
+                setHeadSegment(block, pieces[0]);
+            } else {
+                journalSegment(pSegment);
+                setNBlockSegment(pSegment, pieces[0]);
+            }
+            pSegment = pieces[0];
+            for (int64_t i = 1; i <= offsetNumber; i++) {
+                if (first) {
+                    children[i] = stPinchBlock_construct3(pieces[i], orientation);
+                } else {
+                    stPinchBlock_pinch2_noSupport(children[i], pieces[i], orientation);
+                }
             }
-            pBlockSegment->nBlockSegment = segment->nBlockSegment;
-            if(segment->nBlockSegment == NULL) {
-                assert(segment->block->tailSegment == segment);
-                segment->block->tailSegment = pBlockSegment;
+            segment = nBlockSegment;
+        }
+        setTailSegment(block, pSegment);
+        for (int64_t i = 1; i <= offsetNumber; i++) {
+            children[i]->numSupportingHomologies = numSupportingHomologies;
+        }
+        free(pieces);
+    }
+    if (blocks == NULL) {
+        free(children);
+    }
+}
+
+void stPinchSegment_putSegmentFirstInBlock(stPinchSegment *segment) {
+    if(getSegmentBlock(segment) != NULL) {
+        if(getHeadSegment(getSegmentBlock(segment)) != segment) {
+            stPinchSegment *pBlockSegment = getPBlockSegment(segment);
+            assert(pBlockSegment != NULL && getNBlockSegment(pBlockSegment) == segment);
+            journalBlock(getSegmentBlock(segment));
+            journalSegment(pBlockSegment);
+            journalSegment(segment);
+            setNBlockSegment(pBlockSegment, getNBlockSegment(segment));
+            if(getNBlockSegment(segment) == NULL) {
+                assert(getTailSegment(getSegmentBlock(segment)) == segment);
+                setTailSegment(getSegmentBlock(segment), pBlockSegment);
             }
-            segment->nBlockSegment = segment->block->headSegment;
-            segment->block->headSegment = segment;
+            setNBlockSegment(segment, getHeadSegment(getSegmentBlock(segment)));
+            setHeadSegment(getSegmentBlock(segment), segment);
         }
     }
 }
 
 //Thread
 
+int64_t stPinchThread_getIndex(stPinchThread *thread) {
+    return thread->index;
+}
+
 int64_t stPinchThread_getName(stPinchThread *thread) {
     return thread->name;
 }
@@ -388,10 +1368,45 @@ int64_t stPinchThread_getLength(stPinchThread *thread) {
     return thread->length;
 }
 
+#define ST_PINCH_FINGER_MAX_STEPS 8
+
+/*
+ * Gets the segment containing the coordinate by walking from the finger segment, or
+ * NULL if the finger is NULL or the segment is not within a few segments of it.
+ */
+static stPinchSegment *walkFromFinger(stPinchSegment *finger, int64_t coordinate) {
+    for (int64_t i = 0; finger != NULL && i < ST_PINCH_FINGER_MAX_STEPS; i++) {
+        if (coordinate < finger->start) {
+            finger = getPSegment(finger);
+        } else if (coordinate >= getNSegment(finger)->start) {
+            finger = getNSegment(finger);
+            if (getNSegment(finger) == NULL) { //The terminator
+                return NULL;
+            }
+        } else {
+            return finger;
+        }
+    }
+    return NULL;
+}
+
 stPinchSegment *stPinchThread_getSegment(stPinchThread *thread, int64_t coordinate) {
-    stPinchSegment segment;
-    segment.start = coordinate;
-    stPinchSegment *segment2 = stSortedSet_searchLessThanOrEqual(thread->segments, &segment);
+    //Lookups tend to be close to the previous one, so first try walking from the segment it found
+    stPinchSegment *segment = walkFromFinger(thread->finger, coordinate);
+    if (segment != NULL) {
+        thread->fingerHits++;
+    } else {
+        thread->fingerMisses++;
+        segment = stPinchThread_getSegmentReadOnly(thread, coordinate);
+    }
+    if (segment != NULL) {
+        thread->finger = segment;
+    }
+    return segment;
+}
+
+stPinchSegment *stPinchThread_getSegmentReadOnly(stPinchThread *thread, int64_t coordinate) {
+    stPinchSegment *segment2 = stPinchSegmentIndex_searchLessThanOrEqual(thread->segments, coordinate);
     if (segment2 == NULL) {
         return NULL;
     }
@@ -402,12 +1417,37 @@ stPinchSegment *stPinchThread_getSegment(stPinchThread *thread, int64_t coordina
     return segment2;
 }
 
+/*
+ * Gets the segment of the thread containing the coordinate, walking from the finger
+ * segment if it is within a few segments of it, else using stPinchThread_getSegment.
+ * The finger must be a segment of the thread, or NULL.
+ */
+static stPinchSegment *getSegmentFromFinger(stPinchThread *thread, stPinchSegment *finger, int64_t coordinate) {
+    stPinchSegment *segment = walkFromFinger(finger, coordinate);
+    return segment != NULL ? segment : stPinchThread_getSegment(thread, coordinate);
+}
+
+int64_t stPinchThread_getFingerHits(stPinchThread *thread) {
+    return thread->fingerHits;
+}
+
+int64_t stPinchThread_getFingerMisses(stPinchThread *thread) {
+    return thread->fingerMisses;
+}
+
+// Forgets the finger if it is the given segment, which is being removed from the thread.
+static void releaseFinger(stPinchThread *thread, stPinchSegment *segment) {
+    if (thread->finger == segment) {
+        thread->finger = NULL;
+    }
+}
+
 stPinchSegment *stPinchThread_getFirst(stPinchThread *thread) {
-    return stSortedSet_getFirst(thread->segments);
+    return stPinchSegmentIndex_getFirst(thread->segments);
 }
 
 stPinchSegment *stPinchThread_getLast(stPinchThread *thread) {
-    return stSortedSet_getLast(thread->segments);
+    return stPinchSegmentIndex_getLast(thread->segments);
 }
 
 void stPinchThread_split(stPinchThread *thread, int64_t leftSideOfSplitPoint) {
@@ -418,6 +1458,8 @@ void stPinchThread_split(stPinchThread *thread, int64_t leftSideOfSplitPoint) {
     stPinchSegment_split(segment, leftSideOfSplitPoint);
 }
 
+static void merge3Prime(stPinchSegment *segment);
+
 void stPinchThread_joinTrivialBoundaries(stPinchThread *thread) {
     stPinchSegment *segment = stPinchThread_getFirst(thread);
     do {
@@ -428,11 +1470,7 @@ void stPinchThread_joinTrivialBoundaries(stPinchThread *thread) {
                     stPinchBlock *nBlock = stPinchSegment_getBlock(nSegment);
                     if (nBlock == NULL) {
                         //Trivial join
-                        segment->nSegment = nSegment->nSegment;
-                        assert(nSegment->nSegment != NULL);
-                        nSegment->nSegment->pSegment = segment;
-                        stSortedSet_remove(thread->segments, nSegment);
-                        stPinchSegment_destruct(nSegment);
+                        merge3Prime(segment);
                         continue;
                     }
                 }
@@ -460,7 +1498,14 @@ stPinchSegment *stPinchThread_pinchTrimPositive(stPinchSegment *segment, int64_t
     return segment;
 }
 
-void stPinchThread_pinchPositiveP(stPinchSegment *segment1, stPinchSegment *segment2, int64_t start1, int64_t start2, int64_t length) {
+/*
+ * As stPinchThread_pinchPositiveP, additionally setting last1 and last2 to the last segment
+ * of each thread the pinch reached, for use as cursors by a following pinch.
+ */
+static void pinchPositiveP(stPinchSegment *segment1, stPinchSegment *segment2, int64_t length,
+        stPinchSegment **last1, stPinchSegment **last2) {
+    *last1 = segment1;
+    *last2 = segment2;
     while (length > 0) {
         if (segment1 == segment2) {
             return; //This is a trivial alignment
@@ -489,11 +1534,18 @@ void stPinchThread_pinchPositiveP(stPinchSegment *segment1, stPinchSegment *segm
         }
         block1 = stPinchBlock_pinch(block1, block2, alignmentOrientation);
         length -= stPinchSegment_getLength(segment1);
+        *last1 = segment1;
+        *last2 = segment2;
         segment1 = stPinchSegment_get3Prime(segment1);
         segment2 = stPinchSegment_get3Prime(segment2);
     }
 }
 
+void stPinchThread_pinchPositiveP(stPinchSegment *segment1, stPinchSegment *segment2, int64_t start1, int64_t start2, int64_t length) {
+    stPinchSegment *last1, *last2;
+    pinchPositiveP(segment1, segment2, length, &last1, &last2);
+}
+
 void stPinchThread_pinchPositive(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length) {
     stPinchSegment *segment1 = stPinchThread_pinchP(stPinchThread_getSegment(thread1, start1), start1);
     stPinchSegment *segment2 = stPinchThread_pinchP(stPinchThread_getSegment(thread2, start2), start2);
@@ -515,7 +1567,14 @@ stPinchSegment *stPinchThread_pinchTrimNegative(stPinchSegment *segment, int64_t
     return stPinchSegment_get3Prime(segment);
 }
 
-void stPinchThread_pinchNegativeP(stPinchSegment *segment1, stPinchSegment *segment2, int64_t start1, int64_t start2, int64_t length) {
+/*
+ * As stPinchThread_pinchNegativeP, additionally setting last1 and last2 to the last segment
+ * of each thread the pinch reached, for use as cursors by a following pinch.
+ */
+static void pinchNegativeP(stPinchSegment *segment1, stPinchSegment *segment2, int64_t length,
+        stPinchSegment **last1, stPinchSegment **last2) {
+    *last1 = segment1;
+    *last2 = segment2;
     while (length > 0) {
         if (segment1 == segment2) {
             if (stPinchSegment_getLength(segment1) > 1) { //Split the block in two
@@ -544,105 +1603,1240 @@ void stPinchThread_pinchNegativeP(stPinchSegment *segment1, stPinchSegment *segm
                 continue;
             }
         }
-        block1 = stPinchBlock_pinch(block1, block2, alignmentOrientation);
-        length -= stPinchSegment_getLength(segment1);
-        segment1 = stPinchSegment_get3Prime(segment1);
-        segment2 = stPinchSegment_get5Prime(segment2);
+        block1 = stPinchBlock_pinch(block1, block2, alignmentOrientation);
+        length -= stPinchSegment_getLength(segment1);
+        *last1 = segment1;
+        *last2 = segment2;
+        segment1 = stPinchSegment_get3Prime(segment1);
+        segment2 = stPinchSegment_get5Prime(segment2);
+    }
+}
+
+void stPinchThread_pinchNegativeP(stPinchSegment *segment1, stPinchSegment *segment2, int64_t start1, int64_t start2, int64_t length) {
+    stPinchSegment *last1, *last2;
+    pinchNegativeP(segment1, segment2, length, &last1, &last2);
+}
+
+void stPinchThread_pinchNegative(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length) {
+    stPinchSegment *segment1 = stPinchThread_pinchP(stPinchThread_getSegment(thread1, start1), start1);
+    stPinchSegment *segment2 = stPinchThread_getSegment(thread2, start2 + length - 1);
+    stPinchSegment_split(segment2, start2 + length - 1);
+    stPinchThread_pinchNegativeP(segment1, segment2, start1, start2, length);
+}
+
+void stPinchThread_pinchNegative2(stPinchSegment *segment1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length) {
+    segment1 = stPinchThread_pinchP(segment1, start1);
+    stPinchSegment *segment2 = stPinchThread_getSegment(thread2, start2 + length - 1);
+    stPinchSegment_split(segment2, start2 + length - 1);
+    stPinchThread_pinchNegativeP(segment1, segment2, start1, start2, length);
+}
+
+void stPinchThread_pinch(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length, bool strand2) {
+    assert(length >= 0);
+    if (length == 0) {
+        return;
+    }
+    assert(stPinchThread_getStart(thread1) <= start1);
+    assert(stPinchThread_getStart(thread1) + stPinchThread_getLength(thread1) >= start1 + length);
+    assert(stPinchThread_getStart(thread2) <= start2);
+    assert(stPinchThread_getStart(thread2) + stPinchThread_getLength(thread2) >= start2 + length);
+    if(strand2) {
+        stPinchThread_pinchPositive(thread1, thread2, start1, start2, length);
+    }
+    else {
+        stPinchThread_pinchNegative(thread1, thread2, start1, start2, length);
+    }
+}
+
+
+void stPinchThread_pinchAlignment(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, bool strand2,
+        stPinchAlignmentOperation *operations, int64_t operationNumber) {
+    //On the negative strand thread2 is walked from the 3' end of the aligned region, so find its length first
+    int64_t length1 = 0, length2 = 0;
+    for (int64_t i = 0; i < operationNumber; i++) {
+        if (operations[i].type != ST_PINCH_ALIGNMENT_MATCH && operations[i].type != ST_PINCH_ALIGNMENT_INSERT
+                && operations[i].type != ST_PINCH_ALIGNMENT_DELETE) {
+            st_errAbort("Alignment operation %" PRIi64 " has unknown type %i", i, (int) operations[i].type);
+        }
+        if (operations[i].length < 0) {
+            st_errAbort("Alignment operation %" PRIi64 " has negative length %" PRIi64, i, operations[i].length);
+        }
+        length1 += operations[i].type != ST_PINCH_ALIGNMENT_DELETE ? operations[i].length : 0;
+        length2 += operations[i].type != ST_PINCH_ALIGNMENT_INSERT ? operations[i].length : 0;
+    }
+    assert(stPinchThread_getStart(thread1) <= start1);
+    assert(stPinchThread_getStart(thread1) + stPinchThread_getLength(thread1) >= start1 + length1);
+    assert(stPinchThread_getStart(thread2) <= start2);
+    assert(stPinchThread_getStart(thread2) + stPinchThread_getLength(thread2) >= start2 + length2);
+    (void) length1;
+
+    //The cursors are the last segments reached by the previous match, which are just 5' of the next match,
+    //so unless an insert or delete skips many segments the threads are only walked, not searched
+    int64_t position1 = start1, position2 = strand2 ? start2 : start2 + length2 - 1;
+    stPinchSegment *cursor1 = NULL, *cursor2 = NULL;
+    for (int64_t i = 0; i < operationNumber; i++) {
+        int64_t length = operations[i].length;
+        if (operations[i].type == ST_PINCH_ALIGNMENT_INSERT) {
+            position1 += length;
+            continue;
+        }
+        if (operations[i].type == ST_PINCH_ALIGNMENT_DELETE) {
+            position2 += strand2 ? length : -length;
+            continue;
+        }
+        assert(operations[i].type == ST_PINCH_ALIGNMENT_MATCH);
+        if (length == 0) {
+            continue;
+        }
+        stPinchSegment *segment1 = stPinchThread_pinchP(getSegmentFromFinger(thread1, cursor1, position1), position1);
+        //Splitting the first thread may have split the segment the cursor of the second is in, if they are the same thread
+        stPinchSegment *segment2 = getSegmentFromFinger(thread2, cursor2, position2);
+        if (strand2) {
+            segment2 = stPinchThread_pinchP(segment2, position2);
+            pinchPositiveP(segment1, segment2, length, &cursor1, &cursor2);
+            position2 += length;
+        } else {
+            stPinchSegment_split(segment2, position2);
+            pinchNegativeP(segment1, segment2, length, &cursor1, &cursor2);
+            position2 -= length;
+        }
+        position1 += length;
+    }
+}
+
+
+//Batched pinching
+
+/*
+ * Orders pinches by first thread and coordinate. The remaining fields only
+ * make the order, and so the segment boundaries produced, deterministic.
+ */
+static int stPinch_compareByFirstPosition(const void *a, const void *b) {
+    const stPinch *pinch1 = a, *pinch2 = b;
+    if (pinch1->name1 != pinch2->name1) {
+        return pinch1->name1 < pinch2->name1 ? -1 : 1;
+    }
+    if (pinch1->start1 != pinch2->start1) {
+        return pinch1->start1 < pinch2->start1 ? -1 : 1;
+    }
+    if (pinch1->name2 != pinch2->name2) {
+        return pinch1->name2 < pinch2->name2 ? -1 : 1;
+    }
+    if (pinch1->start2 != pinch2->start2) {
+        return pinch1->start2 < pinch2->start2 ? -1 : 1;
+    }
+    if (pinch1->length != pinch2->length) {
+        return pinch1->length < pinch2->length ? -1 : 1;
+    }
+    return (int) pinch1->strand - (int) pinch2->strand;
+}
+
+/*
+ * Applies a run of pinches sorted by stPinch_compareByFirstPosition. Pinching only ever
+ * creates segments, so the segments used by the previous pinch remain valid fingers.
+ */
+static void pinchSortedBatch(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber) {
+    stPinchThread *thread1 = NULL, *thread2 = NULL;
+    stPinchSegment *finger1 = NULL, *finger2 = NULL;
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        stPinch *pinch = &pinches[i];
+        if (pinch->length == 0) {
+            continue;
+        }
+        if (thread1 == NULL || thread1->name != pinch->name1) {
+            if ((thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1)) == NULL) {
+                st_errAbort("Pinch refers to thread %" PRIi64 " which is not in the pinch graph", pinch->name1);
+            }
+            finger1 = NULL;
+        }
+        if (thread2 == NULL || thread2->name != pinch->name2) {
+            if ((thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2)) == NULL) {
+                st_errAbort("Pinch refers to thread %" PRIi64 " which is not in the pinch graph", pinch->name2);
+            }
+            finger2 = NULL;
+        }
+        assert(pinch->length > 0);
+        assert(stPinchThread_getStart(thread1) <= pinch->start1);
+        assert(stPinchThread_getStart(thread1) + stPinchThread_getLength(thread1) >= pinch->start1 + pinch->length);
+        assert(stPinchThread_getStart(thread2) <= pinch->start2);
+        assert(stPinchThread_getStart(thread2) + stPinchThread_getLength(thread2) >= pinch->start2 + pinch->length);
+        //As in stPinchThread_pinchPositive/Negative, the second segment is only located once the first is split
+        finger1 = getSegmentFromFinger(thread1, finger1, pinch->start1);
+        stPinchSegment *segment1 = stPinchThread_pinchP(finger1, pinch->start1);
+        if (thread1 == thread2) {
+            finger2 = segment1;
+        }
+        if (pinch->strand) {
+            finger2 = getSegmentFromFinger(thread2, finger2, pinch->start2);
+            stPinchSegment *segment2 = stPinchThread_pinchP(finger2, pinch->start2);
+            stPinchThread_pinchPositiveP(segment1, segment2, pinch->start1, pinch->start2, pinch->length);
+        } else {
+            finger2 = getSegmentFromFinger(thread2, finger2, pinch->start2 + pinch->length - 1);
+            stPinchSegment_split(finger2, pinch->start2 + pinch->length - 1);
+            stPinchThread_pinchNegativeP(segment1, finger2, pinch->start1, pinch->start2, pinch->length);
+        }
+    }
+}
+
+stPinchBatchStats stPinchThreadSet_pinchBatch(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber) {
+    stPinchBatchStats stats = threadSet->batchStats;
+    qsort(pinches, pinchNumber, sizeof(stPinch), stPinch_compareByFirstPosition);
+    pinchSortedBatch(threadSet, pinches, pinchNumber);
+    stats.splits = threadSet->batchStats.splits - stats.splits;
+    stats.merges = threadSet->batchStats.merges - stats.merges;
+    return stats;
+}
+
+//Parallel batched pinching
+
+/*
+ * The pinches of a set of threads that share no blocks with any other thread,
+ * and so can be pinched independently of all other pinches.
+ */
+typedef struct _stPinchBatchGroup {
+    stList *threads;
+    stPinch *pinches;
+    int64_t pinchNumber;
+    stPinchBlock **blocks; // Instead of pinches, the blocks to trim, see stPinchThreadSet_trimAllBlocks
+    int64_t blockNumber;
+    stPinchBlockRegistry blockRegistry; // The blocks created by the group's pinches
+    stPinchBatchStats batchStats; // The splits and merges made by the group
+} stPinchBatchGroup;
+
+typedef struct _stPinchBatchWorker {
+    stPinchThreadSet *threadSet;
+    stPinchBatchGroup **groups; //In decreasing order of size
+    int64_t groupNumber;
+    int64_t *nextGroup; //Shared between the workers
+    int64_t trim; //The trim applied to the blocks of groups of blocks
+    stPinchSlabAllocator *segmentAllocator; //Private to the worker, NULL if the thread set does not use slabs
+    stPinchSlabAllocator *blockAllocator;
+} stPinchBatchWorker;
+
+static void stPinchBatchGroup_destruct(stPinchBatchGroup *group) {
+    assert(group->blockRegistry.blocks == NULL);
+    stList_destruct(group->threads);
+    free(group);
+}
+
+static int stPinchBatchGroup_cmpBySize(const void *a, const void *b) {
+    int64_t i = ((stPinchBatchGroup *) a)->pinchNumber + ((stPinchBatchGroup *) a)->blockNumber;
+    int64_t j = ((stPinchBatchGroup *) b)->pinchNumber + ((stPinchBatchGroup *) b)->blockNumber;
+    return i > j ? -1 : (i < j ? 1 : 0);
+}
+
+static int stPinchBatchGroup_cmpByFirstPinch(const void *a, const void *b) {
+    return stPinch_compareByFirstPosition(((stPinchBatchGroup *) a)->pinches, ((stPinchBatchGroup *) b)->pinches);
+}
+
+static void setThreadBlockRegistries(stList *threads, stPinchBlockRegistry *blockRegistry, stPinchBatchStats *batchStats) {
+    for (int64_t i = 0; i < stList_length(threads); i++) {
+        stPinchThread *thread = stList_get(threads, i);
+        thread->blockRegistry = blockRegistry;
+        thread->batchStats = batchStats;
+    }
+}
+
+static void setThreadAllocators(stList *threads, stPinchSlabAllocator *segmentAllocator, stPinchSlabAllocator *blockAllocator) {
+    for (int64_t i = 0; i < stList_length(threads); i++) {
+        stPinchThread *thread = stList_get(threads, i);
+        thread->segmentAllocator = segmentAllocator;
+        thread->blockAllocator = blockAllocator;
+    }
+}
+
+static void *pinchBatchWorker(void *arg) {
+    stPinchBatchWorker *worker = arg;
+    int64_t i;
+    while ((i = __atomic_fetch_add(worker->nextGroup, 1, __ATOMIC_RELAXED)) < worker->groupNumber) {
+        stPinchBatchGroup *group = worker->groups[i];
+        if (worker->segmentAllocator != NULL) {
+            setThreadAllocators(group->threads, worker->segmentAllocator, worker->blockAllocator);
+        }
+        group->blockRegistry.parent = &worker->threadSet->blockRegistry;
+        setThreadBlockRegistries(group->threads, &group->blockRegistry, &group->batchStats);
+        if (group->blocks != NULL) {
+            for (int64_t j = 0; j < group->blockNumber; j++) {
+                stPinchBlock_trim(group->blocks[j], worker->trim);
+            }
+        } else {
+            qsort(group->pinches, group->pinchNumber, sizeof(stPinch), stPinch_compareByFirstPosition);
+            pinchSortedBatch(worker->threadSet, group->pinches, group->pinchNumber);
+        }
+        setThreadBlockRegistries(group->threads, &worker->threadSet->blockRegistry, &worker->threadSet->batchStats);
+        if (worker->segmentAllocator != NULL) {
+            setThreadAllocators(group->threads, worker->threadSet->segmentAllocator, worker->threadSet->blockAllocator);
+        }
+    }
+    return NULL;
+}
+
+static stPinchThread *getPinchThread(stPinchThreadSet *threadSet, int64_t name) {
+    stPinchThread *thread = stPinchThreadSet_getThread(threadSet, name);
+    if (thread == NULL) {
+        st_errAbort("Pinch refers to thread %" PRIi64 " which is not in the pinch graph", name);
+    }
+    return thread;
+}
+
+static int64_t *concurrentUnionFind_construct(int64_t elementNumber);
+
+static void concurrentUnionFind_union(int64_t *parents, int64_t i, int64_t j);
+
+static int64_t concurrentUnionFind_number(int64_t *parents, int64_t elementNumber, bool (*skip)(void *, int64_t), void *extraArg);
+
+/*
+ * Partitions the threads into groups connected by existing blocks or by the pinches, and
+ * reorders the pinches so that those of each group are contiguous. Returns only the groups
+ * with pinches. The components of the existing blocks are found using up to threadNumber
+ * threads, and then only the components joined by the pinches are merged.
+ */
+static stList *getPinchBatchGroups(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber, int64_t threadNumber) {
+    int64_t componentNumber;
+    int64_t *componentIndices = stPinchThreadSet_getThreadComponentIndices(threadSet, threadNumber, &componentNumber);
+    int64_t *parents = concurrentUnionFind_construct(componentNumber);
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        concurrentUnionFind_union(parents, componentIndices[getPinchThread(threadSet, pinches[i].name1)->index],
+                componentIndices[getPinchThread(threadSet, pinches[i].name2)->index]);
+    }
+    int64_t groupNumber = concurrentUnionFind_number(parents, componentNumber, NULL, NULL);
+
+    //Make a group for each component with pinches, bucketing the pinches by group
+    stPinchBatchGroup **componentGroups = st_calloc(groupNumber, sizeof(stPinchBatchGroup *));
+    stPinchBatchGroup **pinchGroups = st_malloc(pinchNumber * sizeof(stPinchBatchGroup *));
+    stList *groups = stList_construct3(0, (void(*)(void *)) stPinchBatchGroup_destruct);
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        int64_t j = parents[componentIndices[stPinchThreadSet_getThread(threadSet, pinches[i].name1)->index]];
+        if (componentGroups[j] == NULL) {
+            componentGroups[j] = st_calloc(1, sizeof(stPinchBatchGroup));
+            componentGroups[j]->threads = stList_construct();
+            stList_append(groups, componentGroups[j]);
+        }
+        pinchGroups[i] = componentGroups[j];
+        pinchGroups[i]->pinchNumber++;
+    }
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stPinchBatchGroup *group = componentGroups[parents[componentIndices[i]]];
+        if (group != NULL) {
+            stList_append(group->threads, stList_get(threadSet->threads, i));
+        }
+    }
+    free(componentGroups);
+    free(parents);
+    free(componentIndices);
+    stPinch *groupedPinches = st_malloc(pinchNumber * sizeof(stPinch));
+    stPinch *nextPinch = groupedPinches;
+    for (int64_t i = 0; i < stList_length(groups); i++) {
+        stPinchBatchGroup *group = stList_get(groups, i);
+        group->pinches = nextPinch;
+        nextPinch += group->pinchNumber;
+        group->pinchNumber = 0;
+    }
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        pinchGroups[i]->pinches[pinchGroups[i]->pinchNumber++] = pinches[i];
+    }
+    memcpy(pinches, groupedPinches, pinchNumber * sizeof(stPinch));
+    for (int64_t i = 0; i < stList_length(groups); i++) {
+        stPinchBatchGroup *group = stList_get(groups, i);
+        group->pinches = pinches + (group->pinches - groupedPinches);
+    }
+    free(groupedPinches);
+    free(pinchGroups);
+    return groups;
+}
+
+/*
+ * Applies the groups using up to threadNumber threads, largest first. The blocks each group
+ * makes are left in its registry, and the slots of the blocks it removes are left empty.
+ */
+static void applyBatchGroups(stPinchThreadSet *threadSet, stList *groups, int64_t threadNumber, int64_t trim) {
+    int64_t groupNumber = stList_length(groups);
+    stList *sortedGroups = stList_construct();
+    for (int64_t i = 0; i < groupNumber; i++) {
+        stList_append(sortedGroups, stList_get(groups, i));
+    }
+    stList_sort(sortedGroups, stPinchBatchGroup_cmpBySize);
+    stPinchBatchGroup **groupArray = st_malloc(groupNumber * sizeof(stPinchBatchGroup *));
+    for (int64_t i = 0; i < groupNumber; i++) {
+        groupArray[i] = stList_get(sortedGroups, i);
+    }
+    stList_destruct(sortedGroups);
+
+    //The calling thread acts as the first worker, and shares the thread set's allocators
+    int64_t workerNumber = threadNumber < groupNumber ? threadNumber : groupNumber;
+    if (workerNumber < 1) {
+        workerNumber = 1;
+    }
+    int64_t nextGroup = 0;
+    stPinchBatchWorker *workers = st_malloc(workerNumber * sizeof(stPinchBatchWorker));
+    pthread_t *threads = st_malloc(workerNumber * sizeof(pthread_t));
+    threadSet->modifiedBlocks.concurrent = workerNumber > 1;
+    for (int64_t i = 0; i < workerNumber; i++) {
+        stPinchBatchWorker *worker = &workers[i];
+        worker->threadSet = threadSet;
+        worker->groups = groupArray;
+        worker->groupNumber = groupNumber;
+        worker->nextGroup = &nextGroup;
+        worker->trim = trim;
+        bool privateAllocators = i > 0 && threadSet->segmentAllocator != NULL;
+        worker->segmentAllocator = privateAllocators ? constructSegmentAllocator() : NULL;
+        worker->blockAllocator = privateAllocators ? constructBlockAllocator() : NULL;
+        if (i > 0 && pthread_create(&threads[i], NULL, pinchBatchWorker, worker) != 0) {
+            st_errAbort("Failed to create a thread to apply pinches");
+        }
     }
+    pinchBatchWorker(&workers[0]);
+    for (int64_t i = 1; i < workerNumber; i++) {
+        pthread_join(threads[i], NULL);
+        if (workers[i].segmentAllocator != NULL) {
+            stPinchSlabAllocator_merge(threadSet->segmentAllocator, workers[i].segmentAllocator);
+            stPinchSlabAllocator_merge(threadSet->blockAllocator, workers[i].blockAllocator);
+        }
+    }
+    threadSet->modifiedBlocks.concurrent = 0;
+    free(threads);
+    free(workers);
+    free(groupArray);
 }
 
-void stPinchThread_pinchNegative(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length) {
-    stPinchSegment *segment1 = stPinchThread_pinchP(stPinchThread_getSegment(thread1, start1), start1);
-    stPinchSegment *segment2 = stPinchThread_getSegment(thread2, start2 + length - 1);
-    stPinchSegment_split(segment2, start2 + length - 1);
-    stPinchThread_pinchNegativeP(segment1, segment2, start1, start2, length);
+/*
+ * Registers the blocks made by each group, in the order of the groups, once they have been applied.
+ * The compaction also collects the slots of the blocks removed by the groups. Returns the total
+ * splits and merges made by the groups, which are added to those of the thread set.
+ */
+static stPinchBatchStats registerBatchGroupBlocks(stPinchThreadSet *threadSet, stList *groups) {
+    stPinchBatchStats stats = { 0, 0 };
+    stPinchBlockRegistry_compact(&threadSet->blockRegistry);
+    for (int64_t i = 0; i < stList_length(groups); i++) {
+        stPinchBatchGroup *group = stList_get(groups, i);
+        stPinchBlockRegistry_append(&threadSet->blockRegistry, &group->blockRegistry);
+        stats.splits += group->batchStats.splits;
+        stats.merges += group->batchStats.merges;
+    }
+    threadSet->batchStats.splits += stats.splits;
+    threadSet->batchStats.merges += stats.merges;
+    return stats;
 }
 
-void stPinchThread_pinchNegative2(stPinchSegment *segment1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length) {
-    segment1 = stPinchThread_pinchP(segment1, start1);
-    stPinchSegment *segment2 = stPinchThread_getSegment(thread2, start2 + length - 1);
-    stPinchSegment_split(segment2, start2 + length - 1);
-    stPinchThread_pinchNegativeP(segment1, segment2, start1, start2, length);
+stPinchBatchStats stPinchThreadSet_pinchBatchParallel(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber,
+        int64_t threadNumber) {
+    if (threadSet->journal != NULL) { //The journal is not shared between threads
+        return stPinchThreadSet_pinchBatch(threadSet, pinches, pinchNumber);
+    }
+    stList *groups = getPinchBatchGroups(threadSet, pinches, pinchNumber, threadNumber);
+    applyBatchGroups(threadSet, groups, threadNumber, 0);
+    //Register the blocks made by each group, in an order independent of the scheduling of the groups
+    stList_sort(groups, stPinchBatchGroup_cmpByFirstPinch);
+    stPinchBatchStats stats = registerBatchGroupBlocks(threadSet, groups);
+    stList_destruct(groups);
+    return stats;
 }
 
-void stPinchThread_pinch(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length, bool strand2) {
-    assert(length >= 0);
-    if (length == 0) {
-        return;
+/*
+ * Groups the blocks by the component of the threads they are on, returning only the groups
+ * with blocks, in the order of the components. The blocks of the groups are held in one array,
+ * returned in blocks.
+ */
+static stList *getTrimBatchGroups(stPinchThreadSet *threadSet, int64_t threadNumber, stPinchBlock ***blocks) {
+    int64_t componentNumber;
+    int64_t *componentIndices = stPinchThreadSet_getThreadComponentIndices(threadSet, threadNumber, &componentNumber);
+    stPinchBatchGroup **componentGroups = st_malloc(componentNumber * sizeof(stPinchBatchGroup *));
+    for (int64_t i = 0; i < componentNumber; i++) {
+        componentGroups[i] = st_calloc(1, sizeof(stPinchBatchGroup));
+        componentGroups[i]->threads = stList_construct();
     }
-    assert(stPinchThread_getStart(thread1) <= start1);
-    assert(stPinchThread_getStart(thread1) + stPinchThread_getLength(thread1) >= start1 + length);
-    assert(stPinchThread_getStart(thread2) <= start2);
-    assert(stPinchThread_getStart(thread2) + stPinchThread_getLength(thread2) >= start2 + length);
-    if(strand2) {
-        stPinchThread_pinchPositive(thread1, thread2, start1, start2, length);
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stList_append(componentGroups[componentIndices[i]]->threads, stList_get(threadSet->threads, i));
     }
-    else {
-        stPinchThread_pinchNegative(thread1, thread2, start1, start2, length);
+
+    //Bucket the blocks by group
+    stPinchBlockRegistry *registry = &threadSet->blockRegistry;
+    for (int64_t i = 0; i < registry->length; i++) {
+        if (registry->blocks[i] != NULL) {
+            componentGroups[componentIndices[getSegmentThread(getHeadSegment(registry->blocks[i]))->index]]->blockNumber++;
+        }
+    }
+    *blocks = st_malloc(registry->blockNumber * sizeof(stPinchBlock *));
+    stPinchBlock **nextBlock = *blocks;
+    for (int64_t i = 0; i < componentNumber; i++) {
+        componentGroups[i]->blocks = nextBlock;
+        nextBlock += componentGroups[i]->blockNumber;
+        componentGroups[i]->blockNumber = 0;
+    }
+    for (int64_t i = 0; i < registry->length; i++) {
+        stPinchBlock *block = registry->blocks[i];
+        if (block != NULL) {
+            stPinchBatchGroup *group = componentGroups[componentIndices[getSegmentThread(getHeadSegment(block))->index]];
+            group->blocks[group->blockNumber++] = block;
+        }
+    }
+    free(componentIndices);
+
+    //Discard the groups without blocks
+    stList *groups = stList_construct3(0, (void(*)(void *)) stPinchBatchGroup_destruct);
+    for (int64_t i = 0; i < componentNumber; i++) {
+        if (componentGroups[i]->blockNumber > 0) {
+            stList_append(groups, componentGroups[i]);
+        } else {
+            stPinchBatchGroup_destruct(componentGroups[i]);
+        }
+    }
+    free(componentGroups);
+    return groups;
+}
+
+stPinchTrimStats stPinchThreadSet_trimAllBlocks(stPinchThreadSet *threadSet, int64_t trim, int64_t threadNumber) {
+    stPinchTrimStats stats = { 0, 0 };
+    if (trim <= 0) {
+        return stats;
+    }
+    //Plan the trims before making any, as trimming makes new blocks
+    stPinchBlock **blocks;
+    stList *groups = getTrimBatchGroups(threadSet, threadNumber, &blocks);
+    int64_t blockNumber = threadSet->blockRegistry.blockNumber;
+    for (int64_t i = 0; i < blockNumber; i++) {
+        if (stPinchBlock_getLength(blocks[i]) > 2 * trim) {
+            stats.shortened++;
+        } else {
+            stats.destroyed++;
+        }
+    }
+    if (threadSet->journal != NULL) { //The journal is not shared between threads
+        for (int64_t i = 0; i < blockNumber; i++) {
+            stPinchBlock_trim(blocks[i], trim);
+        }
+    } else {
+        applyBatchGroups(threadSet, groups, threadNumber, trim);
+        registerBatchGroupBlocks(threadSet, groups);
     }
+    stList_destruct(groups);
+    free(blocks);
+    return stats;
 }
 
 
 //Private functions
 
-static stPinchThread *stPinchThread_construct(int64_t name, int64_t start, int64_t length) {
+// Makes a thread with no segments.
+static stPinchThread *stPinchThread_construct2(int64_t name, int64_t start, int64_t length, stPinchThreadSet *threadSet) {
+#ifdef ST_PINCH_COMPACT_HANDLES
+    stPinchThread *thread = stPinchSlabAllocator_allocate(threadSet->threadAllocator);
+#else
     stPinchThread *thread = st_malloc(sizeof(stPinchThread));
+#endif
     thread->name = name;
     thread->start = start;
     thread->length = length;
-    thread->segments = stSortedSet_construct3((int(*)(const void *, const void *)) stPinchSegment_compareBySequencePosition,
-            (void(*)(void *)) stPinchSegment_destruct);
+    thread->index = stList_length(threadSet->threads); // The thread is appended to the set once made
+    thread->segmentAllocator = threadSet->segmentAllocator;
+    thread->blockAllocator = threadSet->blockAllocator;
+    thread->modifiedBlocks = &threadSet->modifiedBlocks;
+    thread->blockRegistry = &threadSet->blockRegistry;
+    thread->journal = threadSet->journal;
+    thread->batchStats = &threadSet->batchStats;
+    thread->finger = NULL;
+    thread->fingerHits = 0;
+    thread->fingerMisses = 0;
+    thread->trackBoundaries = threadSet->trackBoundaries;
+    thread->dirtyBoundaries = NULL;
+    thread->dirtyBoundaryNumber = 0;
+    thread->maxDirtyBoundaryNumber = 0;
+    thread->allBoundariesDirty = 0;
+    thread->segments = stPinchSegmentIndex_construct();
+    return thread;
+}
+
+static stPinchThread *stPinchThread_construct(int64_t name, int64_t start, int64_t length, stPinchThreadSet *threadSet) {
+    stPinchThread *thread = stPinchThread_construct2(name, start, length, threadSet);
     stPinchSegment *segment = stPinchSegment_construct(start, thread);
     stPinchSegment *terminatorSegment = stPinchSegment_construct(start + length, thread);
-    segment->nSegment = terminatorSegment;
-    terminatorSegment->pSegment = segment;
-    stSortedSet_insert(thread->segments, segment);
+    setNSegment(segment, terminatorSegment);
+    setPSegment(terminatorSegment, segment);
+    stPinchSegmentIndex_insert(thread->segments, segment->start, segment);
     return thread;
 }
 
 static void stPinchThread_destruct(stPinchThread *thread) {
-    stPinchSegment *segment = stPinchThread_getLast(thread);
-    free(segment->nSegment);
-    stSortedSet_destruct(thread->segments);
-    free(thread);
+    thread->finger = NULL;
+    //Slab allocated segments and blocks are released in bulk with the thread set
+    if (thread->segmentAllocator == NULL) {
+        stPinchSegment *segment = stPinchThread_getFirst(thread);
+        while (segment != NULL) { //Includes the terminator segment
+            stPinchSegment *nSegment = getNSegment(segment);
+            stPinchSegment_destruct(segment);
+            segment = nSegment;
+        }
+    }
+    stPinchSegmentIndex_destruct(thread->segments);
+    free(thread->dirtyBoundaries);
+#ifndef ST_PINCH_COMPACT_HANDLES
+    free(thread); //Otherwise released in bulk with the thread set
+#endif
 }
 
-static uint64_t stPinchThread_hashKey(const stPinchThread *thread) {
-    return thread->name;
+static uint64_t hashThreadName(int64_t name, int64_t size) {
+    uint64_t h = (uint64_t) name * 0x9E3779B97F4A7C15ULL;
+    return (h ^ (h >> 32)) & (size - 1);
 }
 
-static int stPinchThread_equals(const stPinchThread *thread1, const stPinchThread *thread2) {
-    return thread1->name == thread2->name;
+static void insertIntoThreadNameTable(stPinchThreadNameIndex *index, stPinchThread *thread) {
+    if (!index->hashed) {
+        assert(index->threads[thread->name - index->minName] == NULL);
+        index->threads[thread->name - index->minName] = thread;
+        return;
+    }
+    uint64_t i = hashThreadName(thread->name, index->size);
+    while (index->threads[i] != NULL) {
+        assert(index->threads[i]->name != thread->name);
+        i = (i + 1) & (index->size - 1);
+    }
+    index->threads[i] = thread;
+}
+
+/*
+ * Rebuilds the table with the given number of entries, moving the threads in it.
+ */
+static void resizeThreadNameTable(stPinchThreadNameIndex *index, int64_t size, int64_t minName, bool hashed) {
+    stPinchThread **threads = index->threads;
+    int64_t oldSize = index->size;
+    index->threads = st_calloc(size, sizeof(stPinchThread *));
+    index->size = size;
+    index->minName = minName;
+    index->hashed = hashed;
+    for (int64_t i = 0; i < oldSize; i++) {
+        if (threads[i] != NULL) {
+            insertIntoThreadNameTable(index, threads[i]);
+        }
+    }
+    free(threads);
+}
+
+static void stPinchThreadNameIndex_insert(stPinchThreadNameIndex *index, stPinchThread *thread) {
+    int64_t name = thread->name;
+    index->threadNumber++;
+    if (index->hashed) {
+        if (2 * index->threadNumber > index->size) {
+            resizeThreadNameTable(index, 2 * index->size, 0, 1);
+        }
+    } else if (index->size == 0 || name < index->minName || name > index->minName + index->size - 1) {
+        //Extend the range to include the name, leaving room beyond it for further names in the same direction,
+        //unless the range would become sparse
+        int64_t maxSize = 4 * index->threadNumber + 64;
+        int64_t low = index->size == 0 || name < index->minName ? name : index->minName;
+        int64_t high = index->size == 0 || name > index->minName ? name : index->minName + index->size - 1;
+        if (name > INT64_MIN + maxSize && name < INT64_MAX - maxSize && (uint64_t) high - (uint64_t) low < (uint64_t) maxSize) {
+            int64_t size = high - low + 1 > 2 * index->size ? high - low + 1 : 2 * index->size;
+            size = size < maxSize ? size : maxSize;
+            resizeThreadNameTable(index, size, name == low ? high - size + 1 : low, 0);
+        } else {
+            int64_t size = 64;
+            while (size < 2 * index->threadNumber) {
+                size *= 2;
+            }
+            resizeThreadNameTable(index, size, 0, 1);
+        }
+    }
+    insertIntoThreadNameTable(index, thread);
+}
+
+static stPinchThread *stPinchThreadNameIndex_get(stPinchThreadNameIndex *index, int64_t name) {
+    if (!index->hashed) {
+        uint64_t i = (uint64_t) name - (uint64_t) index->minName;
+        return i < (uint64_t) index->size ? index->threads[i] : NULL;
+    }
+    for (uint64_t i = hashThreadName(name, index->size); index->threads[i] != NULL; i = (i + 1) & (index->size - 1)) {
+        if (index->threads[i]->name == name) {
+            return index->threads[i];
+        }
+    }
+    return NULL;
+}
+
+static void stPinchThreadNameIndex_remove(stPinchThreadNameIndex *index, stPinchThread *thread) {
+    index->threadNumber--;
+    if (!index->hashed) {
+        assert(index->threads[thread->name - index->minName] == thread);
+        index->threads[thread->name - index->minName] = NULL;
+        return;
+    }
+    uint64_t i = hashThreadName(thread->name, index->size), mask = index->size - 1;
+    while (index->threads[i] != thread) {
+        assert(index->threads[i] != NULL);
+        i = (i + 1) & mask;
+    }
+    //Move back any later thread of the run whose probe sequence passes the emptied entry
+    for (uint64_t j = (i + 1) & mask; index->threads[j] != NULL; j = (j + 1) & mask) {
+        uint64_t k = hashThreadName(index->threads[j]->name, index->size);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+            continue;
+        }
+        index->threads[i] = index->threads[j];
+        i = j;
+    }
+    index->threads[i] = NULL;
 }
 
 //Thread set
 
 stPinchThreadSet *stPinchThreadSet_construct() {
+    return stPinchThreadSet_construct2(0);
+}
+
+stPinchThreadSet *stPinchThreadSet_construct2(bool useSlabAllocation) {
     stPinchThreadSet *threadSet = st_malloc(sizeof(stPinchThreadSet));
     threadSet->threads = stList_construct3(0, (void(*)(void *)) stPinchThread_destruct);
-    threadSet->threadsHash = stHash_construct3((uint64_t(*)(const void *)) stPinchThread_hashKey,
-            (int(*)(const void *, const void *)) stPinchThread_equals, NULL, NULL);
+    memset(&threadSet->threadNames, 0, sizeof(stPinchThreadNameIndex));
+    threadSet->trackBoundaries = 0;
+    threadSet->modifiedBlocks.head = NULL;
+    threadSet->modifiedBlocks.length = 0;
+    threadSet->modifiedBlocks.concurrent = 0;
+    pthread_mutex_init(&threadSet->modifiedBlocks.mutex, NULL);
+    memset(&threadSet->blockRegistry, 0, sizeof(stPinchBlockRegistry));
+    threadSet->batchStats.splits = 0;
+    threadSet->batchStats.merges = 0;
+    threadSet->journal = NULL;
+#ifdef ST_PINCH_COMPACT_HANDLES
+    useSlabAllocation = 1; // Handles can only refer to slab allocated objects
+    threadSet->threadAllocator = stPinchSlabAllocator_construct2(sizeof(stPinchThread), &threadHandles,
+            offsetof(stPinchThread, handle));
+#endif
+    threadSet->segmentAllocator = useSlabAllocation ? constructSegmentAllocator() : NULL;
+    threadSet->blockAllocator = useSlabAllocation ? constructBlockAllocator() : NULL;
     return threadSet;
 }
 
 void stPinchThreadSet_destruct(stPinchThreadSet *threadSet) {
+    if (threadSet->journal != NULL) {
+        stPinchThreadSet_commitTransaction(threadSet); //Releases the objects removed in the transaction
+    }
     stList_destruct(threadSet->threads);
-    stHash_destruct(threadSet->threadsHash);
+    free(threadSet->threadNames.threads);
+    if (threadSet->segmentAllocator != NULL) {
+        stPinchSlabAllocator_destruct(threadSet->segmentAllocator);
+        stPinchSlabAllocator_destruct(threadSet->blockAllocator);
+    }
+#ifdef ST_PINCH_COMPACT_HANDLES
+    stPinchSlabAllocator_destruct(threadSet->threadAllocator);
+#endif
+    pthread_mutex_destroy(&threadSet->modifiedBlocks.mutex);
+    free(threadSet->blockRegistry.blocks);
+    free(threadSet->blockRegistry.emptySlots);
     free(threadSet);
 }
 
 stPinchThread *stPinchThreadSet_addThread(stPinchThreadSet *threadSet, int64_t name, int64_t start, int64_t length) {
-    stPinchThread *thread = stPinchThread_construct(name, start, length);
+    stPinchThread *thread = stPinchThread_construct(name, start, length, threadSet);
     assert(stPinchThreadSet_getThread(threadSet, name) == NULL);
-    stHash_insert(threadSet->threadsHash, thread, thread);
+    stPinchThreadNameIndex_insert(&threadSet->threadNames, thread);
     stList_append(threadSet->threads, thread);
+    if (threadSet->journal != NULL) {
+        stPinchJournal_append(threadSet->journal, ST_PINCH_JOURNAL_ADD_THREAD, thread);
+    }
     return thread;
 }
 
+//Transactions
+
+static void setJournal(stPinchThreadSet *threadSet, stPinchJournal *journal) {
+    threadSet->journal = journal;
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        ((stPinchThread *) stList_get(threadSet->threads, i))->journal = journal;
+    }
+}
+
+void stPinchThreadSet_beginTransaction(stPinchThreadSet *threadSet) {
+    assert(threadSet->journal == NULL);
+    setJournal(threadSet, st_calloc(1, sizeof(stPinchJournal)));
+}
+
+bool stPinchThreadSet_inTransaction(stPinchThreadSet *threadSet) {
+    return threadSet->journal != NULL;
+}
+
+static void stPinchJournal_destruct(stPinchJournal *journal) {
+    free(journal->entries);
+    free(journal);
+}
+
+void stPinchThreadSet_commitTransaction(stPinchThreadSet *threadSet) {
+    stPinchJournal *journal = threadSet->journal;
+    assert(journal != NULL);
+    setJournal(threadSet, NULL);
+    //Release the memory of the objects removed in the transaction
+    for (int64_t i = 0; i < journal->entryNumber; i++) {
+        stPinchJournalEntry *entry = &journal->entries[i];
+        switch (entry->type) {
+        case ST_PINCH_JOURNAL_FREE_BLOCK:
+            releaseBlock(entry->object, threadSet->blockAllocator);
+            break;
+        case ST_PINCH_JOURNAL_JOIN_3PRIME:
+        case ST_PINCH_JOURNAL_JOIN_5PRIME:
+            freeSegment(entry->object);
+            break;
+        case ST_PINCH_JOURNAL_DIRTY_BOUNDARIES:
+            free(entry->pointer1);
+            break;
+        default:
+            break;
+        }
+    }
+    stPinchJournal_destruct(journal);
+}
+
+/*
+ * Reverses the change recorded by the entry, the graph being as it was immediately after the change.
+ */
+static void stPinchJournalEntry_undo(stPinchJournalEntry *entry, stPinchThreadSet *threadSet) {
+    stPinchSegment *segment, *nSegment;
+    stPinchBlock *block;
+    stPinchThread *thread;
+    switch (entry->type) {
+    case ST_PINCH_JOURNAL_SEGMENT:
+        segment = entry->object;
+        setSegmentBlock(segment, entry->pointer1);
+        setSegmentOrientation(segment, entry->value1);
+        setNBlockSegment(segment, entry->pointer2);
+        break;
+    case ST_PINCH_JOURNAL_BLOCK:
+        block = entry->object;
+        setHeadSegment(block, entry->pointer1);
+        setTailSegment(block, entry->pointer2);
+        block->degree = entry->value1;
+        block->numSupportingHomologies = entry->value2;
+        break;
+    case ST_PINCH_JOURNAL_FILTER_FLAG:
+        setFlag(entry->object, 1, entry->value1);
+        break;
+    case ST_PINCH_JOURNAL_MODIFIED_FLAG:
+        block = entry->object;
+        if (entry->value1) { //Put the block back between its old neighbours in the list
+            stPinchBlock *pBlock = entry->pointer1, *nBlock = entry->pointer2;
+            assert(pBlock == NULL ? threadSet->modifiedBlocks.head == nBlock : getNModifiedBlock(pBlock) == nBlock);
+            setPModifiedBlock(block, pBlock);
+            setNModifiedBlock(block, nBlock);
+            if (pBlock != NULL) {
+                setNModifiedBlock(pBlock, block);
+            } else {
+                threadSet->modifiedBlocks.head = block;
+            }
+            if (nBlock != NULL) {
+                setPModifiedBlock(nBlock, block);
+            }
+            threadSet->modifiedBlocks.length++;
+        } else {
+            stPinchModifiedBlocks_remove(&threadSet->modifiedBlocks, block);
+        }
+        setFlag(block, 0, entry->value1);
+        break;
+    case ST_PINCH_JOURNAL_ALLOCATE_BLOCK:
+        stPinchBlockRegistry_undoAdd(&threadSet->blockRegistry, entry->object, entry->value1);
+        releaseBlock(entry->object, threadSet->blockAllocator);
+        break;
+    case ST_PINCH_JOURNAL_FREE_BLOCK:
+        stPinchBlockRegistry_undoRemove(&threadSet->blockRegistry, entry->object);
+#ifdef ST_PINCH_DOUBLY_LINKED_BLOCKS
+        //The block's segments may have been appended to another block without it being journaled
+        block = entry->object;
+        setHeadSegment(block, getHeadSegment(block));
+#endif
+        break;
+    case ST_PINCH_JOURNAL_SPLIT:
+        segment = entry->object;
+        assert(getSegmentBlock(segment) == NULL);
+        setNSegment(getPSegment(segment), getNSegment(segment));
+        setPSegment(getNSegment(segment), getPSegment(segment));
+        stPinchSegmentIndex_remove(getSegmentThread(segment)->segments, segment->start);
+        releaseFinger(getSegmentThread(segment), segment);
+        freeSegment(segment);
+        break;
+    case ST_PINCH_JOURNAL_JOIN_3PRIME:
+        segment = entry->object; //Its own links are unchanged since it was removed
+        setNSegment(getPSegment(segment), segment);
+        setPSegment(getNSegment(segment), segment);
+        stPinchSegmentIndex_insert(getSegmentThread(segment)->segments, segment->start, segment);
+        if (getSegmentThread(segment)->trackBoundaries) {
+            markBoundaryDirty(getSegmentThread(segment), segment->start);
+        }
+        break;
+    case ST_PINCH_JOURNAL_JOIN_5PRIME:
+        segment = entry->object;
+        nSegment = entry->pointer1;
+        thread = getSegmentThread(segment);
+        stPinchSegmentIndex_remove(thread->segments, nSegment->start);
+        nSegment->start = entry->value1;
+        stPinchSegmentIndex_insert(thread->segments, segment->start, segment);
+        stPinchSegmentIndex_insert(thread->segments, nSegment->start, nSegment);
+        setPSegment(nSegment, segment);
+        if (getPSegment(segment) != NULL) {
+            setNSegment(getPSegment(segment), segment);
+        }
+        if (thread->trackBoundaries) {
+            markBoundaryDirty(thread, nSegment->start);
+        }
+        break;
+    case ST_PINCH_JOURNAL_ADD_THREAD:
+        thread = entry->object;
+        assert(stList_peek(threadSet->threads) == thread);
+        stList_pop(threadSet->threads);
+        stPinchThreadNameIndex_remove(&threadSet->threadNames, thread);
+        if (thread->segmentAllocator != NULL) {
+            //Later changes to the thread have been undone, leaving the two segments it was made with,
+            //which stPinchThread_destruct would leave in the slab until the thread set is destructed
+            segment = stPinchThread_getFirst(thread);
+            assert(getNSegment(getNSegment(segment)) == NULL);
+            freeSegment(getNSegment(segment));
+            freeSegment(segment);
+        }
+        stPinchThread_destruct(thread);
+#ifdef ST_PINCH_COMPACT_HANDLES
+        stPinchSlabAllocator_free(threadSet->threadAllocator, thread);
+#endif
+        break;
+    case ST_PINCH_JOURNAL_DIRTY_BOUNDARIES:
+        thread = entry->object;
+        if (entry->value2) {
+            markAllBoundariesDirty(thread);
+        }
+        for (int64_t i = 0; i < entry->value1; i++) {
+            markBoundaryDirty(thread, ((int64_t *) entry->pointer1)[i]);
+        }
+        free(entry->pointer1);
+        break;
+    case ST_PINCH_JOURNAL_TRACK_BOUNDARIES:
+        threadSet->trackBoundaries = 0;
+        for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+            thread = stList_get(threadSet->threads, i);
+            thread->trackBoundaries = 0;
+            thread->dirtyBoundaryNumber = 0;
+            thread->allBoundariesDirty = 0;
+        }
+        break;
+    }
+}
+
+void stPinchThreadSet_rollbackTransaction(stPinchThreadSet *threadSet) {
+    stPinchJournal *journal = threadSet->journal;
+    assert(journal != NULL);
+    setJournal(threadSet, NULL);
+    for (int64_t i = journal->entryNumber - 1; i >= 0; i--) {
+        stPinchJournalEntry_undo(&journal->entries[i], threadSet);
+    }
+    stPinchJournal_destruct(journal);
+}
+
+//Binary snapshots
+
+/*
+ * The snapshot is a header followed by four arrays of fixed size records, in native byte order:
+ * the threads, the segments of all threads (thread by thread, in order, excluding the
+ * terminator segments), the blocks, and the segments of each block in turn, from head to tail.
+ * Segment records refer to blocks by array index, -1 meaning none, and the segments of a block
+ * are given by thread index and start, so that neither needs a map from addresses to be written.
+ */
+#define ST_PINCH_BINARY_MAGIC "stPinchG"
+#define ST_PINCH_BINARY_VERSION 2
+#define ST_PINCH_BINARY_BYTE_ORDER 0x01020304
+#define ST_PINCH_BINARY_BUFFER_SIZE (1 << 20)
+
+typedef struct _stPinchBinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder; // Differs when read on a machine of the other endianness
+    int64_t threadNumber;
+    int64_t segmentNumber;
+    int64_t blockNumber;
+    int64_t blockSegmentNumber;
+} stPinchBinaryHeader;
+
+typedef struct _stPinchBinaryThread {
+    int64_t name;
+    int64_t start;
+    int64_t length;
+    int64_t segmentNumber;
+} stPinchBinaryThread;
+
+typedef struct _stPinchBinarySegment {
+    int64_t start;
+    int64_t block;
+    int64_t blockOrientation;
+} stPinchBinarySegment;
+
+typedef struct _stPinchBinaryBlock {
+    int64_t degree;
+    int64_t numSupportingHomologies;
+    int64_t flags;
+} stPinchBinaryBlock;
+
+typedef struct _stPinchBinaryBlockSegment {
+    int64_t thread;
+    int64_t start;
+} stPinchBinaryBlockSegment;
+
+typedef struct _stPinchSnapshotWriter {
+    FILE *fileHandle;
+    const char *fileName;
+    char *buffer;
+    size_t length;
+} stPinchSnapshotWriter;
+
+static void flushSnapshot(stPinchSnapshotWriter *writer) {
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->fileHandle) != writer->length) {
+        st_errAbort("Failed to write pinch graph snapshot %s", writer->fileName);
+    }
+    writer->length = 0;
+}
+
+static void writeSnapshotRecord(stPinchSnapshotWriter *writer, const void *record, size_t recordSize) {
+    if (writer->length + recordSize > ST_PINCH_BINARY_BUFFER_SIZE) {
+        flushSnapshot(writer);
+    }
+    memcpy(writer->buffer + writer->length, record, recordSize);
+    writer->length += recordSize;
+}
+
+void stPinchThreadSet_writeBinary(stPinchThreadSet *threadSet, const char *fileName) {
+    //Number the blocks in the order of their slots in the registry, which is the order they are written
+    stPinchBlockRegistry *registry = &threadSet->blockRegistry;
+    int64_t *blockIndices = st_malloc((registry->length + 1) * sizeof(int64_t));
+    int64_t blockNumber = 0, blockSegmentNumber = 0;
+    for (int64_t i = 0; i < registry->length; i++) {
+        blockIndices[i] = registry->blocks[i] != NULL ? blockNumber++ : -1;
+        blockSegmentNumber += registry->blocks[i] != NULL ? registry->blocks[i]->degree : 0;
+    }
+    int64_t segmentNumber = 0;
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        segmentNumber += stPinchSegmentIndex_size(((stPinchThread *) stList_get(threadSet->threads, i))->segments);
+    }
+
+    stPinchSnapshotWriter writer = { fopen(fileName, "wb"), fileName, st_malloc(ST_PINCH_BINARY_BUFFER_SIZE), 0 };
+    if (writer.fileHandle == NULL) {
+        st_errAbort("Could not open %s to write a pinch graph snapshot", fileName);
+    }
+    stPinchBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ST_PINCH_BINARY_MAGIC, sizeof(header.magic));
+    header.version = ST_PINCH_BINARY_VERSION;
+    header.byteOrder = ST_PINCH_BINARY_BYTE_ORDER;
+    header.threadNumber = stList_length(threadSet->threads);
+    header.segmentNumber = segmentNumber;
+    header.blockNumber = blockNumber;
+    header.blockSegmentNumber = blockSegmentNumber;
+    writeSnapshotRecord(&writer, &header, sizeof(header));
+
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stPinchThread *thread = stList_get(threadSet->threads, i);
+        stPinchBinaryThread threadRecord = { thread->name, thread->start, thread->length,
+                stPinchSegmentIndex_size(thread->segments) };
+        writeSnapshotRecord(&writer, &threadRecord, sizeof(threadRecord));
+    }
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stPinchSegment *segment = stPinchThread_getFirst(stList_get(threadSet->threads, i));
+        while (getNSegment(segment) != NULL) {
+            stPinchBlock *block = getSegmentBlock(segment);
+            stPinchBinarySegment segmentRecord = { segment->start, block != NULL ? blockIndices[block->slot] : -1,
+                    block != NULL ? getSegmentOrientation(segment) : 0 };
+            writeSnapshotRecord(&writer, &segmentRecord, sizeof(segmentRecord));
+            segment = getNSegment(segment);
+        }
+    }
+    for (int64_t i = 0; i < registry->length; i++) {
+        stPinchBlock *block = registry->blocks[i];
+        if (block != NULL) {
+            stPinchBinaryBlock blockRecord = { block->degree, block->numSupportingHomologies, block->flags };
+            writeSnapshotRecord(&writer, &blockRecord, sizeof(blockRecord));
+        }
+    }
+    for (int64_t i = 0; i < registry->length; i++) {
+        stPinchBlock *block = registry->blocks[i];
+        for (stPinchSegment *segment = block != NULL ? getHeadSegment(block) : NULL; segment != NULL;
+                segment = getNBlockSegment(segment)) {
+            stPinchBinaryBlockSegment blockSegmentRecord = { getSegmentThread(segment)->index, segment->start };
+            writeSnapshotRecord(&writer, &blockSegmentRecord, sizeof(blockSegmentRecord));
+        }
+    }
+    flushSnapshot(&writer);
+    if (fclose(writer.fileHandle) != 0) {
+        st_errAbort("Failed to write pinch graph snapshot %s", fileName);
+    }
+    free(writer.buffer);
+    free(blockIndices);
+}
+
+static void checkSnapshot(bool condition, const char *fileName) {
+    if (!condition) {
+        st_errAbort("%s is not a valid pinch graph snapshot", fileName);
+    }
+}
+
+/*
+ * Gets the index of the segment record with the given start among the given thread's, or -1 if there is none.
+ */
+static int64_t findSnapshotSegment(const stPinchBinarySegment *segmentRecords, const int64_t *threadOffsets, int64_t threadNumber,
+        const stPinchBinaryBlockSegment *blockSegmentRecord) {
+    if (blockSegmentRecord->thread < 0 || blockSegmentRecord->thread >= threadNumber) {
+        return -1;
+    }
+    int64_t i = threadOffsets[blockSegmentRecord->thread], j = threadOffsets[blockSegmentRecord->thread + 1];
+    while (i < j) {
+        int64_t k = (i + j) / 2;
+        if (segmentRecords[k].start < blockSegmentRecord->start) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i < threadOffsets[blockSegmentRecord->thread + 1] && segmentRecords[i].start == blockSegmentRecord->start ? i : -1;
+}
+
+stPinchThreadSet *stPinchThreadSet_readBinary(const char *fileName) {
+    int fileDescriptor = open(fileName, O_RDONLY);
+    if (fileDescriptor == -1) {
+        st_errAbort("Could not open pinch graph snapshot %s", fileName);
+    }
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0) {
+        st_errAbort("Could not read pinch graph snapshot %s", fileName);
+    }
+    size_t fileSize = fileStat.st_size;
+    checkSnapshot(fileSize >= sizeof(stPinchBinaryHeader), fileName);
+    char *data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (data == MAP_FAILED) {
+        st_errAbort("Could not map pinch graph snapshot %s", fileName);
+    }
+
+    const stPinchBinaryHeader *header = (const stPinchBinaryHeader *) data;
+    checkSnapshot(memcmp(header->magic, ST_PINCH_BINARY_MAGIC, sizeof(header->magic)) == 0, fileName);
+    if (header->version != ST_PINCH_BINARY_VERSION || header->byteOrder != ST_PINCH_BINARY_BYTE_ORDER) {
+        st_errAbort("Pinch graph snapshot %s was written by an incompatible version or machine", fileName);
+    }
+    int64_t threadNumber = header->threadNumber, segmentNumber = header->segmentNumber, blockNumber = header->blockNumber;
+    int64_t blockSegmentNumber = header->blockSegmentNumber;
+    checkSnapshot(threadNumber >= 0 && segmentNumber >= 0 && blockNumber >= 0 && blockSegmentNumber >= 0, fileName);
+    checkSnapshot(threadNumber <= (int64_t) (fileSize / sizeof(stPinchBinaryThread))
+            && segmentNumber <= (int64_t) (fileSize / sizeof(stPinchBinarySegment))
+            && blockNumber <= (int64_t) (fileSize / sizeof(stPinchBinaryBlock))
+            && blockSegmentNumber <= (int64_t) (fileSize / sizeof(stPinchBinaryBlockSegment)), fileName);
+    checkSnapshot(fileSize == sizeof(stPinchBinaryHeader) + threadNumber * sizeof(stPinchBinaryThread)
+            + segmentNumber * sizeof(stPinchBinarySegment) + blockNumber * sizeof(stPinchBinaryBlock)
+            + blockSegmentNumber * sizeof(stPinchBinaryBlockSegment), fileName);
+    const stPinchBinaryThread *threadRecords = (const stPinchBinaryThread *) (header + 1);
+    const stPinchBinarySegment *segmentRecords = (const stPinchBinarySegment *) (threadRecords + threadNumber);
+    const stPinchBinaryBlock *blockRecords = (const stPinchBinaryBlock *) (segmentRecords + segmentNumber);
+    const stPinchBinaryBlockSegment *blockSegmentRecords = (const stPinchBinaryBlockSegment *) (blockRecords + blockNumber);
+
+    //Check the threads and the order of their segments, noting where each thread's segment records begin
+    int64_t *threadOffsets = st_malloc((threadNumber + 1) * sizeof(int64_t));
+    int64_t segmentIndex = 0;
+    for (int64_t i = 0; i < threadNumber; i++) {
+        const stPinchBinaryThread *threadRecord = &threadRecords[i];
+        checkSnapshot(threadRecord->length >= 0 && threadRecord->segmentNumber >= 1
+                && threadRecord->segmentNumber <= segmentNumber - segmentIndex, fileName);
+        threadOffsets[i] = segmentIndex;
+        for (int64_t j = 0; j < threadRecord->segmentNumber; j++, segmentIndex++) {
+            int64_t start = segmentRecords[segmentIndex].start;
+            checkSnapshot(j == 0 ? start == threadRecord->start : start > segmentRecords[segmentIndex - 1].start, fileName);
+            checkSnapshot(start < threadRecord->start + threadRecord->length || (j == 0 && threadRecord->length == 0), fileName);
+        }
+    }
+    threadOffsets[threadNumber] = segmentIndex;
+    checkSnapshot(segmentIndex == segmentNumber, fileName);
+
+    //Build the threads and segments. The records are in thread order, so each thread's index is built
+    //bottom up from them rather than by inserting its segments one at a time
+    stPinchThreadSet *threadSet = stPinchThreadSet_construct2(1);
+    stPinchSegment **segments = st_malloc(segmentNumber * sizeof(stPinchSegment *));
+    int64_t *starts = st_malloc(segmentNumber * sizeof(int64_t));
+    for (int64_t i = 0; i < threadNumber; i++) {
+        const stPinchBinaryThread *threadRecord = &threadRecords[i];
+        checkSnapshot(stPinchThreadSet_getThread(threadSet, threadRecord->name) == NULL, fileName);
+        stPinchThread *thread = stPinchThread_construct2(threadRecord->name, threadRecord->start, threadRecord->length, threadSet);
+        stPinchThreadNameIndex_insert(&threadSet->threadNames, thread);
+        stList_append(threadSet->threads, thread);
+        stPinchSegment *pSegment = NULL;
+        for (int64_t k = threadOffsets[i]; k < threadOffsets[i + 1]; k++) {
+            stPinchSegment *segment = stPinchSegment_construct(segmentRecords[k].start, thread);
+            if (pSegment != NULL) {
+                setNSegment(pSegment, segment);
+                setPSegment(segment, pSegment);
+            }
+            segments[k] = segment;
+            starts[k] = segment->start;
+            pSegment = segment;
+        }
+        stPinchSegment *terminatorSegment = stPinchSegment_construct(thread->start + thread->length, thread);
+        setNSegment(pSegment, terminatorSegment);
+        setPSegment(terminatorSegment, pSegment);
+        stPinchSegmentIndex_destruct(thread->segments);
+        thread->segments = stPinchSegmentIndex_constructFromSorted(starts + threadOffsets[i], (void **) segments + threadOffsets[i],
+                threadRecord->segmentNumber);
+    }
+    free(starts);
+
+    //Check that the segments listed for each block are degree distinct segments of the same length that
+    //claim the block, and that no segment claims a block without being listed
+    int64_t claimedSegmentNumber = 0;
+    for (int64_t i = 0; i < segmentNumber; i++) {
+        const stPinchBinarySegment *segmentRecord = &segmentRecords[i];
+        checkSnapshot(segmentRecord->block >= -1 && segmentRecord->block < blockNumber, fileName);
+        checkSnapshot(segmentRecord->block == -1 || segmentRecord->blockOrientation == 0 || segmentRecord->blockOrientation == 1,
+                fileName);
+        claimedSegmentNumber += segmentRecord->block != -1;
+    }
+    checkSnapshot(claimedSegmentNumber == blockSegmentNumber, fileName);
+    int64_t *blockSegments = st_malloc(blockSegmentNumber * sizeof(int64_t)); //Segment indices, block by block
+    bool *visited = st_calloc(segmentNumber, sizeof(bool));
+    int64_t blockSegmentIndex = 0;
+    for (int64_t i = 0; i < blockNumber; i++) {
+        const stPinchBinaryBlock *blockRecord = &blockRecords[i];
+        checkSnapshot(blockRecord->degree >= 1 && blockRecord->degree <= blockSegmentNumber - blockSegmentIndex
+                && blockRecord->numSupportingHomologies >= 0, fileName);
+        int64_t length = -1;
+        for (int64_t j = 0; j < blockRecord->degree; j++, blockSegmentIndex++) {
+            int64_t k = findSnapshotSegment(segmentRecords, threadOffsets, threadNumber, &blockSegmentRecords[blockSegmentIndex]);
+            checkSnapshot(k != -1 && !visited[k] && segmentRecords[k].block == i
+                    && (j == 0 || stPinchSegment_getLength(segments[k]) == length), fileName);
+            visited[k] = 1;
+            length = stPinchSegment_getLength(segments[k]);
+            blockSegments[blockSegmentIndex] = k;
+        }
+    }
+    checkSnapshot(blockSegmentIndex == blockSegmentNumber, fileName);
+    free(visited);
+    free(threadOffsets);
+
+    //Build the blocks and link them and their segments
+    blockSegmentIndex = 0;
+    for (int64_t i = 0; i < blockNumber; i++) {
+        const stPinchBinaryBlock *blockRecord = &blockRecords[i];
+        stPinchSegment *headSegment = segments[blockSegments[blockSegmentIndex]];
+        stPinchBlock *block = allocateBlock(getSegmentThread(headSegment));
+        stPinchSegment *pSegment = NULL;
+        for (int64_t j = 0; j < blockRecord->degree; j++) {
+            int64_t k = blockSegments[blockSegmentIndex++];
+            setSegmentBlock(segments[k], block);
+            setSegmentOrientation(segments[k], segmentRecords[k].blockOrientation);
+            if (pSegment != NULL) {
+                setNBlockSegment(pSegment, segments[k]);
+            }
+            pSegment = segments[k];
+        }
+        setHeadSegment(block, headSegment);
+        setTailSegment(block, pSegment);
+        block->degree = blockRecord->degree;
+        block->numSupportingHomologies = blockRecord->numSupportingHomologies;
+        block->flags = blockRecord->flags & ~1; //The modified flag is set below, adding the block to the modified blocks
+        stPinchBlock_setModifiedFlag(block, blockRecord->flags & 1);
+    }
+
+    free(segments);
+    free(blockSegments);
+    munmap(data, fileSize);
+    return threadSet;
+}
+
 stPinchThread *stPinchThreadSet_getThread(stPinchThreadSet *threadSet, int64_t name) {
-    stPinchThread thread;
-    thread.name = name;
-    return stHash_search(threadSet->threadsHash, &thread);
+    return stPinchThreadNameIndex_get(&threadSet->threadNames, name);
 }
 
 int64_t stPinchThreadSet_getSize(stPinchThreadSet *threadSet) {
@@ -663,6 +2857,32 @@ stPinchThread *stPinchThreadSetIt_getNext(stPinchThreadSetIt *threadIt) {
     return NULL;
 }
 
+/*
+ * Records that the thread's dirty boundaries, which the journal takes ownership of, have been cleared,
+ * along with whether all its boundaries were dirty, so that they are restored with the joined boundaries
+ * if the transaction is rolled back.
+ */
+static void journalDirtyBoundaries(stPinchThread *thread, int64_t *dirtyBoundaries, int64_t dirtyBoundaryNumber,
+        bool allBoundariesDirty) {
+    stPinchJournalEntry *entry = stPinchJournal_append(thread->journal, ST_PINCH_JOURNAL_DIRTY_BOUNDARIES, thread);
+    entry->pointer1 = dirtyBoundaries;
+    entry->value1 = dirtyBoundaryNumber;
+    entry->value2 = allBoundariesDirty;
+}
+
+static void clearDirtyBoundaries(stPinchThreadSet *threadSet) {
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stPinchThread *thread = stList_get(threadSet->threads, i);
+        if (thread->journal != NULL && (thread->dirtyBoundaryNumber > 0 || thread->allBoundariesDirty)) {
+            journalDirtyBoundaries(thread, thread->dirtyBoundaries, thread->dirtyBoundaryNumber, thread->allBoundariesDirty);
+            thread->dirtyBoundaries = NULL;
+            thread->maxDirtyBoundaryNumber = 0;
+        }
+        thread->dirtyBoundaryNumber = 0;
+        thread->allBoundariesDirty = 0;
+    }
+}
+
 void stPinchThreadSet_joinTrivialBoundaries(stPinchThreadSet *threadSet) {
     stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
     stPinchThread *thread;
@@ -681,6 +2901,84 @@ void stPinchThreadSet_joinTrivialBoundaries(stPinchThreadSet *threadSet) {
             stPinchEnd_joinTrivialBoundary(end);
         }
     }
+    clearDirtyBoundaries(threadSet);
+}
+
+/*
+ * Joins the boundary between the segment starting at the coordinate and the segment before
+ * it, if the coordinate is still the start of a segment and the boundary is trivial.
+ */
+static void joinTrivialBoundaryAt(stPinchThread *thread, int64_t coordinate) {
+    stPinchSegment *segment = stPinchThread_getSegment(thread, coordinate);
+    if (segment == NULL || segment->start != coordinate || getPSegment(segment) == NULL) {
+        return;
+    }
+    stPinchSegment *pSegment = getPSegment(segment);
+    stPinchBlock *block = getSegmentBlock(pSegment);
+    if (block == NULL) {
+        if (getSegmentBlock(segment) == NULL) {
+            merge3Prime(pSegment);
+        }
+        return;
+    }
+    //The end of the block which pSegment leaves on its 3' side
+    stPinchEnd end = stPinchEnd_constructStatic(block, !getSegmentOrientation(pSegment));
+    if (stPinchEnd_boundaryIsTrivial(end)) {
+        stPinchEnd_joinTrivialBoundary(end);
+    }
+}
+
+static int compareCoordinates(const void *a, const void *b) {
+    int64_t i = *(const int64_t *) a, j = *(const int64_t *) b;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+void stPinchThreadSet_joinTrivialBoundariesIncremental(stPinchThreadSet *threadSet) {
+    if (!threadSet->trackBoundaries) {
+        stPinchThreadSet_joinTrivialBoundaries(threadSet);
+        if (threadSet->journal != NULL) {
+            stPinchJournal_append(threadSet->journal, ST_PINCH_JOURNAL_TRACK_BOUNDARIES, threadSet);
+        }
+        threadSet->trackBoundaries = 1;
+        for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+            ((stPinchThread *) stList_get(threadSet->threads, i))->trackBoundaries = 1;
+        }
+        return;
+    }
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stPinchThread *thread = stList_get(threadSet->threads, i);
+        //Joining marks further boundaries, which are already covered, so work on a copy of the dirty boundaries
+        int64_t *dirtyBoundaries = thread->dirtyBoundaries;
+        int64_t dirtyBoundaryNumber = thread->dirtyBoundaryNumber;
+        bool allBoundariesDirty = thread->allBoundariesDirty;
+        thread->dirtyBoundaries = NULL;
+        thread->dirtyBoundaryNumber = 0;
+        thread->maxDirtyBoundaryNumber = 0;
+        thread->allBoundariesDirty = 0;
+        if (allBoundariesDirty) {
+            //Too many to have been recorded, so examine the start of every segment bar the terminator, in order
+            assert(dirtyBoundaries == NULL);
+            dirtyBoundaries = st_malloc(stPinchSegmentIndex_size(thread->segments) * sizeof(int64_t));
+            stPinchSegment *segment = stPinchThread_getFirst(thread);
+            while (getNSegment(segment) != NULL) {
+                dirtyBoundaries[dirtyBoundaryNumber++] = segment->start;
+                segment = getNSegment(segment);
+            }
+        } else if (dirtyBoundaryNumber > 0) {
+            qsort(dirtyBoundaries, dirtyBoundaryNumber, sizeof(int64_t), compareCoordinates);
+        }
+        for (int64_t j = 0; j < dirtyBoundaryNumber; j++) {
+            if (j == 0 || dirtyBoundaries[j] != dirtyBoundaries[j - 1]) {
+                joinTrivialBoundaryAt(thread, dirtyBoundaries[j]);
+            }
+        }
+        if (thread->journal != NULL && (dirtyBoundaryNumber > 0 || allBoundariesDirty)) {
+            journalDirtyBoundaries(thread, dirtyBoundaries, dirtyBoundaryNumber, 0);
+        } else {
+            free(dirtyBoundaries);
+        }
+    }
+    clearDirtyBoundaries(threadSet);
 }
 
 stPinchSegment *stPinchThreadSet_getSegment(stPinchThreadSet *threadSet, int64_t name, int64_t coordinate) {
@@ -714,88 +3012,230 @@ stPinchSegment *stPinchThreadSetSegmentIt_getNext(stPinchThreadSetSegmentIt *seg
     return segmentIt->segment;
 }
 
-stPinchThreadSetBlockIt stPinchThreadSet_getBlockIt(stPinchThreadSet *threadSet) {
-    stPinchThreadSetBlockIt blockIt;
-    blockIt.segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
-    return blockIt;
+stPinchThreadSetBlockIt stPinchThreadSet_getBlockIt(stPinchThreadSet *threadSet) {
+    stPinchThreadSetBlockIt blockIt;
+    blockIt.threadSet = threadSet;
+    blockIt.slot = 0;
+    return blockIt;
+}
+
+stPinchBlock *stPinchThreadSetBlockIt_getNext(stPinchThreadSetBlockIt *blockIt) {
+    stPinchBlockRegistry *registry = &blockIt->threadSet->blockRegistry;
+    while (blockIt->slot < registry->length) {
+        stPinchBlock *block = registry->blocks[blockIt->slot++];
+        if (block != NULL) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+stPinchThreadSetModifiedBlockIt stPinchThreadSet_getModifiedBlockIt(stPinchThreadSet *threadSet) {
+    stPinchThreadSetModifiedBlockIt modifiedBlockIt;
+    modifiedBlockIt.block = threadSet->modifiedBlocks.head;
+    return modifiedBlockIt;
+}
+
+stPinchBlock *stPinchThreadSetModifiedBlockIt_getNext(stPinchThreadSetModifiedBlockIt *modifiedBlockIt) {
+    stPinchBlock *block = modifiedBlockIt->block;
+    if (block != NULL) {
+        modifiedBlockIt->block = getNModifiedBlock(block);
+    }
+    return block;
+}
+
+int64_t stPinchThreadSet_getModifiedBlockNumber(stPinchThreadSet *threadSet) {
+    return threadSet->modifiedBlocks.length;
+}
+
+stList *stPinchThreadSet_consumeModifiedBlocks(stPinchThreadSet *threadSet) {
+    stList *blocks = stList_construct();
+    stPinchBlock *block = threadSet->modifiedBlocks.head;
+    while (block != NULL) {
+        stList_append(blocks, block);
+        if (threadSet->journal != NULL) {
+            setPModifiedBlock(block, NULL); //Each block is in turn removed from the head of the list
+            journalModifiedFlag(threadSet->journal, block, 1);
+        }
+        setFlag(block, 0, 0);
+        block = getNModifiedBlock(block);
+    }
+    threadSet->modifiedBlocks.head = NULL;
+    threadSet->modifiedBlocks.length = 0;
+    return blocks;
+}
+
+int64_t stPinchThreadSet_getTotalBlockNumber(stPinchThreadSet *threadSet) {
+    return threadSet->blockRegistry.blockNumber;
+}
+
+int64_t stPinchThreadSet_getBlockIndexBound(stPinchThreadSet *threadSet) {
+    return threadSet->blockRegistry.length;
+}
+
+stPinchBlock *stPinchThreadSet_getBlockFromIndex(stPinchThreadSet *threadSet, int64_t index) {
+    assert(index >= 0 && index < threadSet->blockRegistry.length);
+    return threadSet->blockRegistry.blocks[index];
+}
+
+//Concurrent union-find over dense indices, as used for adjacency and thread components
+
+/*
+ * Finds the root of an element of a union-find forest that may be updated by other threads,
+ * halving the path as it goes.
+ */
+static int64_t concurrentUnionFind_find(int64_t *parents, int64_t i) {
+    while (1) {
+        int64_t parent = __atomic_load_n(&parents[i], __ATOMIC_RELAXED);
+        if (parent == i) {
+            return i;
+        }
+        int64_t grandparent = __atomic_load_n(&parents[parent], __ATOMIC_RELAXED);
+        if (grandparent != parent) {
+            __atomic_compare_exchange_n(&parents[i], &parent, grandparent, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+        i = grandparent;
+    }
 }
 
-stPinchBlock *stPinchThreadSetBlockIt_getNext(stPinchThreadSetBlockIt *blockIt) {
+/*
+ * Joins the sets of two elements. The root of each set is always its least element, so the
+ * final forest does not depend on the order of the unions.
+ *
+ * This is lock-free rather than wait-free: a union whose compare and swap fails, because
+ * another thread linked one of the roots first, finds the roots again and retries. Every
+ * failure means some other union made progress, and a root can be linked at most once, so
+ * the retries of one union are bounded by the number of elements, but not by a constant.
+ */
+static void concurrentUnionFind_union(int64_t *parents, int64_t i, int64_t j) {
     while (1) {
-        stPinchSegment *segment = stPinchThreadSetSegmentIt_getNext(&(blockIt->segmentIt));
-        if (segment == NULL) {
-            return NULL;
+        i = concurrentUnionFind_find(parents, i);
+        j = concurrentUnionFind_find(parents, j);
+        if (i == j) {
+            return;
         }
-        stPinchBlock *block;
-        if ((block = stPinchSegment_getBlock(segment)) != NULL && stPinchBlock_getFirst(block) == segment) {
-            return block;
+        if (i < j) {
+            int64_t k = i;
+            i = j;
+            j = k;
+        }
+        int64_t expected = i;
+        if (__atomic_compare_exchange_n(&parents[i], &expected, j, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return;
         }
     }
-    return NULL;
 }
 
-int64_t stPinchThreadSet_getTotalBlockNumber(stPinchThreadSet *threadSet) {
-    int64_t blockCount = 0;
-    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-    while (stPinchThreadSetBlockIt_getNext(&blockIt) != NULL) {
-        blockCount++;
+static int64_t *concurrentUnionFind_construct(int64_t elementNumber) {
+    int64_t *parents = st_malloc(elementNumber * sizeof(int64_t));
+    for (int64_t i = 0; i < elementNumber; i++) {
+        parents[i] = i;
     }
-    return blockCount;
+    return parents;
 }
 
-void stPinchThreadSet_getAdjacencyComponentsP2(stHash *endsToAdjacencyComponents, stList *adjacencyComponent, stPinchEnd *end) {
-    stList *stack = stList_construct();
-    stList_append(adjacencyComponent, end);
-    stHash_insert(endsToAdjacencyComponents, end, adjacencyComponent);
-    stList_append(stack, end);
-    while (stList_length(stack) > 0) {
-        end = stList_pop(stack);
-        stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(end->block);
-        stPinchSegment *segment;
-        while ((segment = stPinchBlockIt_getNext(&blockIt)) != NULL) {
-            bool _5PrimeTraversal = stPinchEnd_traverse5Prime(end->orientation, segment);
-            while (1) {
-                segment = _5PrimeTraversal ? stPinchSegment_get5Prime(segment) : stPinchSegment_get3Prime(segment);
-                if (segment == NULL) {
-                    break;
-                }
-                stPinchBlock *block = stPinchSegment_getBlock(segment);
-                if (block != NULL) {
-                    stPinchEnd end2 = stPinchEnd_constructStatic(block, stPinchEnd_endOrientation(_5PrimeTraversal, segment));
-                    if (stHash_search(endsToAdjacencyComponents, &end2) == NULL) {
-                        stPinchEnd *end3 = stPinchEnd_construct(end2.block, end2.orientation);
-                        stList_append(adjacencyComponent, end3);
-                        stHash_insert(endsToAdjacencyComponents, end3, adjacencyComponent);
-                        stList_append(stack, end3);
-                    }
-                    break;
-                }
+/*
+ * Replaces the parent of each element with the number of its set, the sets being numbered from 0 in
+ * order of their least elements. Elements for which skip is set are given -1. Returns the number of sets.
+ */
+static int64_t concurrentUnionFind_number(int64_t *parents, int64_t elementNumber, bool (*skip)(void *, int64_t), void *extraArg) {
+    int64_t setNumber = 0;
+    for (int64_t i = 0; i < elementNumber; i++) {
+        if (skip != NULL && skip(extraArg, i)) {
+            parents[i] = -1;
+        } else if (parents[i] == i) {
+            parents[i] = setNumber++;
+        } else { //The root of each set is its least element, so parents have already been numbered
+            assert(parents[i] < i);
+            parents[i] = parents[parents[i]];
+        }
+    }
+    return setNumber;
+}
+
+//Adjacency components
+
+
+typedef struct _stPinchAdjacencyWorker {
+    stPinchThreadSet *threadSet;
+    int64_t *parents;
+    int64_t *nextThread; //Shared between the workers
+} stPinchAdjacencyWorker;
+
+/*
+ * Joins the ends connected by the adjacencies along each thread, taking threads until none are left.
+ */
+static void *adjacencyComponentsWorker(void *arg) {
+    stPinchAdjacencyWorker *worker = arg;
+    int64_t threadNumber = stList_length(worker->threadSet->threads);
+    int64_t i;
+    while ((i = __atomic_fetch_add(worker->nextThread, 1, __ATOMIC_RELAXED)) < threadNumber) {
+        stPinchThread *thread = stList_get(worker->threadSet->threads, i);
+        stPinchSegment *pSegment = NULL; //The last segment with a block
+        for (stPinchSegment *segment = stPinchThread_getFirst(thread); segment != NULL; segment = getNSegment(segment)) {
+            stPinchBlock *block = getSegmentBlock(segment);
+            if (block == NULL) {
+                continue;
+            }
+            if (pSegment != NULL) {
+                //The end on the 3' side of pSegment is adjacent to the end on the 5' side of segment
+                concurrentUnionFind_union(worker->parents, 2 * getSegmentBlock(pSegment)->slot + !getSegmentOrientation(pSegment),
+                        2 * block->slot + getSegmentOrientation(segment));
             }
+            pSegment = segment;
         }
     }
-    stList_destruct(stack);
+    return NULL;
 }
 
-void stPinchThreadSet_getAdjacencyComponentsP(stHash *endsToAdjacencyComponents, stList *adjacencyComponents, stPinchBlock *block,
-        bool orientation) {
-    stPinchEnd end = stPinchEnd_constructStatic(block, orientation);
-    stList *adjacencyComponent = stHash_search(endsToAdjacencyComponents, &end);
-    if (adjacencyComponent == NULL) {
-        adjacencyComponent = stList_construct3(0, (void(*)(void *)) stPinchEnd_destruct);
-        stList_append(adjacencyComponents, adjacencyComponent);
-        stPinchThreadSet_getAdjacencyComponentsP2(endsToAdjacencyComponents, adjacencyComponent, stPinchEnd_construct(block, orientation));
+static bool endIndexIsUnused(void *threadSet, int64_t i) {
+    return ((stPinchThreadSet *) threadSet)->blockRegistry.blocks[i / 2] == NULL;
+}
+
+int64_t *stPinchThreadSet_getAdjacencyComponentIndices(stPinchThreadSet *threadSet, int64_t threadNumber, int64_t *componentNumber) {
+    int64_t endNumber = 2 * threadSet->blockRegistry.length;
+    int64_t *parents = concurrentUnionFind_construct(endNumber);
+
+    //The calling thread acts as the first worker
+    int64_t workerNumber = threadNumber < stList_length(threadSet->threads) ? threadNumber : stList_length(threadSet->threads);
+    if (workerNumber < 1) {
+        workerNumber = 1;
+    }
+    int64_t nextThread = 0;
+    stPinchAdjacencyWorker worker = { threadSet, parents, &nextThread };
+    pthread_t *threads = st_malloc(workerNumber * sizeof(pthread_t));
+    for (int64_t i = 1; i < workerNumber; i++) {
+        if (pthread_create(&threads[i], NULL, adjacencyComponentsWorker, &worker) != 0) {
+            st_errAbort("Failed to create a thread to compute adjacency components");
+        }
+    }
+    adjacencyComponentsWorker(&worker);
+    for (int64_t i = 1; i < workerNumber; i++) {
+        pthread_join(threads[i], NULL);
     }
+    free(threads);
+
+    *componentNumber = concurrentUnionFind_number(parents, endNumber, endIndexIsUnused, threadSet);
+    return parents;
 }
 
 stList *stPinchThreadSet_getAdjacencyComponents2(stPinchThreadSet *threadSet, stHash **endsToAdjacencyComponents) {
+    int64_t componentNumber;
+    int64_t *componentIndices = stPinchThreadSet_getAdjacencyComponentIndices(threadSet, 1, &componentNumber);
     *endsToAdjacencyComponents = stHash_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL, NULL);
     stList *adjacencyComponents = stList_construct3(0, (void(*)(void *)) stList_destruct);
-    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-    stPinchBlock *block;
-    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
-        stPinchThreadSet_getAdjacencyComponentsP(*endsToAdjacencyComponents, adjacencyComponents, block, 0);
-        stPinchThreadSet_getAdjacencyComponentsP(*endsToAdjacencyComponents, adjacencyComponents, block, 1);
+    for (int64_t i = 0; i < componentNumber; i++) {
+        stList_append(adjacencyComponents, stList_construct3(0, (void(*)(void *)) stPinchEnd_destruct));
+    }
+    for (int64_t i = 0; i < 2 * threadSet->blockRegistry.length; i++) {
+        if (componentIndices[i] != -1) {
+            stList *adjacencyComponent = stList_get(adjacencyComponents, componentIndices[i]);
+            stPinchEnd *end = stPinchEnd_construct(threadSet->blockRegistry.blocks[i / 2], i % 2);
+            stList_append(adjacencyComponent, end);
+            stHash_insert(*endsToAdjacencyComponents, end, adjacencyComponent);
+        }
     }
+    free(componentIndices);
     return adjacencyComponents;
 }
 
@@ -806,41 +3246,82 @@ stList *stPinchThreadSet_getAdjacencyComponents(stPinchThreadSet *threadSet) {
     return adjacencyComponents;
 }
 
-stSortedSet *stPinchThreadSet_getThreadComponents(stPinchThreadSet *threadSet) {
-    stUnionFind *components = stUnionFind_construct();
-    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
-    stPinchThread *thread;
+//Thread components
 
-    //Make a component for each thread.
-    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
-        stUnionFind_add(components, thread);
+#define ST_PINCH_THREAD_COMPONENTS_CHUNK 64 // Block slots taken by a worker at a time
+
+typedef struct _stPinchThreadComponentsWorker {
+    stPinchThreadSet *threadSet;
+    int64_t *parents;
+    int64_t *nextSlot; //Shared between the workers
+} stPinchThreadComponentsWorker;
+
+/*
+ * Joins the threads of each block, taking chunks of the block registry until none are left.
+ */
+static void *threadComponentsWorker(void *arg) {
+    stPinchThreadComponentsWorker *worker = arg;
+    stPinchBlockRegistry *registry = &worker->threadSet->blockRegistry;
+    int64_t i;
+    while ((i = __atomic_fetch_add(worker->nextSlot, ST_PINCH_THREAD_COMPONENTS_CHUNK, __ATOMIC_RELAXED)) < registry->length) {
+        int64_t j = i + ST_PINCH_THREAD_COMPONENTS_CHUNK < registry->length ? i + ST_PINCH_THREAD_COMPONENTS_CHUNK : registry->length;
+        for (; i < j; i++) {
+            stPinchBlock *block = registry->blocks[i];
+            if (block == NULL) {
+                continue;
+            }
+            int64_t firstThreadIndex = getSegmentThread(getHeadSegment(block))->index;
+            for (stPinchSegment *segment = getNBlockSegment(getHeadSegment(block)); segment != NULL; segment = getNBlockSegment(segment)) {
+                concurrentUnionFind_union(worker->parents, firstThreadIndex, getSegmentThread(segment)->index);
+            }
+        }
     }
+    return NULL;
+}
 
-    //Now join components progressively according to blocks
-    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-    stPinchBlock *block;
-    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
-        stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(block);
-        stPinchSegment *segment = stPinchBlockIt_getNext(&segmentIt);
-        assert(segment != NULL);
-        stPinchThread *firstThread = stPinchSegment_getThread(segment);
-        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
-            stUnionFind_union(components, firstThread, stPinchSegment_getThread(segment));
+int64_t *stPinchThreadSet_getThreadComponentIndices(stPinchThreadSet *threadSet, int64_t threadNumber, int64_t *componentNumber) {
+    int64_t *parents = concurrentUnionFind_construct(stList_length(threadSet->threads));
+
+    //The calling thread acts as the first worker
+    int64_t chunkNumber = (threadSet->blockRegistry.length + ST_PINCH_THREAD_COMPONENTS_CHUNK - 1) / ST_PINCH_THREAD_COMPONENTS_CHUNK;
+    int64_t workerNumber = threadNumber < chunkNumber ? threadNumber : chunkNumber;
+    if (workerNumber < 1) {
+        workerNumber = 1;
+    }
+    int64_t nextSlot = 0;
+    stPinchThreadComponentsWorker worker = { threadSet, parents, &nextSlot };
+    pthread_t *threads = st_malloc(workerNumber * sizeof(pthread_t));
+    for (int64_t i = 1; i < workerNumber; i++) {
+        if (pthread_create(&threads[i], NULL, threadComponentsWorker, &worker) != 0) {
+            st_errAbort("Failed to create a thread to compute thread components");
         }
     }
+    threadComponentsWorker(&worker);
+    for (int64_t i = 1; i < workerNumber; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    *componentNumber = concurrentUnionFind_number(parents, stList_length(threadSet->threads), NULL, NULL);
+    return parents;
+}
 
-    //Get a list of the components
+stSortedSet *stPinchThreadSet_getThreadComponents(stPinchThreadSet *threadSet) {
+    int64_t componentNumber;
+    int64_t *componentIndices = stPinchThreadSet_getThreadComponentIndices(threadSet, 1, &componentNumber);
+    stList **components = st_malloc(componentNumber * sizeof(stList *));
+    for (int64_t i = 0; i < componentNumber; i++) {
+        components[i] = stList_construct();
+    }
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stList_append(components[componentIndices[i]], stList_get(threadSet->threads, i));
+    }
     stSortedSet *threadComponentsSet = stSortedSet_construct2((void(*)(void *)) stList_destruct);
-    stUnionFindIt *componentsIt = stUnionFind_getIterator(components);
-    stSet *component;
-    while ((component = stUnionFindIt_getNext(componentsIt)) != NULL) {
-        stList *componentList = stSet_getList(component);
-        stSortedSet_insert(threadComponentsSet, componentList);
+    for (int64_t i = 0; i < componentNumber; i++) {
+        stSortedSet_insert(threadComponentsSet, components[i]);
     }
-
-    //Cleanup
-    stUnionFind_destructIterator(componentsIt);
-    stUnionFind_destruct(components);
+    free(components);
+    free(componentIndices);
     return threadComponentsSet;
 }
 
@@ -877,6 +3358,10 @@ bool stPinchEnd_getOrientation(stPinchEnd *end) {
     return end->orientation;
 }
 
+int64_t stPinchEnd_getIndex(stPinchEnd *end) {
+    return 2 * stPinchBlock_getIndex(end->block) + end->orientation;
+}
+
 int stPinchEnd_equalsFn(const void *a, const void *b) {
     const stPinchEnd *end1 = a, *end2 = b;
     return end1->block == end2->block && end1->orientation == end2->orientation;
@@ -954,6 +3439,108 @@ int64_t stPinchEnd_getNumberOfConnectedPinchEnds(stPinchEnd *end) {
     return i;
 }
 
+struct _stPinchEndAdjacencies {
+    int64_t endNumber;
+    int64_t *starts; // The adjacencies of the end with index i are from starts[i] up to starts[i + 1]
+    stPinchEndAdjacency *adjacencies;
+};
+
+stPinchEndAdjacencies *stPinchThreadSet_getEndAdjacencies(stPinchThreadSet *threadSet) {
+    stPinchEndAdjacencies *endAdjacencies = st_malloc(sizeof(stPinchEndAdjacencies));
+    int64_t endNumber = 2 * stPinchThreadSet_getBlockIndexBound(threadSet);
+    endAdjacencies->endNumber = endNumber;
+
+    //Each pair of consecutive aligned segments of a thread connects the end at the 3' side of
+    //the first to the end at the 5' side of the second
+    int64_t *pairs = NULL;
+    int64_t pairNumber = 0, maxPairNumber = 0;
+    int64_t *counts = st_calloc(endNumber + 1, sizeof(int64_t));
+    for (int64_t i = 0; i < stList_length(threadSet->threads); i++) {
+        stPinchSegment *pSegment = NULL;
+        for (stPinchSegment *segment = stPinchThread_getFirst(stList_get(threadSet->threads, i)); segment != NULL;
+                segment = stPinchSegment_get3Prime(segment)) {
+            if (getSegmentBlock(segment) == NULL) {
+                continue;
+            }
+            if (pSegment != NULL) {
+                if (pairNumber == maxPairNumber) {
+                    maxPairNumber = maxPairNumber * 2 + 64;
+                    pairs = st_realloc(pairs, 2 * maxPairNumber * sizeof(int64_t));
+                }
+                int64_t end1 = 2 * getSegmentBlock(pSegment)->slot + stPinchEnd_endOrientation(1, pSegment);
+                int64_t end2 = 2 * getSegmentBlock(segment)->slot + stPinchEnd_endOrientation(0, segment);
+                pairs[2 * pairNumber] = end1;
+                pairs[2 * pairNumber + 1] = end2;
+                pairNumber++;
+                counts[end1]++;
+                counts[end2]++;
+            }
+            pSegment = segment;
+        }
+    }
+
+    //Bucket the other end of each pair by end, then merge repeats into multiplicities
+    int64_t *rawStarts = st_malloc((endNumber + 1) * sizeof(int64_t));
+    rawStarts[0] = 0;
+    for (int64_t i = 0; i < endNumber; i++) {
+        rawStarts[i + 1] = rawStarts[i] + counts[i];
+        counts[i] = rawStarts[i];
+    }
+    int64_t *rawAdjacencies = st_malloc(2 * pairNumber * sizeof(int64_t));
+    for (int64_t i = 0; i < pairNumber; i++) {
+        rawAdjacencies[counts[pairs[2 * i]]++] = pairs[2 * i + 1];
+        rawAdjacencies[counts[pairs[2 * i + 1]]++] = pairs[2 * i];
+    }
+    free(pairs);
+    int64_t *positions = counts; //The position of each end among the adjacencies of the current end
+    for (int64_t i = 0; i < endNumber; i++) {
+        positions[i] = -1;
+    }
+    endAdjacencies->starts = st_malloc((endNumber + 1) * sizeof(int64_t));
+    endAdjacencies->adjacencies = st_malloc(2 * pairNumber * sizeof(stPinchEndAdjacency));
+    int64_t j = 0;
+    for (int64_t i = 0; i < endNumber; i++) {
+        endAdjacencies->starts[i] = j;
+        for (int64_t k = rawStarts[i]; k < rawStarts[i + 1]; k++) {
+            int64_t end = rawAdjacencies[k];
+            if (positions[end] < endAdjacencies->starts[i]) {
+                positions[end] = j;
+                stPinchEndAdjacency *adjacency = &endAdjacencies->adjacencies[j++];
+                adjacency->end = stPinchEnd_constructStatic(threadSet->blockRegistry.blocks[end / 2], end % 2);
+                adjacency->multiplicity = 0;
+            }
+            endAdjacencies->adjacencies[positions[end]].multiplicity++;
+        }
+    }
+    endAdjacencies->starts[endNumber] = j;
+    if (j > 0) {
+        endAdjacencies->adjacencies = st_realloc(endAdjacencies->adjacencies, j * sizeof(stPinchEndAdjacency));
+    }
+    free(positions);
+    free(rawAdjacencies);
+    free(rawStarts);
+    return endAdjacencies;
+}
+
+void stPinchEndAdjacencies_destruct(stPinchEndAdjacencies *endAdjacencies) {
+    free(endAdjacencies->starts);
+    free(endAdjacencies->adjacencies);
+    free(endAdjacencies);
+}
+
+stPinchEndAdjacency *stPinchEndAdjacencies_get(stPinchEndAdjacencies *endAdjacencies, stPinchEnd *end, int64_t *adjacencyNumber) {
+    int64_t i = stPinchEnd_getIndex(end);
+    assert(i < endAdjacencies->endNumber);
+    *adjacencyNumber = endAdjacencies->starts[i + 1] - endAdjacencies->starts[i];
+    return &endAdjacencies->adjacencies[endAdjacencies->starts[i]];
+}
+
+int64_t stPinchEndAdjacencies_getNumber(stPinchEndAdjacencies *endAdjacencies, stPinchEnd *end) {
+    int64_t i = stPinchEnd_getIndex(end);
+    assert(i < endAdjacencies->endNumber);
+    return endAdjacencies->starts[i + 1] - endAdjacencies->starts[i];
+}
+
 static void appendBlocksSegments(stPinchBlock *block, stList *list) {
     stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
     stPinchSegment *segment;
@@ -962,6 +3549,49 @@ static void appendBlocksSegments(stPinchBlock *block, stList *list) {
     }
 }
 
+//If s1 and s2 are successive segments of the same thread, both from the block of end and joined by an interstitial
+//sequence leaving the end of s1 and entering the end of s2, they form a self-loop of the end.
+static bool isSelfLoop(stPinchEnd *end, stPinchSegment *s1, stPinchSegment *s2) {
+    if(stPinchSegment_getBlock(s1) == stPinchEnd_getBlock(end) && //same block
+       stPinchSegment_getBlock(s2) == stPinchEnd_getBlock(end) && //same block
+       stPinchSegment_getThread(s1) == stPinchSegment_getThread(s2) && //same thread
+       !stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s1) && //contiguous
+       stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s2) /*contiguous*/) {
+        assert(stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1) <= s2->start);
+        return 1;
+    }
+    return 0;
+}
+
+//If s1 and s2 are successive segments of the same thread, one from each end, that are contiguous, returns the length of
+//the sequence between them, else returns -1.
+static int64_t getConnectingLength(stPinchEnd *end, stPinchEnd *otherEnd, stPinchSegment *s1, stPinchSegment *s2) {
+    if(stPinchSegment_getThread(s1) == stPinchSegment_getThread(s2)) { //same thread
+        if(stPinchSegment_getBlock(s1) == stPinchEnd_getBlock(end)) { //case where first segment is from first block.
+           if(stPinchSegment_getBlock(s2) == stPinchEnd_getBlock(otherEnd) && //right blocks
+               ((!stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s1) && //contiguity, traverse 5 to 3 from end to otherEnd
+               stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(otherEnd), s2)) ||
+               //second case of contiguity occurs when ends are opposite ends of same block, in which case we must consider
+               //traverse 5 to 4 from otherEnd to end
+               (stPinchEnd_getBlock(end) == stPinchEnd_getBlock(otherEnd) && !stPinchEnd_equalsFn(end, otherEnd) &&
+               !stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(otherEnd), s1) &&
+               stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s2)))) {
+               assert(stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1) <= s2->start);
+               return stPinchSegment_getStart(s2) - (stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1));
+           }
+        } else {
+            assert(stPinchSegment_getBlock(s1) == stPinchEnd_getBlock(otherEnd)); //case where first segment is from other block.
+            if(stPinchSegment_getBlock(s2) == stPinchEnd_getBlock(end) && //different blocks
+                 !stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(otherEnd), s1) &&
+                 stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s2)) { //contiguous
+                assert(stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1) <= s2->start);
+                return stPinchSegment_getStart(s2) - (stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1));
+            }
+        }
+    }
+    return -1;
+}
+
 bool stPinchEnd_hasSelfLoopWithRespectToOtherBlock(stPinchEnd *end, stPinchBlock *otherBlock) {
     //Construct list of segments in end and otherEnd's blocks.
     stList *l = stList_construct();
@@ -974,16 +3604,9 @@ bool stPinchEnd_hasSelfLoopWithRespectToOtherBlock(stPinchEnd *end, stPinchBlock
 
     //Walk through list of segments
     for(int64_t i=1; i<stList_length(l); i++) {
-        stPinchSegment *s1 = stList_get(l, i-1);
-        stPinchSegment *s2 = stList_get(l, i);
         //If there exists two successive segments in the same thread from block's end that are joined by an interstitial sequence,
         //without an intervening segment from otherEnd's block then we have identified a self-loop.
-        if(stPinchSegment_getBlock(s1) == stPinchEnd_getBlock(end) && //same block
-           stPinchSegment_getBlock(s2) == stPinchEnd_getBlock(end) && //same block
-           stPinchSegment_getThread(s1) == stPinchSegment_getThread(s2) && //same thread
-           !stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s1) && //contiguous
-           stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s2) /*contiguous*/) {
-            assert(stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1) <= s2->start);
+        if(isSelfLoop(end, stList_get(l, i-1), stList_get(l, i))) {
             stList_destruct(l);
             return 1;
         }
@@ -1007,60 +3630,159 @@ stList *stPinchEnd_getSubSequenceLengthsConnectingEnds(stPinchEnd *end, stPinchE
 
     //Walk through list of segments
     for(int64_t i=1; i<stList_length(l); i++) {
-        stPinchSegment *s1 = stList_get(l, i-1);
-        stPinchSegment *s2 = stList_get(l, i);
         //If there exists two successive segments in different ends that are contigous add their length.
-        if(stPinchSegment_getThread(s1) == stPinchSegment_getThread(s2)) { //same thread
-            if(stPinchSegment_getBlock(s1) == stPinchEnd_getBlock(end)) { //case where first segment is from first block.
-               if(stPinchSegment_getBlock(s2) == stPinchEnd_getBlock(otherEnd) && //right blocks
-                   ((!stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s1) && //contiguity, traverse 5 to 3 from end to otherEnd
-                   stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(otherEnd), s2)) ||
-                   //second case of contiguity occurs when ends are opposite ends of same block, in which case we must consider
-                   //traverse 5 to 4 from otherEnd to end
-                   (stPinchEnd_getBlock(end) == stPinchEnd_getBlock(otherEnd) && !stPinchEnd_equalsFn(end, otherEnd) &&
-                   !stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(otherEnd), s1) &&
-                   stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s2)))) {
-                   assert(stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1) <= s2->start);
-                   stList_append(lengths, stIntTuple_construct1(stPinchSegment_getStart(s2) - (stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1))));
-               }
-            } else {
-                assert(stPinchSegment_getBlock(s1) == stPinchEnd_getBlock(otherEnd)); //case where first segment is from other block.
-                if(stPinchSegment_getBlock(s2) == stPinchEnd_getBlock(end) && //different blocks
-                     !stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(otherEnd), s1) &&
-                     stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), s2)) { //contiguous
-                    assert(stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1) <= s2->start);
-                    stList_append(lengths, stIntTuple_construct1(stPinchSegment_getStart(s2) - (stPinchSegment_getStart(s1) + stPinchSegment_getLength(s1))));
-                }
-            }
+        int64_t length = getConnectingLength(end, otherEnd, stList_get(l, i-1), stList_get(l, i));
+        if(length != -1) {
+            stList_append(lengths, stIntTuple_construct1(length));
         }
     }
     stList_destruct(l);
     return lengths;
 }
 
+struct _stPinchSortedBlockSegments {
+    int64_t blockNumber;
+    stPinchSegment ***segments; //The segments of the block with index i sorted by stPinchSegment_compare, or NULL until needed
+    int64_t *segmentNumbers;
+};
+
+stPinchSortedBlockSegments *stPinchThreadSet_getSortedBlockSegments(stPinchThreadSet *threadSet) {
+    stPinchSortedBlockSegments *sortedSegments = st_malloc(sizeof(stPinchSortedBlockSegments));
+    sortedSegments->blockNumber = stPinchThreadSet_getBlockIndexBound(threadSet);
+    sortedSegments->segments = st_calloc(sortedSegments->blockNumber, sizeof(stPinchSegment **));
+    sortedSegments->segmentNumbers = st_calloc(sortedSegments->blockNumber, sizeof(int64_t));
+    return sortedSegments;
+}
+
+void stPinchSortedBlockSegments_destruct(stPinchSortedBlockSegments *sortedSegments) {
+    for(int64_t i=0; i<sortedSegments->blockNumber; i++) {
+        free(sortedSegments->segments[i]);
+    }
+    free(sortedSegments->segments);
+    free(sortedSegments->segmentNumbers);
+    free(sortedSegments);
+}
+
+static int compareSegmentPointers(const void *a, const void *b) {
+    return stPinchSegment_compare(*(stPinchSegment * const *)a, *(stPinchSegment * const *)b);
+}
+
+static stPinchSegment **getSortedSegments(stPinchSortedBlockSegments *sortedSegments, stPinchBlock *block, int64_t *segmentNumber) {
+    int64_t i = stPinchBlock_getIndex(block);
+    assert(i < sortedSegments->blockNumber);
+    if(sortedSegments->segments[i] == NULL) {
+        int64_t degree = stPinchBlock_getDegree(block);
+        stPinchSegment **segments = st_malloc(degree * sizeof(stPinchSegment *));
+        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        for(int64_t j=0; j<degree; j++) {
+            segments[j] = stPinchBlockIt_getNext(&it);
+        }
+        qsort(segments, degree, sizeof(stPinchSegment *), compareSegmentPointers);
+        sortedSegments->segments[i] = segments;
+        sortedSegments->segmentNumbers[i] = degree;
+    }
+    *segmentNumber = sortedSegments->segmentNumbers[i];
+    return sortedSegments->segments[i];
+}
+
+//Walks the union of the sorted segments of one or two blocks in order, as if they had been sorted together.
+typedef struct _stPinchSegmentMerge {
+    stPinchSegment **segments1, **segments2;
+    int64_t segmentNumber1, segmentNumber2;
+    int64_t i1, i2;
+} stPinchSegmentMerge;
+
+static stPinchSegmentMerge getSegmentMerge(stPinchSortedBlockSegments *sortedSegments, stPinchBlock *block1, stPinchBlock *block2) {
+    stPinchSegmentMerge merge;
+    merge.segments1 = getSortedSegments(sortedSegments, block1, &merge.segmentNumber1);
+    merge.segments2 = NULL;
+    merge.segmentNumber2 = 0;
+    if(block2 != block1) {
+        merge.segments2 = getSortedSegments(sortedSegments, block2, &merge.segmentNumber2);
+    }
+    merge.i1 = 0;
+    merge.i2 = 0;
+    return merge;
+}
+
+static stPinchSegment *stPinchSegmentMerge_getNext(stPinchSegmentMerge *merge) {
+    if(merge->i1 < merge->segmentNumber1) {
+        if(merge->i2 < merge->segmentNumber2 &&
+           compareSegmentPointers(&merge->segments2[merge->i2], &merge->segments1[merge->i1]) < 0) {
+            return merge->segments2[merge->i2++];
+        }
+        return merge->segments1[merge->i1++];
+    }
+    return merge->i2 < merge->segmentNumber2 ? merge->segments2[merge->i2++] : NULL;
+}
+
+bool stPinchSortedBlockSegments_hasSelfLoopWithRespectToOtherBlock(stPinchSortedBlockSegments *sortedSegments, stPinchEnd *end,
+        stPinchBlock *otherBlock) {
+    stPinchSegmentMerge merge = getSegmentMerge(sortedSegments, stPinchEnd_getBlock(end), otherBlock);
+    stPinchSegment *s1 = stPinchSegmentMerge_getNext(&merge), *s2;
+    while((s2 = stPinchSegmentMerge_getNext(&merge)) != NULL) {
+        if(isSelfLoop(end, s1, s2)) {
+            return 1;
+        }
+        s1 = s2;
+    }
+    return 0;
+}
+
+stList *stPinchSortedBlockSegments_getSubSequenceLengthsConnectingEnds(stPinchSortedBlockSegments *sortedSegments, stPinchEnd *end,
+        stPinchEnd *otherEnd) {
+    stList *lengths = stList_construct3(0, (void (*)(void *))stIntTuple_destruct);
+    stPinchSegmentMerge merge = getSegmentMerge(sortedSegments, stPinchEnd_getBlock(end), stPinchEnd_getBlock(otherEnd));
+    stPinchSegment *s1 = stPinchSegmentMerge_getNext(&merge), *s2;
+    while((s2 = stPinchSegmentMerge_getNext(&merge)) != NULL) {
+        int64_t length = getConnectingLength(end, otherEnd, s1, s2);
+        if(length != -1) {
+            stList_append(lengths, stIntTuple_construct1(length));
+        }
+        s1 = s2;
+    }
+    return lengths;
+}
+
 static void merge3Prime(stPinchSegment *segment) {
-    stPinchSegment *nSegment = segment->nSegment;
+    stPinchSegment *nSegment = getNSegment(segment);
     assert(nSegment != NULL && nSegment != segment);
-    stSortedSet_remove(segment->thread->segments, nSegment);
-    assert(nSegment->block == NULL);
-    assert(nSegment->nSegment != NULL);
-    segment->nSegment = nSegment->nSegment;
-    nSegment->nSegment->pSegment = segment;
-    stPinchSegment_destruct(nSegment);
+    stPinchSegmentIndex_remove(getSegmentThread(segment)->segments, nSegment->start);
+    releaseFinger(getSegmentThread(segment), nSegment);
+    assert(getSegmentBlock(nSegment) == NULL);
+    assert(getNSegment(nSegment) != NULL);
+    setNSegment(segment, getNSegment(nSegment));
+    setPSegment(getNSegment(nSegment), segment);
+    if (getSegmentThread(segment)->journal != NULL) {
+        stPinchJournal_append(getSegmentThread(segment)->journal, ST_PINCH_JOURNAL_JOIN_3PRIME, nSegment);
+    } else {
+        stPinchSegment_destruct(nSegment);
+    }
 }
 
 static void merge5Prime(stPinchSegment *segment) {
-    stPinchSegment *pSegment = segment->pSegment;
+    stPinchSegment *pSegment = getPSegment(segment);
     assert(pSegment != NULL && pSegment != segment);
-    stSortedSet_remove(segment->thread->segments, pSegment);
-    assert(pSegment->block == NULL);
-    segment->pSegment = pSegment->pSegment;
-    if (pSegment->pSegment != NULL) {
-        pSegment->pSegment->nSegment = segment;
+    //The segment takes over the start, and so the index entry, of pSegment
+    stPinchSegmentIndex_remove(getSegmentThread(segment)->segments, segment->start);
+    stPinchSegmentIndex_remove(getSegmentThread(segment)->segments, pSegment->start);
+    stPinchSegmentIndex_insert(getSegmentThread(segment)->segments, pSegment->start, segment);
+    releaseFinger(getSegmentThread(segment), pSegment);
+    assert(getSegmentBlock(pSegment) == NULL);
+    setPSegment(segment, getPSegment(pSegment));
+    if (getPSegment(pSegment) != NULL) {
+        setNSegment(getPSegment(pSegment), segment);
     }
     assert(pSegment->start < segment->start);
-    segment->start = pSegment->start;
-    stPinchSegment_destruct(pSegment);
+    if (getSegmentThread(segment)->journal != NULL) {
+        stPinchJournalEntry *entry = stPinchJournal_append(getSegmentThread(segment)->journal, ST_PINCH_JOURNAL_JOIN_5PRIME, pSegment);
+        entry->pointer1 = segment;
+        entry->value1 = segment->start;
+        segment->start = pSegment->start;
+    } else {
+        segment->start = pSegment->start;
+        stPinchSegment_destruct(pSegment);
+    }
 }
 
 void stPinchEnd_joinTrivialBoundary(stPinchEnd end) {
@@ -1149,54 +3871,65 @@ void stPinchInterval_destruct(stPinchInterval *pinchInterval) {
     free(pinchInterval);
 }
 
-void stPinchThreadSet_getLabelIntervalsP2(stPinchThread *thread, stSortedSet *pinchIntervals, int64_t start, void *label) {
-    int64_t end = stPinchThread_getLength(thread) + stPinchThread_getStart(thread);
-    if (start < end) {
-        stSortedSet_insert(pinchIntervals, stPinchInterval_construct(stPinchThread_getName(thread), start, end - start, label));
-    }
-}
-
-void stPinchThreadSet_getLabelIntervalsP(stPinchThread *thread, stHash *pinchEndsToLabels, stSortedSet *pinchIntervals) {
+/*
+ * Walks the thread, calling addInterval for each interval of positions whose closest end has the same
+ * label. getLabel gives the label of an end.
+ */
+static void getLabelIntervalsOfThread(stPinchThread *thread, void *(*getLabel)(void *, stPinchEnd *), void *labels,
+        void (*addInterval)(void *, int64_t, int64_t, int64_t, void *), void *intervals) {
     stPinchSegment *segment = stPinchThread_getFirst(thread);
     if (segment == NULL) {
         return;
     }
     int64_t start = stPinchSegment_getStart(segment);
+    int64_t threadEnd = stPinchThread_getLength(thread) + stPinchThread_getStart(thread);
     void *label = NULL;
     do {
         stPinchBlock *block;
         while ((block = stPinchSegment_getBlock(segment)) == NULL) {
             segment = stPinchSegment_get3Prime(segment);
             if (segment == NULL) {
-                stPinchThreadSet_getLabelIntervalsP2(thread, pinchIntervals, start, label);
+                if (start < threadEnd) {
+                    addInterval(intervals, stPinchThread_getName(thread), start, threadEnd - start, label);
+                }
                 return;
             }
         }
         stPinchEnd pinchEnd = stPinchEnd_constructStatic(block, !stPinchSegment_getBlockOrientation(segment));
-        void *label2 = stHash_search(pinchEndsToLabels, &pinchEnd);
+        void *label2 = getLabel(labels, &pinchEnd);
         assert(label2 != NULL);
         if (label == NULL) {
             pinchEnd.orientation = !pinchEnd.orientation;
-            label = stHash_search(pinchEndsToLabels, &pinchEnd);
+            label = getLabel(labels, &pinchEnd);
             assert(label != NULL);
         }
 #ifndef NDEBUG
         else {
             pinchEnd.orientation = !pinchEnd.orientation;
-            assert(label == stHash_search(pinchEndsToLabels, &pinchEnd));
+            assert(label == getLabel(labels, &pinchEnd));
         }
 #endif
         if (label != label2) {
             int64_t end = stPinchSegment_getStart(segment) + stPinchSegment_getLength(segment) / 2;
             if (start < end) {
-                stSortedSet_insert(pinchIntervals, stPinchInterval_construct(stPinchThread_getName(thread), start, end - start, label));
+                addInterval(intervals, stPinchThread_getName(thread), start, end - start, label);
             }
             start = end;
             label = label2;
         }
         segment = stPinchSegment_get3Prime(segment);
     } while (segment != NULL);
-    stPinchThreadSet_getLabelIntervalsP2(thread, pinchIntervals, start, label);
+    if (start < threadEnd) {
+        addInterval(intervals, stPinchThread_getName(thread), start, threadEnd - start, label);
+    }
+}
+
+static void *getLabelFromHash(void *pinchEndsToLabels, stPinchEnd *end) {
+    return stHash_search(pinchEndsToLabels, end);
+}
+
+static void addIntervalToSortedSet(void *pinchIntervals, int64_t name, int64_t start, int64_t length, void *label) {
+    stSortedSet_insert(pinchIntervals, stPinchInterval_construct(name, start, length, label));
 }
 
 stSortedSet *stPinchThreadSet_getLabelIntervals(stPinchThreadSet *threadSet, stHash *pinchEndsToLabels) {
@@ -1205,11 +3938,127 @@ stSortedSet *stPinchThreadSet_getLabelIntervals(stPinchThreadSet *threadSet, stH
     stPinchThread *thread;
     stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
     while ((thread = stPinchThreadSetIt_getNext(&threadIt))) {
-        stPinchThreadSet_getLabelIntervalsP(thread, pinchEndsToLabels, pinchIntervals);
+        getLabelIntervalsOfThread(thread, getLabelFromHash, pinchEndsToLabels, addIntervalToSortedSet, pinchIntervals);
     }
     return pinchIntervals;
 }
 
+//Label intervals in flat arrays
+
+struct _stPinchLabelIntervals {
+    stPinchThreadSet *threadSet;
+    stPinchInterval **intervals; // For each thread, by index, its intervals in order
+    int64_t *intervalNumbers;
+};
+
+/*
+ * The intervals of one thread, as they are built.
+ */
+typedef struct _stPinchIntervalArray {
+    stPinchInterval *intervals;
+    int64_t length;
+    int64_t maxLength;
+} stPinchIntervalArray;
+
+static void *getLabelFromArray(void *endLabels, stPinchEnd *end) {
+    return ((void **) endLabels)[stPinchEnd_getIndex(end)];
+}
+
+static void addIntervalToArray(void *intervalArray, int64_t name, int64_t start, int64_t length, void *label) {
+    stPinchIntervalArray *array = intervalArray;
+    if (array->length == array->maxLength) {
+        array->maxLength = array->maxLength == 0 ? 16 : array->maxLength * 2;
+        array->intervals = st_realloc(array->intervals, array->maxLength * sizeof(stPinchInterval));
+    }
+    stPinchInterval_fillOut(&array->intervals[array->length++], name, start, length, label);
+}
+
+typedef struct _stPinchLabelIntervalsWorker {
+    stPinchLabelIntervals *labelIntervals;
+    void **endLabels;
+    int64_t *nextThread; //Shared between the workers
+} stPinchLabelIntervalsWorker;
+
+static void *labelIntervalsWorker(void *arg) {
+    stPinchLabelIntervalsWorker *worker = arg;
+    stPinchLabelIntervals *labelIntervals = worker->labelIntervals;
+    int64_t threadNumber = stList_length(labelIntervals->threadSet->threads);
+    int64_t i;
+    while ((i = __atomic_fetch_add(worker->nextThread, 1, __ATOMIC_RELAXED)) < threadNumber) {
+        stPinchIntervalArray array = { NULL, 0, 0 };
+        getLabelIntervalsOfThread(stList_get(labelIntervals->threadSet->threads, i), getLabelFromArray, worker->endLabels,
+                addIntervalToArray, &array);
+        labelIntervals->intervals[i] = array.length > 0 ? st_realloc(array.intervals, array.length * sizeof(stPinchInterval)) : NULL;
+        labelIntervals->intervalNumbers[i] = array.length;
+    }
+    return NULL;
+}
+
+stPinchLabelIntervals *stPinchThreadSet_getLabelIntervals2(stPinchThreadSet *threadSet, void **endLabels, int64_t threadNumber) {
+    stPinchLabelIntervals *labelIntervals = st_malloc(sizeof(stPinchLabelIntervals));
+    labelIntervals->threadSet = threadSet;
+    labelIntervals->intervals = st_malloc(stList_length(threadSet->threads) * sizeof(stPinchInterval *));
+    labelIntervals->intervalNumbers = st_malloc(stList_length(threadSet->threads) * sizeof(int64_t));
+
+    //The calling thread acts as the first worker
+    int64_t workerNumber = threadNumber < stList_length(threadSet->threads) ? threadNumber : stList_length(threadSet->threads);
+    if (workerNumber < 1) {
+        workerNumber = 1;
+    }
+    int64_t nextThread = 0;
+    stPinchLabelIntervalsWorker worker = { labelIntervals, endLabels, &nextThread };
+    pthread_t *threads = st_malloc(workerNumber * sizeof(pthread_t));
+    for (int64_t i = 1; i < workerNumber; i++) {
+        if (pthread_create(&threads[i], NULL, labelIntervalsWorker, &worker) != 0) {
+            st_errAbort("Failed to create a thread to compute label intervals");
+        }
+    }
+    labelIntervalsWorker(&worker);
+    for (int64_t i = 1; i < workerNumber; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return labelIntervals;
+}
+
+void stPinchLabelIntervals_destruct(stPinchLabelIntervals *labelIntervals) {
+    for (int64_t i = 0; i < stList_length(labelIntervals->threadSet->threads); i++) {
+        free(labelIntervals->intervals[i]);
+    }
+    free(labelIntervals->intervals);
+    free(labelIntervals->intervalNumbers);
+    free(labelIntervals);
+}
+
+stPinchInterval *stPinchLabelIntervals_getThreadIntervals(stPinchLabelIntervals *labelIntervals, stPinchThread *thread,
+        int64_t *intervalNumber) {
+    *intervalNumber = labelIntervals->intervalNumbers[thread->index];
+    return labelIntervals->intervals[thread->index];
+}
+
+stPinchInterval *stPinchLabelIntervals_getInterval(stPinchLabelIntervals *labelIntervals, int64_t name, int64_t position) {
+    stPinchThread *thread = stPinchThreadSet_getThread(labelIntervals->threadSet, name);
+    if (thread == NULL) {
+        return NULL;
+    }
+    int64_t intervalNumber;
+    stPinchInterval *intervals = stPinchLabelIntervals_getThreadIntervals(labelIntervals, thread, &intervalNumber);
+    //Find the last interval starting at or before the position
+    int64_t i = 0, j = intervalNumber;
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        if (intervals[k].start <= position) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    if (i == 0 || intervals[i - 1].start + intervals[i - 1].length <= position) {
+        return NULL;
+    }
+    return &intervals[i - 1];
+}
+
 static inline int cmp64s(int64_t i, int64_t j) {
     return i > j ? 1 : (i < j ? -1 : 0);
 }
@@ -1386,10 +4235,130 @@ void stPinchThread_filterPinch(stPinchThread *thread1, stPinchThread *thread2, i
     }
 }
 
+//Batched filtering of pinches
+
+/*
+ * Returns true if the pair of segments matches any of the predicates in the filter.
+ */
+static inline bool isFilteredSegmentPair(stPinchSegment *segment1, stPinchSegment *segment2, int filter, int64_t maxDegree) {
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+    stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+    if ((filter & ST_PINCH_FILTER_SAME_BLOCK) && block1 != NULL && block1 == block2) {
+        return true;
+    }
+    if ((filter & ST_PINCH_FILTER_BLOCK_MERGE) && block1 != NULL && block2 != NULL && block1 != block2) {
+        return true;
+    }
+    if (filter & ST_PINCH_FILTER_MAX_DEGREE) {
+        int64_t degree = block1 != NULL ? stPinchBlock_getDegree(block1) : 1;
+        if (block1 == NULL || block1 != block2) {
+            degree += block2 != NULL ? stPinchBlock_getDegree(block2) : 1;
+        }
+        if (degree > maxDegree) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void setBits(uint64_t *bits, int64_t from, int64_t to) {
+    for (; from < to && (from & 63) != 0; from++) {
+        bits[from >> 6] |= 1ULL << (from & 63);
+    }
+    for (; from + 64 <= to; from += 64) {
+        bits[from >> 6] = UINT64_MAX;
+    }
+    for (; from < to; from++) {
+        bits[from >> 6] |= 1ULL << (from & 63);
+    }
+}
+
+/*
+ * Walks the segment pairs of each pinch, setting the bits of those accepted. Each thread
+ * keeps a finger on the last segment visited, so runs of nearby pinches don't search the
+ * threads. The filter is always a constant, so each inlined copy tests only its predicates.
+ */
+static inline void filterPinchesP(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber, int filter,
+        int64_t maxDegree, uint64_t *bits) {
+    stPinchSegment **fingers = st_calloc(stPinchThreadSet_getSize(threadSet) + 1, sizeof(stPinchSegment *));
+    stPinchThread *thread1 = NULL, *thread2 = NULL;
+    int64_t firstBit = 0;
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        stPinch *pinch = &pinches[i];
+        if (pinch->length == 0) {
+            continue;
+        }
+        if (thread1 == NULL || thread1->name != pinch->name1) {
+            if ((thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1)) == NULL) {
+                st_errAbort("Pinch refers to thread %" PRIi64 " which is not in the pinch graph", pinch->name1);
+            }
+        }
+        if (thread2 == NULL || thread2->name != pinch->name2) {
+            if ((thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2)) == NULL) {
+                st_errAbort("Pinch refers to thread %" PRIi64 " which is not in the pinch graph", pinch->name2);
+            }
+        }
+        assert(pinch->length > 0);
+        assert(stPinchThread_getStart(thread1) <= pinch->start1);
+        assert(stPinchThread_getStart(thread1) + stPinchThread_getLength(thread1) >= pinch->start1 + pinch->length);
+        assert(stPinchThread_getStart(thread2) <= pinch->start2);
+        assert(stPinchThread_getStart(thread2) + stPinchThread_getLength(thread2) >= pinch->start2 + pinch->length);
+        int64_t end2 = pinch->start2 + pinch->length;
+        stPinchSegment *segment1 = getSegmentFromFinger(thread1, fingers[thread1->index], pinch->start1);
+        stPinchSegment *segment2 = getSegmentFromFinger(thread2, fingers[thread2->index], pinch->strand ? pinch->start2 : end2 - 1);
+        int64_t offset = 0;
+        while (offset < pinch->length) {
+            assert(segment1 != NULL);
+            assert(segment2 != NULL);
+            fingers[thread1->index] = segment1;
+            fingers[thread2->index] = segment2;
+            int64_t start = offset;
+            bool filtered = isFilteredSegmentPair(segment1, segment2, filter, maxDegree);
+            if (pinch->strand) {
+                stPinchThread_filterPinchPositiveStrandP(&segment1, &segment2, pinch->start1, pinch->start2, &offset);
+            } else {
+                stPinchThread_filterPinchNegativeStrandP(&segment1, &segment2, pinch->start1, end2, &offset);
+            }
+            if (!filtered) {
+                setBits(bits, firstBit + start, firstBit + (offset < pinch->length ? offset : pinch->length));
+            }
+        }
+        firstBit += pinch->length;
+    }
+    free(fingers);
+}
+
+#define ST_PINCH_FILTER_CASE(filter) case (filter): \
+        filterPinchesP(threadSet, pinches, pinchNumber, (filter), maxDegree, bits); \
+        break
+
+uint64_t *stPinchThreadSet_filterPinches(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber,
+        int filter, int64_t maxDegree) {
+    int64_t totalLength = 0;
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        totalLength += pinches[i].length;
+    }
+    uint64_t *bits = st_calloc(totalLength / 64 + 1, sizeof(uint64_t));
+    //One case per combination of predicates, so the walk never calls through a pointer
+    switch (filter) {
+        ST_PINCH_FILTER_CASE(0);
+        ST_PINCH_FILTER_CASE(ST_PINCH_FILTER_SAME_BLOCK);
+        ST_PINCH_FILTER_CASE(ST_PINCH_FILTER_BLOCK_MERGE);
+        ST_PINCH_FILTER_CASE(ST_PINCH_FILTER_SAME_BLOCK | ST_PINCH_FILTER_BLOCK_MERGE);
+        ST_PINCH_FILTER_CASE(ST_PINCH_FILTER_MAX_DEGREE);
+        ST_PINCH_FILTER_CASE(ST_PINCH_FILTER_SAME_BLOCK | ST_PINCH_FILTER_MAX_DEGREE);
+        ST_PINCH_FILTER_CASE(ST_PINCH_FILTER_BLOCK_MERGE | ST_PINCH_FILTER_MAX_DEGREE);
+        ST_PINCH_FILTER_CASE(ST_PINCH_FILTER_SAME_BLOCK | ST_PINCH_FILTER_BLOCK_MERGE | ST_PINCH_FILTER_MAX_DEGREE);
+        default:
+            st_errAbort("Unknown pinch filter %i", filter);
+    }
+    return bits;
+}
+
+#undef ST_PINCH_FILTER_CASE
+
 // Ability to undo a pinch. This is a fairly nasty problem--this is
-// the best solution I could come up with. Requires a lot of
-// allocation/deallocation which slows things down, unfortunately. I
-// think that's more or less unavoidable.
+// the best solution I could come up with.
 
 // The general strategy for doing pinch undos is to iterate along one
 // of the regions being pinched and take a snapshot of the blocks
@@ -1398,67 +4367,52 @@ void stPinchThread_filterPinch(stPinchThread *thread1, stPinchThread *thread2, i
 // extra trivial boundaries relative to before the pinch was applied,
 // or degree-1 blocks present before the pinch may be removed,
 // although the alignment relationships will be the same.
+
+// The snapshots are appended by value to a single journal buffer
+// owned by the undo, so preparing an undo only allocates when the
+// buffer has to grow.
+typedef struct {
+    int64_t name;
+    int64_t start;
+    int64_t length;
+} stPinchUndoInterval;
+
 typedef struct {
     uint64_t degree;
-    stPinchInterval *refInterval; // interval of ref (thread1) segment in the pinch region
-    stPinchInterval *head; // interval of first segment in the block
-    stPinchInterval *tail; // interval of last segment in the block
+    stPinchUndoInterval refInterval; // interval of ref (thread1) segment in the pinch region
+    stPinchUndoInterval head; // interval of first segment in the block
+    stPinchUndoInterval tail; // interval of last segment in the block
     uint64_t numSupportingHomologies; // number of supporting homologies in the block.
 } stPinchUndoBlock;
 
 struct _stPinchUndo {
-    stPinch *pinchToUndo; // Pinch that this was created to undo.
-    stList *blocks1; // Saved blocks from before the pinch, in the
-                     // + order on thread1. Blocks appear
-                     // twice if there's a self-alignment.
-    stList *blocks2; // Saved blocks from thread2, in thread order.
+    stPinch pinchToUndo; // Pinch that this was created to undo.
+    stPinchUndoBlock *blocks; // Saved blocks from before the pinch. The
+                              // first blockNumber1 are from thread1, in
+                              // the + order on thread1 (blocks appear
+                              // twice if there's a self-alignment), the
+                              // remainder from thread2, in thread order.
+    int64_t blockNumber1;
+    int64_t blockNumber;
+    int64_t maxBlockNumber;
 };
 
-static stPinchUndoBlock *stPinchUndoBlock_construct(stPinchBlock *block, stPinchSegment *refSegment) {
-    stPinchUndoBlock *ret = calloc(1, sizeof(stPinchUndoBlock));
-    ret->degree = stPinchBlock_getDegree(block);
-    ret->head = stPinchInterval_construct(stPinchSegment_getName(block->headSegment),
-                                          stPinchSegment_getStart(block->headSegment),
-                                          stPinchSegment_getLength(block->headSegment),
-                                          NULL);
-    ret->tail = stPinchInterval_construct(stPinchSegment_getName(block->tailSegment),
-                                          stPinchSegment_getStart(block->tailSegment),
-                                          stPinchSegment_getLength(block->tailSegment),
-                                          NULL);
-    ret->refInterval = stPinchInterval_construct(stPinchSegment_getName(refSegment),
-                                          stPinchSegment_getStart(refSegment),
-                                          stPinchSegment_getLength(refSegment),
-                                          NULL);
-    ret->numSupportingHomologies = stPinchBlock_getNumSupportingHomologies(block);
-    return ret;
-}
-
-static stPinchUndoBlock *stPinchUndoBlock_construct2(stPinchSegment *segment) {
-    stPinchUndoBlock *ret = calloc(1, sizeof(stPinchUndoBlock));
-    ret->degree = 1;
-    ret->head = stPinchInterval_construct(stPinchSegment_getName(segment),
-                                          stPinchSegment_getStart(segment),
-                                          stPinchSegment_getLength(segment),
-                                          NULL);
-    ret->tail = ret->head;
-    ret->refInterval = ret->head;
-    ret->numSupportingHomologies = 0;
-    return ret;
+static void stPinchUndoInterval_set(stPinchUndoInterval *interval, stPinchSegment *segment) {
+    interval->name = stPinchSegment_getName(segment);
+    interval->start = stPinchSegment_getStart(segment);
+    interval->length = stPinchSegment_getLength(segment);
 }
 
-static void stPinchUndoBlock_destruct(stPinchUndoBlock *undoBlock) {
-    stPinchInterval_destruct(undoBlock->head);
-    if (undoBlock->head != undoBlock->tail) {
-        stPinchInterval_destruct(undoBlock->tail);
-    }
-    if (undoBlock->refInterval != undoBlock->head && undoBlock->refInterval != undoBlock->tail) {
-        stPinchInterval_destruct(undoBlock->refInterval);
+static stPinchUndoBlock *stPinchUndo_appendBlock(stPinchUndo *undo) {
+    if (undo->blockNumber == undo->maxBlockNumber) {
+        undo->maxBlockNumber = undo->maxBlockNumber * 2 + 8;
+        undo->blocks = st_realloc(undo->blocks, undo->maxBlockNumber * sizeof(stPinchUndoBlock));
     }
-    free(undoBlock);
+    return &undo->blocks[undo->blockNumber++];
 }
 
 // Iterate along the thread, making a copy of sorts of all the blocks we see.
-static void stPinchThread_prepareUndoP(stPinchThread *thread, int64_t start, int64_t length, stList *blocks) {
+static void stPinchThread_prepareUndoP(stPinchThread *thread, int64_t start, int64_t length, stPinchUndo *undo) {
     if (length == 0) {
         // A zero-length pinch can't affect the graph, so we don't
         // need to save any undo blocks.
@@ -1469,48 +4423,59 @@ static void stPinchThread_prepareUndoP(stPinchThread *thread, int64_t start, int
 
     while (segment != NULL && stPinchSegment_getStart(segment) < start + length) {
         stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchUndoBlock *undoBlock;
+        stPinchUndoBlock *undoBlock = stPinchUndo_appendBlock(undo);
+        stPinchUndoInterval_set(&undoBlock->refInterval, segment);
         if (block == NULL) {
-            undoBlock = stPinchUndoBlock_construct2(segment);
+            undoBlock->degree = 1;
+            undoBlock->head = undoBlock->refInterval;
+            undoBlock->tail = undoBlock->refInterval;
+            undoBlock->numSupportingHomologies = 0;
         } else {
-            undoBlock = stPinchUndoBlock_construct(block, segment);
+            undoBlock->degree = stPinchBlock_getDegree(block);
+            stPinchUndoInterval_set(&undoBlock->head, getHeadSegment(block));
+            stPinchUndoInterval_set(&undoBlock->tail, getTailSegment(block));
+            undoBlock->numSupportingHomologies = stPinchBlock_getNumSupportingHomologies(block);
         }
-        stList_append(blocks, undoBlock);
         segment = stPinchSegment_get3Prime(segment);
     }
 }
 
 stPinchUndo *stPinchThread_prepareUndo(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length, bool strand2) {
-    stPinchUndo *ret = malloc(sizeof(stPinchUndo));
-    ret->blocks1 = stList_construct3(0, (void (*)(void *)) stPinchUndoBlock_destruct);
-    ret->blocks2 = stList_construct3(0, (void (*)(void *)) stPinchUndoBlock_destruct);
-    ret->pinchToUndo = stPinch_construct(stPinchThread_getName(thread1),
-                                         stPinchThread_getName(thread2),
-                                         start1, start2, length, strand2);
-
-    stPinchThread_prepareUndoP(thread1, start1, length, ret->blocks1);
-    stPinchThread_prepareUndoP(thread2, start2, length, ret->blocks2);
+    stPinchUndo *ret = st_malloc(sizeof(stPinchUndo));
+    ret->pinchToUndo.name1 = stPinchThread_getName(thread1);
+    ret->pinchToUndo.name2 = stPinchThread_getName(thread2);
+    ret->pinchToUndo.start1 = start1;
+    ret->pinchToUndo.start2 = start2;
+    ret->pinchToUndo.length = length;
+    ret->pinchToUndo.strand = strand2;
+    ret->blocks = NULL;
+    ret->blockNumber = 0;
+    ret->maxBlockNumber = 0;
+
+    stPinchThread_prepareUndoP(thread1, start1, length, ret);
+    ret->blockNumber1 = ret->blockNumber;
+    stPinchThread_prepareUndoP(thread2, start2, length, ret);
     return ret;
 }
 
-static bool stPinchInterval_containsSegment(stPinchInterval *interval, stPinchSegment *segment) {
-    return stPinchInterval_getName(interval) == stPinchSegment_getName(segment)
-        && stPinchInterval_getStart(interval) <= stPinchSegment_getStart(segment)
-        && stPinchInterval_getStart(interval) + stPinchInterval_getLength(interval) >= stPinchSegment_getStart(segment) + stPinchSegment_getLength(segment);
+static bool stPinchUndoInterval_containsSegment(stPinchUndoInterval *interval, stPinchSegment *segment) {
+    return interval->name == stPinchSegment_getName(segment)
+        && interval->start <= stPinchSegment_getStart(segment)
+        && interval->start + interval->length >= stPinchSegment_getStart(segment) + stPinchSegment_getLength(segment);
 }
 
 #ifndef NDEBUG
 static bool stPinchBlock_check(stPinchBlock *block) {
-    stPinchSegment *segment = block->headSegment;
+    stPinchSegment *segment = getHeadSegment(block);
     int64_t i = 0;
-    while (segment->nBlockSegment != NULL) {
-        segment = segment->nBlockSegment;
+    while (getNBlockSegment(segment) != NULL) {
+        segment = getNBlockSegment(segment);
         i++;
     }
     if (i != block->degree - 1) { 
         return false;
     }
-    if (segment != block->tailSegment) {
+    if (segment != getTailSegment(block)) {
         return false;
     }
     return true;
@@ -1524,11 +4489,11 @@ static stPinchBlock *splitBlockUsingUndoBlock(stPinchBlock *block, stPinchSegmen
         return NULL;
     }
 
-    stPinchSegment *segment = block->headSegment;
+    stPinchSegment *segment = getHeadSegment(block);
     stPinchSegment *prevSegment = NULL;
     int64_t i = 0;
     do {
-        if (stPinchInterval_containsSegment(undoBlock->head, segment)) {
+        if (stPinchUndoInterval_containsSegment(&undoBlock->head, segment)) {
             // Contiguous region representing the old block. (There
             // may be multiple subregions of the old block in this
             // block. We just take out one at a time for each thread1
@@ -1546,8 +4511,8 @@ static stPinchBlock *splitBlockUsingUndoBlock(stPinchBlock *block, stPinchSegmen
                     break;
                 }
                 tmpPrevSeg = tmpSeg;
-                tmpSeg = tmpSeg->nBlockSegment;
-            } while (tmpSeg != NULL && !stPinchInterval_containsSegment(undoBlock->tail, tmpPrevSeg));
+                tmpSeg = getNBlockSegment(tmpSeg);
+            } while (tmpSeg != NULL && !stPinchUndoInterval_containsSegment(&undoBlock->tail, tmpPrevSeg));
 
             if (!refSegmentPresent) {
                 i++;
@@ -1556,15 +4521,18 @@ static stPinchBlock *splitBlockUsingUndoBlock(stPinchBlock *block, stPinchSegmen
             }
 
             int64_t endi = i + undoBlock->degree;
-            stPinchBlock *newBlock = st_calloc(1, sizeof(stPinchBlock));
+            journalBlock(block);
+            stPinchBlock *newBlock = allocateBlock(getSegmentThread(segment));
+            setHeadSegment(newBlock, segment);
             stPinchBlock_setModifiedFlag(newBlock, 1); // Mark the newly created block as modified
             stPinchBlock_setModifiedFlag(block, 1); // Mark the old block as modified
-            newBlock->headSegment = segment;
             while (i < endi) {
-                segment->block = newBlock;
+                journalSegment(segment);
+                setSegmentBlock(segment, newBlock);
+                markSegmentBoundariesDirty(segment);
                 i++;
                 if (i < endi) {
-                    segment = segment->nBlockSegment;
+                    segment = getNBlockSegment(segment);
                     assert(segment != NULL);
                 }
             }
@@ -1572,45 +4540,48 @@ static stPinchBlock *splitBlockUsingUndoBlock(stPinchBlock *block, stPinchSegmen
             // After that loop, segment is the tail segment of the new
             // block and prevSegment is still the segment before the
             // head segment.
-            assert(stPinchInterval_containsSegment(undoBlock->tail, segment));
+            assert(stPinchUndoInterval_containsSegment(&undoBlock->tail, segment));
 
-            newBlock->tailSegment = segment;
+            setTailSegment(newBlock, segment);
             if (prevSegment == NULL) {
                 // The new block we're extracting used to be at the
                 // head of this block.
-                block->headSegment = segment->nBlockSegment;
+                setHeadSegment(block, getNBlockSegment(segment));
             } else {
-                prevSegment->nBlockSegment = segment->nBlockSegment;
+                journalSegment(prevSegment);
+                setNBlockSegment(prevSegment, getNBlockSegment(segment));
             }
-            if (segment->nBlockSegment == NULL) {
-                block->tailSegment = prevSegment;
+            if (getNBlockSegment(segment) == NULL) {
+                setTailSegment(block, prevSegment);
             }
-            segment->nBlockSegment = NULL;
+            setNBlockSegment(segment, NULL);
             newBlock->degree = undoBlock->degree;
             assert(stPinchBlock_check(newBlock));
             block->degree -= newBlock->degree;
             assert(stPinchBlock_check(block));
             newBlock->numSupportingHomologies = undoBlock->numSupportingHomologies;
             block->numSupportingHomologies -= newBlock->numSupportingHomologies + 1;
+            markSegmentBoundariesDirty(getHeadSegment(block));
 
             return newBlock;
         }
         i++;
         prevSegment = segment;
-    } while ((segment = segment->nBlockSegment) != NULL);
+    } while ((segment = getNBlockSegment(segment)) != NULL);
 
     return NULL;
 }
 
-static void stPinchThreadSet_undoPinchP(stPinchThread *thread, int64_t start, int64_t length, stList *blocks) {
-    if (stList_length(blocks) == 0) {
+static void stPinchThreadSet_undoPinchP(stPinchThread *thread, int64_t start, int64_t length,
+                                        stPinchUndoBlock *blocks, int64_t blockNumber) {
+    if (blockNumber == 0) {
         // Nothing to undo.
         return;
     }
 
     stPinchSegment *segment = stPinchThread_getSegment(thread, start);
     int64_t i = 0;
-    stPinchUndoBlock *undoBlock = stList_get(blocks, i);
+    stPinchUndoBlock *undoBlock = &blocks[i];
     while (segment != NULL && stPinchSegment_getStart(segment) < start + length) {
         if (stPinchSegment_getStart(segment) < start) {
             stPinchSegment_split(segment, start - 1);
@@ -1623,9 +4594,9 @@ static void stPinchThreadSet_undoPinchP(stPinchThread *thread, int64_t start, in
         assert(stPinchSegment_getStart(segment) + stPinchSegment_getLength(segment) <= start + length);
 
         // Fast-forward to the proper undo block.
-        while (stList_length(blocks) != i + 1 && !stPinchInterval_containsSegment(undoBlock->refInterval, segment)) {
+        while (blockNumber != i + 1 && !stPinchUndoInterval_containsSegment(&undoBlock->refInterval, segment)) {
             i++;
-            undoBlock = stList_get(blocks, i);
+            undoBlock = &blocks[i];
         }
 
         stPinchBlock *block = stPinchSegment_getBlock(segment);
@@ -1650,10 +4621,12 @@ static void stPinchThreadSet_undoPinchP(stPinchThread *thread, int64_t start, in
 }
 
 void stPinchThreadSet_undoPinch(stPinchThreadSet *threadSet, stPinchUndo *undo) {
-    stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo->name1),
-                                undo->pinchToUndo->start1, undo->pinchToUndo->length, undo->blocks1);
-    stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo->name2),
-                                undo->pinchToUndo->start2, undo->pinchToUndo->length, undo->blocks2);
+    stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo.name1),
+                                undo->pinchToUndo.start1, undo->pinchToUndo.length,
+                                undo->blocks, undo->blockNumber1);
+    stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo.name2),
+                                undo->pinchToUndo.start2, undo->pinchToUndo.length,
+                                undo->blocks + undo->blockNumber1, undo->blockNumber - undo->blockNumber1);
 }
 
 void stPinchThreadSet_partiallyUndoPinch(stPinchThreadSet *threadSet, stPinchUndo *undo, int64_t offset, int64_t length) {
@@ -1661,31 +4634,36 @@ void stPinchThreadSet_partiallyUndoPinch(stPinchThreadSet *threadSet, stPinchUnd
         // Nothing to undo.
         return;
     }
-    stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo->name1),
-                                undo->pinchToUndo->start1 + offset, length, undo->blocks1);
-    if (undo->pinchToUndo->strand) {
-        stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo->name2),
-                                    undo->pinchToUndo->start2 + offset, length, undo->blocks2);
+    stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo.name1),
+                                undo->pinchToUndo.start1 + offset, length,
+                                undo->blocks, undo->blockNumber1);
+    if (undo->pinchToUndo.strand) {
+        stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo.name2),
+                                    undo->pinchToUndo.start2 + offset, length,
+                                    undo->blocks + undo->blockNumber1, undo->blockNumber - undo->blockNumber1);
     } else {
-        stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo->name2),
-                                    undo->pinchToUndo->start2 + undo->pinchToUndo->length - offset - length,
-                                    length, undo->blocks2);
+        stPinchThreadSet_undoPinchP(stPinchThreadSet_getThread(threadSet, undo->pinchToUndo.name2),
+                                    undo->pinchToUndo.start2 + undo->pinchToUndo.length - offset - length,
+                                    length, undo->blocks + undo->blockNumber1, undo->blockNumber - undo->blockNumber1);
     }
 }
 
-static bool stPinchUndo_findOffsetForBlockP(stList *blocks, stPinchBlock *block,
+static bool stPinchUndo_findOffsetForBlockP(stPinchUndoBlock *blocks, int64_t blockNumber, stPinchBlock *block,
                                             stPinchThread *thread, int64_t start,
                                             int64_t length, stPinch *pinch,
                                             int64_t *undoOffset, int64_t *undoLength) {
+    if (blockNumber == 0) {
+        return false;
+    }
     stPinchSegment *segment = stPinchThread_getSegment(thread, start);
     int64_t i = 0;
-    stPinchUndoBlock *undoBlock = stList_get(blocks, i);
+    stPinchUndoBlock *undoBlock = &blocks[i];
     while (segment != NULL && stPinchSegment_getStart(segment) < start + length) {
         if (stPinchSegment_getBlock(segment) == block) {
             // Fast-forward to the proper undo block.
-            while (stList_length(blocks) != i && !stPinchInterval_containsSegment(undoBlock->refInterval, segment)) {
+            while (blockNumber != i + 1 && !stPinchUndoInterval_containsSegment(&undoBlock->refInterval, segment)) {
                 i++;
-                undoBlock = stList_get(blocks, i);
+                undoBlock = &blocks[i];
             }
             if (stPinchBlock_getDegree(block) != undoBlock->degree) {
                 if (stPinchSegment_getName(segment) == pinch->name1 && stPinchSegment_getStart(segment) >= pinch->start1 && stPinchSegment_getStart(segment) < pinch->start1 + pinch->length) {
@@ -1713,24 +4691,22 @@ bool stPinchUndo_findOffsetForBlock(stPinchUndo *undo, stPinchThreadSet *threadS
     // could be undone rather than going through each thread's
     // region. The runtime is more predictable the way it's done now
     // though.
-    if (stPinchUndo_findOffsetForBlockP(undo->blocks1, block,
-                                        stPinchThreadSet_getThread(threadSet, undo->pinchToUndo->name1),
-                                        undo->pinchToUndo->start1, undo->pinchToUndo->length,
-                                        undo->pinchToUndo, undoOffset, undoLength)) {
+    if (stPinchUndo_findOffsetForBlockP(undo->blocks, undo->blockNumber1, block,
+                                        stPinchThreadSet_getThread(threadSet, undo->pinchToUndo.name1),
+                                        undo->pinchToUndo.start1, undo->pinchToUndo.length,
+                                        &undo->pinchToUndo, undoOffset, undoLength)) {
         return true;
     }
-    if (stPinchUndo_findOffsetForBlockP(undo->blocks2, block,
-                                        stPinchThreadSet_getThread(threadSet, undo->pinchToUndo->name2),
-                                        undo->pinchToUndo->start2, undo->pinchToUndo->length,
-                                        undo->pinchToUndo, undoOffset, undoLength)) {
+    if (stPinchUndo_findOffsetForBlockP(undo->blocks + undo->blockNumber1, undo->blockNumber - undo->blockNumber1, block,
+                                        stPinchThreadSet_getThread(threadSet, undo->pinchToUndo.name2),
+                                        undo->pinchToUndo.start2, undo->pinchToUndo.length,
+                                        &undo->pinchToUndo, undoOffset, undoLength)) {
         return true;
     }
     return false;
 }
 
 void stPinchUndo_destruct(stPinchUndo *undo) {
-    stPinch_destruct(undo->pinchToUndo);
-    stList_destruct(undo->blocks1);
-    stList_destruct(undo->blocks2);
+    free(undo->blocks);
     free(undo);
 }
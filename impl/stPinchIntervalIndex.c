@@ -0,0 +1,154 @@
+/*
+ * stPinchIntervalIndex.c
+ *
+ *  Per thread Eytzinger ordered arrays of interval starts.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sonLib.h"
+#include "stPinchGraphs.h"
+#include "stPinchIntervalIndex.h"
+
+typedef struct _stPinchIntervalIndexThread {
+    int64_t name;
+    int64_t intervalNumber;
+    stPinchInterval **intervals; //In order of start
+    int64_t *starts; //The starts of the intervals in Eytzinger order, from index 1
+    int64_t *ranks; //The position in intervals of each of starts
+} stPinchIntervalIndexThread;
+
+struct _stPinchIntervalIndex {
+    stPinchIntervalIndexThread *threads; //In order of name
+    int64_t threadNumber;
+};
+
+/*
+ * Fills in the subtree rooted at k of the Eytzinger layout with the intervals from i onwards,
+ * returning the index of the first interval not placed.
+ */
+static int64_t fillEytzinger(stPinchIntervalIndexThread *thread, int64_t i, int64_t k) {
+    if (k <= thread->intervalNumber) {
+        i = fillEytzinger(thread, i, 2 * k);
+        thread->starts[k] = thread->intervals[i]->start;
+        thread->ranks[k] = i++;
+        i = fillEytzinger(thread, i, 2 * k + 1);
+    }
+    return i;
+}
+
+stPinchIntervalIndex *stPinchIntervalIndex_construct(stSortedSet *pinchIntervals) {
+    stPinchIntervalIndex *index = st_malloc(sizeof(stPinchIntervalIndex));
+    stList *intervals = stSortedSet_getList(pinchIntervals);
+
+    //Count the threads, the intervals being sorted by name and then start
+    index->threadNumber = 0;
+    for (int64_t i = 0; i < stList_length(intervals); i++) {
+        if (i == 0 || ((stPinchInterval *) stList_get(intervals, i))->name != ((stPinchInterval *) stList_get(intervals, i - 1))->name) {
+            index->threadNumber++;
+        }
+    }
+    index->threads = st_malloc(index->threadNumber * sizeof(stPinchIntervalIndexThread));
+
+    int64_t i = 0;
+    for (int64_t j = 0; j < index->threadNumber; j++) {
+        stPinchIntervalIndexThread *thread = &index->threads[j];
+        thread->name = ((stPinchInterval *) stList_get(intervals, i))->name;
+        thread->intervalNumber = 0;
+        while (i + thread->intervalNumber < stList_length(intervals)
+                && ((stPinchInterval *) stList_get(intervals, i + thread->intervalNumber))->name == thread->name) {
+            thread->intervalNumber++;
+        }
+        thread->intervals = st_malloc(thread->intervalNumber * sizeof(stPinchInterval *));
+        for (int64_t k = 0; k < thread->intervalNumber; k++) {
+            thread->intervals[k] = stList_get(intervals, i + k);
+            assert(k == 0 || thread->intervals[k - 1]->start + thread->intervals[k - 1]->length <= thread->intervals[k]->start);
+        }
+        thread->starts = st_malloc((thread->intervalNumber + 1) * sizeof(int64_t));
+        thread->ranks = st_malloc((thread->intervalNumber + 1) * sizeof(int64_t));
+        fillEytzinger(thread, 0, 1);
+        i += thread->intervalNumber;
+    }
+    stList_destruct(intervals);
+    return index;
+}
+
+void stPinchIntervalIndex_destruct(stPinchIntervalIndex *index) {
+    for (int64_t i = 0; i < index->threadNumber; i++) {
+        free(index->threads[i].intervals);
+        free(index->threads[i].starts);
+        free(index->threads[i].ranks);
+    }
+    free(index->threads);
+    free(index);
+}
+
+static stPinchIntervalIndexThread *getThread(stPinchIntervalIndex *index, int64_t name) {
+    int64_t i = 0, j = index->threadNumber;
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        if (index->threads[k].name < name) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i < index->threadNumber && index->threads[i].name == name ? &index->threads[i] : NULL;
+}
+
+/*
+ * Returns the position in the thread's intervals of the last interval starting at or before
+ * the position, or -1 if there is none.
+ */
+static int64_t searchLessThanOrEqual(stPinchIntervalIndexThread *thread, int64_t position) {
+    //Descend to the first start greater than the position, then undo the right turns made after it
+    uint64_t k = 1;
+    while (k <= (uint64_t) thread->intervalNumber) {
+        k = 2 * k + (thread->starts[k] <= position);
+    }
+    k >>= __builtin_ffsll(~k);
+    return k == 0 ? thread->intervalNumber - 1 : thread->ranks[k] - 1;
+}
+
+static stPinchInterval *getIntervalIfContains(stPinchIntervalIndexThread *thread, int64_t i, int64_t position) {
+    if (i < 0 || thread->intervals[i]->start + thread->intervals[i]->length <= position) {
+        return NULL;
+    }
+    return thread->intervals[i];
+}
+
+stPinchInterval *stPinchIntervalIndex_getInterval(stPinchIntervalIndex *index, int64_t name, int64_t position) {
+    stPinchIntervalIndexThread *thread = getThread(index, name);
+    if (thread == NULL) {
+        return NULL;
+    }
+    return getIntervalIfContains(thread, searchLessThanOrEqual(thread, position), position);
+}
+
+void stPinchIntervalIndex_getIntervals(stPinchIntervalIndex *index, int64_t name, const int64_t *positions, int64_t positionNumber,
+        stPinchInterval **intervals) {
+    stPinchIntervalIndexThread *thread = getThread(index, name);
+    if (thread == NULL) {
+        memset(intervals, 0, positionNumber * sizeof(stPinchInterval *));
+        return;
+    }
+    //Searching costs about log2 of the interval number per position, merging one step per interval
+    int64_t searchCost = 1;
+    while ((1LL << searchCost) < thread->intervalNumber) {
+        searchCost++;
+    }
+    if (positionNumber * searchCost < thread->intervalNumber) {
+        for (int64_t i = 0; i < positionNumber; i++) {
+            intervals[i] = getIntervalIfContains(thread, searchLessThanOrEqual(thread, positions[i]), positions[i]);
+        }
+        return;
+    }
+    int64_t j = -1; //The last interval starting at or before the current position
+    for (int64_t i = 0; i < positionNumber; i++) {
+        assert(i == 0 || positions[i - 1] <= positions[i]);
+        while (j + 1 < thread->intervalNumber && thread->intervals[j + 1]->start <= positions[i]) {
+            j++;
+        }
+        intervals[i] = getIntervalIfContains(thread, j, positions[i]);
+    }
+}
@@ -0,0 +1,402 @@
+/*
+ * stPinchPaf.c
+ *
+ *  Streaming ingestion of PAF alignments into a pinch graph.
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+// For pthreads and getline.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "sonLib.h"
+#include "stPinchGraphs.h"
+#include "stPinchPaf.h"
+
+#define ST_PINCH_PAF_LINES_PER_BATCH 1024
+#define ST_PINCH_PAF_QUEUE_LENGTH 4 // Batches buffered between each pair of stages
+
+//Bounded queue of batches passed between the stages of the pipeline
+
+typedef struct _stPinchPafQueue {
+    void *batches[ST_PINCH_PAF_QUEUE_LENGTH];
+    int64_t first;
+    int64_t length;
+    bool closed; // Set by the producer once it has pushed its last batch
+    pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} stPinchPafQueue;
+
+static void stPinchPafQueue_init(stPinchPafQueue *queue) {
+    queue->first = 0;
+    queue->length = 0;
+    queue->closed = 0;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->notEmpty, NULL);
+    pthread_cond_init(&queue->notFull, NULL);
+}
+
+static void stPinchPafQueue_destroy(stPinchPafQueue *queue) {
+    assert(queue->length == 0);
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->notEmpty);
+    pthread_cond_destroy(&queue->notFull);
+}
+
+static void stPinchPafQueue_push(stPinchPafQueue *queue, void *batch) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->length == ST_PINCH_PAF_QUEUE_LENGTH) {
+        pthread_cond_wait(&queue->notFull, &queue->mutex);
+    }
+    queue->batches[(queue->first + queue->length++) % ST_PINCH_PAF_QUEUE_LENGTH] = batch;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void stPinchPafQueue_close(stPinchPafQueue *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = 1;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+/*
+ * Returns the next batch, or NULL once the queue is closed and empty.
+ */
+static void *stPinchPafQueue_pop(stPinchPafQueue *queue) {
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->length == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->notEmpty, &queue->mutex);
+    }
+    void *batch = NULL;
+    if (queue->length > 0) {
+        batch = queue->batches[queue->first];
+        queue->first = (queue->first + 1) % ST_PINCH_PAF_QUEUE_LENGTH;
+        queue->length--;
+        pthread_cond_signal(&queue->notFull);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return batch;
+}
+
+//Batches
+
+typedef struct _stPinchPafLineBatch {
+    char *lines[ST_PINCH_PAF_LINES_PER_BATCH];
+    int64_t lineNumber;
+    int64_t firstLine; // Line number in the file of lines[0], from 1, for error messages
+} stPinchPafLineBatch;
+
+typedef struct _stPinchPafPinchBatch {
+    stPinch *pinches;
+    int64_t pinchNumber;
+    int64_t maxPinchNumber;
+} stPinchPafPinchBatch;
+
+static void stPinchPafPinchBatch_add(stPinchPafPinchBatch *batch, stPinch pinch) {
+    if (batch->pinchNumber == batch->maxPinchNumber) {
+        batch->maxPinchNumber = batch->maxPinchNumber * 2 + 16;
+        batch->pinches = st_realloc(batch->pinches, batch->maxPinchNumber * sizeof(stPinch));
+    }
+    batch->pinches[batch->pinchNumber++] = pinch;
+}
+
+static void stPinchPafPinchBatch_destruct(stPinchPafPinchBatch *batch) {
+    free(batch->pinches);
+    free(batch);
+}
+
+//Parsing
+
+typedef struct _stPinchPafPipeline {
+    stPinchThreadSet *threadSet;
+    FILE *fileHandle;
+    stHash *sequenceNamesToThreads;
+    stPinchPafQueue lineQueue; // Reader to generator
+    stPinchPafQueue pinchQueue; // Generator to applier
+    int64_t records; // Counted by the generator
+} stPinchPafPipeline;
+
+static void pafAbort(int64_t lineNumber, const char *message) {
+    st_errAbort("Line %" PRIi64 " of the PAF file is not a valid record: %s", lineNumber, message);
+}
+
+static stPinchThread *getPafThread(stPinchPafPipeline *pipeline, const char *sequenceName, int64_t lineNumber) {
+    stPinchThread *thread;
+    if (pipeline->sequenceNamesToThreads != NULL) {
+        thread = stHash_search(pipeline->sequenceNamesToThreads, (void *) sequenceName);
+    } else {
+        char *end;
+        errno = 0;
+        int64_t name = strtoll(sequenceName, &end, 10);
+        thread = (errno != 0 || *end != '\0' || end == sequenceName) ? NULL :
+                stPinchThreadSet_getThread(pipeline->threadSet, name);
+    }
+    if (thread == NULL) {
+        pafAbort(lineNumber, "sequence is not a thread of the pinch graph");
+    }
+    return thread;
+}
+
+static int64_t parsePafInt(const char *field, int64_t lineNumber) {
+    char *end;
+    errno = 0;
+    int64_t i = strtoll(field, &end, 10);
+    if (errno != 0 || *end != '\0' || end == field || i < 0) {
+        pafAbort(lineNumber, "expected a non-negative integer");
+    }
+    return i;
+}
+
+/*
+ * Parses a PAF line, which is modified, adding the pinches of its match runs to the batch.
+ */
+static void parsePafRecord(stPinchPafPipeline *pipeline, char *line, int64_t lineNumber, stPinchPafPinchBatch *batch) {
+    char *fields[12];
+    char *cigar = NULL;
+    int64_t fieldNumber = 0;
+    char *saveptr;
+    for (char *field = strtok_r(line, "\t\n\r", &saveptr); field != NULL; field = strtok_r(NULL, "\t\n\r", &saveptr)) {
+        if (fieldNumber < 12) {
+            fields[fieldNumber++] = field;
+        } else if (strncmp(field, "cg:Z:", 5) == 0) {
+            cigar = field + 5;
+        }
+    }
+    if (fieldNumber < 12) {
+        pafAbort(lineNumber, "fewer than 12 fields");
+    }
+    if (cigar == NULL) {
+        pafAbort(lineNumber, "no cg:Z CIGAR");
+    }
+    stPinchThread *queryThread = getPafThread(pipeline, fields[0], lineNumber);
+    int64_t queryStart = parsePafInt(fields[2], lineNumber), queryEnd = parsePafInt(fields[3], lineNumber);
+    if (strcmp(fields[4], "+") != 0 && strcmp(fields[4], "-") != 0) {
+        pafAbort(lineNumber, "strand is not + or -");
+    }
+    bool strand = fields[4][0] == '+';
+    stPinchThread *targetThread = getPafThread(pipeline, fields[5], lineNumber);
+    int64_t targetStart = parsePafInt(fields[7], lineNumber), targetEnd = parsePafInt(fields[8], lineNumber);
+    if (queryStart > queryEnd || queryEnd > stPinchThread_getLength(queryThread) || targetStart > targetEnd
+            || targetEnd > stPinchThread_getLength(targetThread)) {
+        pafAbort(lineNumber, "alignment does not lie within its threads");
+    }
+
+    //Walk the CIGAR, along the target forwards and along the query in the direction of the strand
+    int64_t queryOffset = stPinchThread_getStart(queryThread), targetOffset = stPinchThread_getStart(targetThread);
+    int64_t queryPosition = strand ? queryStart : queryEnd, targetPosition = targetStart;
+    int64_t queryLength = 0, targetLength = 0;
+    char *op = cigar;
+    while (*op != '\0') {
+        char *end;
+        int64_t length = strtoll(op, &end, 10);
+        if (end == op || length <= 0) {
+            pafAbort(lineNumber, "malformed CIGAR");
+        }
+        switch (*end) {
+        case 'M':
+        case '=':
+        case 'X':
+            if (queryLength + length > queryEnd - queryStart || targetLength + length > targetEnd - targetStart) {
+                pafAbort(lineNumber, "CIGAR is longer than the alignment");
+            }
+            if (strand) {
+                stPinchPafPinchBatch_add(batch, stPinch_constructStatic(stPinchThread_getName(queryThread),
+                        stPinchThread_getName(targetThread), queryOffset + queryPosition, targetOffset + targetPosition, length, 1));
+                queryPosition += length;
+            } else {
+                queryPosition -= length;
+                stPinchPafPinchBatch_add(batch, stPinch_constructStatic(stPinchThread_getName(queryThread),
+                        stPinchThread_getName(targetThread), queryOffset + queryPosition, targetOffset + targetPosition, length, 0));
+            }
+            targetPosition += length;
+            queryLength += length;
+            targetLength += length;
+            break;
+        case 'I':
+            queryPosition += strand ? length : -length;
+            queryLength += length;
+            break;
+        case 'D':
+        case 'N':
+            targetPosition += length;
+            targetLength += length;
+            break;
+        default:
+            pafAbort(lineNumber, "unknown CIGAR operation");
+        }
+        op = end + 1;
+    }
+    if (queryLength != queryEnd - queryStart || targetLength != targetEnd - targetStart) {
+        pafAbort(lineNumber, "CIGAR does not match the alignment coordinates");
+    }
+}
+
+//Stages of the pipeline
+
+static void *readPafLines(void *argument) {
+    stPinchPafPipeline *pipeline = argument;
+    int64_t lineNumber = 0;
+    stPinchPafLineBatch *batch = NULL;
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    while (getline(&line, &lineCapacity, pipeline->fileHandle) != -1) {
+        lineNumber++;
+        if (batch == NULL) {
+            batch = st_malloc(sizeof(stPinchPafLineBatch));
+            batch->lineNumber = 0;
+            batch->firstLine = lineNumber;
+        }
+        batch->lines[batch->lineNumber++] = line;
+        line = NULL;
+        lineCapacity = 0;
+        if (batch->lineNumber == ST_PINCH_PAF_LINES_PER_BATCH) {
+            stPinchPafQueue_push(&pipeline->lineQueue, batch);
+            batch = NULL;
+        }
+    }
+    free(line);
+    if (ferror(pipeline->fileHandle)) {
+        st_errAbort("Failed to read the PAF file");
+    }
+    if (batch != NULL) {
+        stPinchPafQueue_push(&pipeline->lineQueue, batch);
+    }
+    stPinchPafQueue_close(&pipeline->lineQueue);
+    return NULL;
+}
+
+static void *generatePafPinches(void *argument) {
+    stPinchPafPipeline *pipeline = argument;
+    stPinchPafLineBatch *lineBatch;
+    while ((lineBatch = stPinchPafQueue_pop(&pipeline->lineQueue)) != NULL) {
+        stPinchPafPinchBatch *pinchBatch = st_calloc(1, sizeof(stPinchPafPinchBatch));
+        for (int64_t i = 0; i < lineBatch->lineNumber; i++) {
+            char *line = lineBatch->lines[i];
+            if (line[strspn(line, " \t\n\r")] != '\0') { //Skip blank lines
+                parsePafRecord(pipeline, line, lineBatch->firstLine + i, pinchBatch);
+                pipeline->records++;
+            }
+            free(line);
+        }
+        free(lineBatch);
+        stPinchPafQueue_push(&pipeline->pinchQueue, pinchBatch);
+    }
+    stPinchPafQueue_close(&pipeline->pinchQueue);
+    return NULL;
+}
+
+stPinchPafStats stPinchThreadSet_pinchPaf(stPinchThreadSet *threadSet, FILE *fileHandle, stHash *sequenceNamesToThreads) {
+    stPinchPafPipeline pipeline;
+    pipeline.threadSet = threadSet;
+    pipeline.fileHandle = fileHandle;
+    pipeline.sequenceNamesToThreads = sequenceNamesToThreads;
+    pipeline.records = 0;
+    stPinchPafQueue_init(&pipeline.lineQueue);
+    stPinchPafQueue_init(&pipeline.pinchQueue);
+    pthread_t reader, generator;
+    if (pthread_create(&reader, NULL, readPafLines, &pipeline) != 0
+            || pthread_create(&generator, NULL, generatePafPinches, &pipeline) != 0) {
+        st_errAbort("Failed to create a thread to read the PAF file");
+    }
+
+    //The calling thread applies the pinches, in the order they were read
+    stPinchPafStats stats = { 0, 0, 0 };
+    stPinchPafPinchBatch *pinchBatch;
+    while ((pinchBatch = stPinchPafQueue_pop(&pipeline.pinchQueue)) != NULL) {
+        for (int64_t i = 0; i < pinchBatch->pinchNumber; i++) {
+            stats.alignedBases += pinchBatch->pinches[i].length;
+        }
+        stats.pinches += pinchBatch->pinchNumber;
+        stPinchThreadSet_pinchBatch(threadSet, pinchBatch->pinches, pinchBatch->pinchNumber);
+        stPinchPafPinchBatch_destruct(pinchBatch);
+    }
+    pthread_join(reader, NULL);
+    pthread_join(generator, NULL);
+    stats.records = pipeline.records;
+    stPinchPafQueue_destroy(&pipeline.lineQueue);
+    stPinchPafQueue_destroy(&pipeline.pinchQueue);
+    return stats;
+}
+
+//Random records, for testing
+
+static void writeRandomPafRecord(stList *threads, FILE *fileHandle, stList *pinches) {
+    stPinchThread *queryThread = stList_get(threads, st_randomInt(0, stList_length(threads)));
+    stPinchThread *targetThread = stList_get(threads, st_randomInt(0, stList_length(threads)));
+    int64_t queryLength = stPinchThread_getLength(queryThread), targetLength = stPinchThread_getLength(targetThread);
+    int64_t queryStart = st_randomInt(0, queryLength), targetStart = st_randomInt(0, targetLength);
+    bool strand = st_random() > 0.5;
+
+    //Choose the operations first, as the query coordinates of the pinches on the negative strand depend on the query end
+    int64_t opNumber = st_randomInt(1, 10);
+    int64_t *opLengths = st_malloc(opNumber * sizeof(int64_t));
+    char *ops = st_malloc(opNumber * sizeof(char));
+    int64_t queryEnd = queryStart, targetEnd = targetStart, matches = 0, alignmentLength = 0;
+    for (int64_t i = 0; i < opNumber; i++) {
+        ops[i] = i == 0 ? 'M' : "M=XID"[st_randomInt(0, 5)];
+        bool consumesQuery = ops[i] != 'D', consumesTarget = ops[i] != 'I';
+        int64_t maxLength = 5;
+        if (consumesQuery && queryLength - queryEnd < maxLength) {
+            maxLength = queryLength - queryEnd;
+        }
+        if (consumesTarget && targetLength - targetEnd < maxLength) {
+            maxLength = targetLength - targetEnd;
+        }
+        if (maxLength == 0) {
+            opNumber = i;
+            break;
+        }
+        opLengths[i] = st_randomInt(1, maxLength + 1);
+        queryEnd += consumesQuery ? opLengths[i] : 0;
+        targetEnd += consumesTarget ? opLengths[i] : 0;
+        matches += ops[i] == 'M' || ops[i] == '=' ? opLengths[i] : 0;
+        alignmentLength += opLengths[i];
+    }
+
+    fprintf(fileHandle, "%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%c\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%"
+            PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t255\ttp:A:P\tcg:Z:", stPinchThread_getName(queryThread), queryLength, queryStart,
+            queryEnd, strand ? '+' : '-', stPinchThread_getName(targetThread), targetLength, targetStart, targetEnd, matches,
+            alignmentLength);
+    int64_t queryPosition = strand ? queryStart : queryEnd, targetPosition = targetStart;
+    for (int64_t i = 0; i < opNumber; i++) {
+        fprintf(fileHandle, "%" PRIi64 "%c", opLengths[i], ops[i]);
+        if (ops[i] == 'I') {
+            queryPosition += strand ? opLengths[i] : -opLengths[i];
+        } else if (ops[i] == 'D') {
+            targetPosition += opLengths[i];
+        } else {
+            queryPosition -= strand ? 0 : opLengths[i];
+            stList_append(pinches, stPinch_construct(stPinchThread_getName(queryThread), stPinchThread_getName(targetThread),
+                    stPinchThread_getStart(queryThread) + queryPosition, stPinchThread_getStart(targetThread) + targetPosition,
+                    opLengths[i], strand));
+            queryPosition += strand ? opLengths[i] : 0;
+            targetPosition += opLengths[i];
+        }
+    }
+    fprintf(fileHandle, "\n");
+    free(opLengths);
+    free(ops);
+}
+
+stList *stPinchPaf_writeRandomRecords(stPinchThreadSet *threadSet, FILE *fileHandle, int64_t recordNumber) {
+    stList *threads = stList_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        if (stPinchThread_getLength(thread) > 0) {
+            stList_append(threads, thread);
+        }
+    }
+    stList *pinches = stList_construct3(0, (void (*)(void *)) stPinch_destruct);
+    for (int64_t i = 0; i < recordNumber && stList_length(threads) > 0; i++) {
+        writeRandomPafRecord(threads, fileHandle, pinches);
+    }
+    stList_destruct(threads);
+    return pinches;
+}
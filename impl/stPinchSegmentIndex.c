@@ -0,0 +1,366 @@
+/*
+ * stPinchSegmentIndex.c
+ *
+ *  B+-tree mapping segment starts to segments.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sonLib.h"
+#include "stPinchSegmentIndex.h"
+
+#define ST_PINCH_SEGMENT_INDEX_MAX_KEYS 32
+#define ST_PINCH_SEGMENT_INDEX_MIN_KEYS (ST_PINCH_SEGMENT_INDEX_MAX_KEYS / 2)
+
+typedef struct _stPinchSegmentIndexNode stPinchSegmentIndexNode;
+
+/*
+ * An internal node with n keys has n + 1 children, where every key in child i is
+ * less than keys[i] and every key in child i + 1 is greater than or equal to keys[i].
+ * Leaves are doubly linked in key order.
+ */
+struct _stPinchSegmentIndexNode {
+    int64_t numKeys;
+    bool isLeaf;
+    stPinchSegmentIndexNode *pLeaf;
+    stPinchSegmentIndexNode *nLeaf;
+    int64_t keys[ST_PINCH_SEGMENT_INDEX_MAX_KEYS + 1]; //One spare slot, so a node can overflow before it is split
+    void *pointers[ST_PINCH_SEGMENT_INDEX_MAX_KEYS + 2]; //The values of a leaf or the children of an internal node
+};
+
+struct _stPinchSegmentIndex {
+    stPinchSegmentIndexNode *root;
+    int64_t size;
+};
+
+static stPinchSegmentIndexNode *stPinchSegmentIndexNode_construct(bool isLeaf) {
+    stPinchSegmentIndexNode *node = st_malloc(sizeof(stPinchSegmentIndexNode));
+    node->numKeys = 0;
+    node->isLeaf = isLeaf;
+    node->pLeaf = NULL;
+    node->nLeaf = NULL;
+    return node;
+}
+
+static void stPinchSegmentIndexNode_destruct(stPinchSegmentIndexNode *node) {
+    if (!node->isLeaf) {
+        for (int64_t i = 0; i <= node->numKeys; i++) {
+            stPinchSegmentIndexNode_destruct(node->pointers[i]);
+        }
+    }
+    free(node);
+}
+
+/*
+ * Returns the number of keys in the node less than or equal to the given key.
+ */
+static inline int64_t upperBound(const stPinchSegmentIndexNode *node, int64_t key) {
+    int64_t i = 0, j = node->numKeys;
+    while (i < j) {
+        int64_t k = (i + j) / 2;
+        if (node->keys[k] <= key) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i;
+}
+
+static stPinchSegmentIndexNode *getLeaf(stPinchSegmentIndex *index, int64_t key) {
+    stPinchSegmentIndexNode *node = index->root;
+    while (!node->isLeaf) {
+        node = node->pointers[upperBound(node, key)];
+    }
+    return node;
+}
+
+stPinchSegmentIndex *stPinchSegmentIndex_construct() {
+    stPinchSegmentIndex *index = st_malloc(sizeof(stPinchSegmentIndex));
+    index->root = stPinchSegmentIndexNode_construct(1);
+    index->size = 0;
+    return index;
+}
+
+/*
+ * Returns the number of nodes to spread the given number of entries over, aiming for the
+ * target number in each while giving every node at least the minimum, unless there is one node.
+ */
+static int64_t getNodeNumber(int64_t entryNumber, int64_t minEntries, int64_t targetEntries) {
+    int64_t nodeNumber = (entryNumber + targetEntries - 1) / targetEntries;
+    while (nodeNumber > 1 && entryNumber / nodeNumber < minEntries) {
+        nodeNumber--;
+    }
+    return nodeNumber > 0 ? nodeNumber : 1;
+}
+
+stPinchSegmentIndex *stPinchSegmentIndex_constructFromSorted(const int64_t *keys, void **values, int64_t length) {
+    stPinchSegmentIndex *index = st_malloc(sizeof(stPinchSegmentIndex));
+    index->size = length;
+    //Fill the leaves three quarters full, so that the first inserts don't split them
+    int64_t nodeNumber = getNodeNumber(length, ST_PINCH_SEGMENT_INDEX_MIN_KEYS, ST_PINCH_SEGMENT_INDEX_MAX_KEYS * 3 / 4);
+    stPinchSegmentIndexNode **nodes = st_malloc(nodeNumber * sizeof(stPinchSegmentIndexNode *));
+    int64_t *firstKeys = st_malloc(nodeNumber * sizeof(int64_t)); //The smallest key below each node
+    for (int64_t i = 0, j = 0; i < nodeNumber; i++) {
+        stPinchSegmentIndexNode *leaf = stPinchSegmentIndexNode_construct(1);
+        leaf->numKeys = length / nodeNumber + (i < length % nodeNumber);
+        memcpy(leaf->keys, keys + j, leaf->numKeys * sizeof(int64_t));
+        memcpy(leaf->pointers, values + j, leaf->numKeys * sizeof(void *));
+        firstKeys[i] = leaf->numKeys > 0 ? keys[j] : 0;
+        if (i > 0) {
+            leaf->pLeaf = nodes[i - 1];
+            nodes[i - 1]->nLeaf = leaf;
+        }
+        nodes[i] = leaf;
+        j += leaf->numKeys;
+    }
+    //Then build each level of internal nodes on the one below, until a single root is left
+    while (nodeNumber > 1) {
+        int64_t parentNumber = getNodeNumber(nodeNumber, ST_PINCH_SEGMENT_INDEX_MIN_KEYS + 1,
+                ST_PINCH_SEGMENT_INDEX_MAX_KEYS * 3 / 4 + 1);
+        for (int64_t i = 0, j = 0; i < parentNumber; i++) {
+            stPinchSegmentIndexNode *parent = stPinchSegmentIndexNode_construct(0);
+            int64_t childNumber = nodeNumber / parentNumber + (i < nodeNumber % parentNumber);
+            parent->numKeys = childNumber - 1;
+            for (int64_t k = 0; k < childNumber; k++) {
+                parent->pointers[k] = nodes[j + k];
+                if (k > 0) {
+                    parent->keys[k - 1] = firstKeys[j + k];
+                }
+            }
+            firstKeys[i] = firstKeys[j]; //In place, as i <= j
+            nodes[i] = parent;
+            j += childNumber;
+        }
+        nodeNumber = parentNumber;
+    }
+    index->root = nodes[0];
+    free(nodes);
+    free(firstKeys);
+    return index;
+}
+
+void stPinchSegmentIndex_destruct(stPinchSegmentIndex *index) {
+    stPinchSegmentIndexNode_destruct(index->root);
+    free(index);
+}
+
+int64_t stPinchSegmentIndex_size(stPinchSegmentIndex *index) {
+    return index->size;
+}
+
+void *stPinchSegmentIndex_search(stPinchSegmentIndex *index, int64_t key) {
+    stPinchSegmentIndexNode *leaf = getLeaf(index, key);
+    int64_t i = upperBound(leaf, key);
+    return i > 0 && leaf->keys[i - 1] == key ? leaf->pointers[i - 1] : NULL;
+}
+
+void *stPinchSegmentIndex_searchLessThanOrEqual(stPinchSegmentIndex *index, int64_t key) {
+    stPinchSegmentIndexNode *leaf = getLeaf(index, key);
+    int64_t i = upperBound(leaf, key);
+    if (i > 0) {
+        return leaf->pointers[i - 1];
+    }
+    //Separators are not updated when the first key of a leaf is removed, so the
+    //answer may be the last key of the previous leaf
+    leaf = leaf->pLeaf;
+    return leaf != NULL ? leaf->pointers[leaf->numKeys - 1] : NULL;
+}
+
+void *stPinchSegmentIndex_getFirst(stPinchSegmentIndex *index) {
+    stPinchSegmentIndexNode *node = index->root;
+    while (!node->isLeaf) {
+        node = node->pointers[0];
+    }
+    return node->numKeys > 0 ? node->pointers[0] : NULL;
+}
+
+void *stPinchSegmentIndex_getLast(stPinchSegmentIndex *index) {
+    stPinchSegmentIndexNode *node = index->root;
+    while (!node->isLeaf) {
+        node = node->pointers[node->numKeys];
+    }
+    return node->numKeys > 0 ? node->pointers[node->numKeys - 1] : NULL;
+}
+
+//Insertion
+
+/*
+ * Splits an overflowing node in two, returning the new right hand node and setting
+ * splitKey to the key separating the two.
+ */
+static stPinchSegmentIndexNode *splitNode(stPinchSegmentIndexNode *node, int64_t *splitKey) {
+    stPinchSegmentIndexNode *right = stPinchSegmentIndexNode_construct(node->isLeaf);
+    int64_t leftKeys = node->numKeys / 2;
+    if (node->isLeaf) {
+        right->numKeys = node->numKeys - leftKeys;
+        memcpy(right->keys, node->keys + leftKeys, right->numKeys * sizeof(int64_t));
+        memcpy(right->pointers, node->pointers + leftKeys, right->numKeys * sizeof(void *));
+        *splitKey = right->keys[0];
+        right->pLeaf = node;
+        right->nLeaf = node->nLeaf;
+        if (node->nLeaf != NULL) {
+            node->nLeaf->pLeaf = right;
+        }
+        node->nLeaf = right;
+    } else {
+        //The middle key moves up to the parent
+        right->numKeys = node->numKeys - leftKeys - 1;
+        memcpy(right->keys, node->keys + leftKeys + 1, right->numKeys * sizeof(int64_t));
+        memcpy(right->pointers, node->pointers + leftKeys + 1, (right->numKeys + 1) * sizeof(void *));
+        *splitKey = node->keys[leftKeys];
+    }
+    node->numKeys = leftKeys;
+    return right;
+}
+
+static stPinchSegmentIndexNode *insertP(stPinchSegmentIndexNode *node, int64_t key, void *value, int64_t *splitKey) {
+    int64_t i = upperBound(node, key);
+    if (node->isLeaf) {
+        assert(i == 0 || node->keys[i - 1] != key);
+        memmove(node->keys + i + 1, node->keys + i, (node->numKeys - i) * sizeof(int64_t));
+        memmove(node->pointers + i + 1, node->pointers + i, (node->numKeys - i) * sizeof(void *));
+        node->keys[i] = key;
+        node->pointers[i] = value;
+    } else {
+        int64_t childSplitKey;
+        stPinchSegmentIndexNode *right = insertP(node->pointers[i], key, value, &childSplitKey);
+        if (right == NULL) {
+            return NULL;
+        }
+        memmove(node->keys + i + 1, node->keys + i, (node->numKeys - i) * sizeof(int64_t));
+        memmove(node->pointers + i + 2, node->pointers + i + 1, (node->numKeys - i) * sizeof(void *));
+        node->keys[i] = childSplitKey;
+        node->pointers[i + 1] = right;
+    }
+    if (++node->numKeys <= ST_PINCH_SEGMENT_INDEX_MAX_KEYS) {
+        return NULL;
+    }
+    return splitNode(node, splitKey);
+}
+
+void stPinchSegmentIndex_insert(stPinchSegmentIndex *index, int64_t key, void *value) {
+    assert(value != NULL);
+    int64_t splitKey;
+    stPinchSegmentIndexNode *right = insertP(index->root, key, value, &splitKey);
+    if (right != NULL) {
+        stPinchSegmentIndexNode *root = stPinchSegmentIndexNode_construct(0);
+        root->numKeys = 1;
+        root->keys[0] = splitKey;
+        root->pointers[0] = index->root;
+        root->pointers[1] = right;
+        index->root = root;
+    }
+    index->size++;
+}
+
+//Removal
+
+static void borrowFromLeft(stPinchSegmentIndexNode *node, int64_t i) {
+    stPinchSegmentIndexNode *left = node->pointers[i - 1], *child = node->pointers[i];
+    memmove(child->keys + 1, child->keys, child->numKeys * sizeof(int64_t));
+    if (child->isLeaf) {
+        memmove(child->pointers + 1, child->pointers, child->numKeys * sizeof(void *));
+        child->keys[0] = left->keys[left->numKeys - 1];
+        child->pointers[0] = left->pointers[left->numKeys - 1];
+        node->keys[i - 1] = child->keys[0];
+    } else {
+        memmove(child->pointers + 1, child->pointers, (child->numKeys + 1) * sizeof(void *));
+        child->keys[0] = node->keys[i - 1];
+        child->pointers[0] = left->pointers[left->numKeys];
+        node->keys[i - 1] = left->keys[left->numKeys - 1];
+    }
+    left->numKeys--;
+    child->numKeys++;
+}
+
+static void borrowFromRight(stPinchSegmentIndexNode *node, int64_t i) {
+    stPinchSegmentIndexNode *child = node->pointers[i], *right = node->pointers[i + 1];
+    if (child->isLeaf) {
+        child->keys[child->numKeys] = right->keys[0];
+        child->pointers[child->numKeys] = right->pointers[0];
+        memmove(right->keys, right->keys + 1, (right->numKeys - 1) * sizeof(int64_t));
+        memmove(right->pointers, right->pointers + 1, (right->numKeys - 1) * sizeof(void *));
+        node->keys[i] = right->keys[0];
+    } else {
+        child->keys[child->numKeys] = node->keys[i];
+        child->pointers[child->numKeys + 1] = right->pointers[0];
+        node->keys[i] = right->keys[0];
+        memmove(right->keys, right->keys + 1, (right->numKeys - 1) * sizeof(int64_t));
+        memmove(right->pointers, right->pointers + 1, right->numKeys * sizeof(void *));
+    }
+    right->numKeys--;
+    child->numKeys++;
+}
+
+/*
+ * Merges child i + 1 of the node into child i.
+ */
+static void mergeChildren(stPinchSegmentIndexNode *node, int64_t i) {
+    stPinchSegmentIndexNode *left = node->pointers[i], *right = node->pointers[i + 1];
+    if (left->isLeaf) {
+        memcpy(left->keys + left->numKeys, right->keys, right->numKeys * sizeof(int64_t));
+        memcpy(left->pointers + left->numKeys, right->pointers, right->numKeys * sizeof(void *));
+        left->numKeys += right->numKeys;
+        left->nLeaf = right->nLeaf;
+        if (right->nLeaf != NULL) {
+            right->nLeaf->pLeaf = left;
+        }
+    } else {
+        left->keys[left->numKeys] = node->keys[i];
+        memcpy(left->keys + left->numKeys + 1, right->keys, right->numKeys * sizeof(int64_t));
+        memcpy(left->pointers + left->numKeys + 1, right->pointers, (right->numKeys + 1) * sizeof(void *));
+        left->numKeys += right->numKeys + 1;
+    }
+    assert(left->numKeys <= ST_PINCH_SEGMENT_INDEX_MAX_KEYS);
+    free(right);
+    memmove(node->keys + i, node->keys + i + 1, (node->numKeys - i - 1) * sizeof(int64_t));
+    memmove(node->pointers + i + 1, node->pointers + i + 2, (node->numKeys - i - 1) * sizeof(void *));
+    node->numKeys--;
+}
+
+static void rebalance(stPinchSegmentIndexNode *node, int64_t i) {
+    if (i > 0 && ((stPinchSegmentIndexNode *) node->pointers[i - 1])->numKeys > ST_PINCH_SEGMENT_INDEX_MIN_KEYS) {
+        borrowFromLeft(node, i);
+    } else if (i < node->numKeys
+            && ((stPinchSegmentIndexNode *) node->pointers[i + 1])->numKeys > ST_PINCH_SEGMENT_INDEX_MIN_KEYS) {
+        borrowFromRight(node, i);
+    } else if (i > 0) {
+        mergeChildren(node, i - 1);
+    } else {
+        mergeChildren(node, i);
+    }
+}
+
+static void *removeP(stPinchSegmentIndexNode *node, int64_t key) {
+    int64_t i = upperBound(node, key);
+    if (node->isLeaf) {
+        if (i == 0 || node->keys[i - 1] != key) {
+            return NULL;
+        }
+        void *value = node->pointers[i - 1];
+        memmove(node->keys + i - 1, node->keys + i, (node->numKeys - i) * sizeof(int64_t));
+        memmove(node->pointers + i - 1, node->pointers + i, (node->numKeys - i) * sizeof(void *));
+        node->numKeys--;
+        return value;
+    }
+    stPinchSegmentIndexNode *child = node->pointers[i];
+    void *value = removeP(child, key);
+    if (value != NULL && child->numKeys < ST_PINCH_SEGMENT_INDEX_MIN_KEYS) {
+        rebalance(node, i);
+    }
+    return value;
+}
+
+void *stPinchSegmentIndex_remove(stPinchSegmentIndex *index, int64_t key) {
+    void *value = removeP(index->root, key);
+    if (value != NULL) {
+        index->size--;
+        if (!index->root->isLeaf && index->root->numKeys == 0) {
+            stPinchSegmentIndexNode *root = index->root;
+            index->root = root->pointers[0];
+            free(root);
+        }
+    }
+    return value;
+}
@@ -46,11 +46,16 @@ typedef struct _stPinchThreadSetSegmentIt {
 } stPinchThreadSetSegmentIt;
 
 typedef struct _stPinchThreadSetBlockIt {
-    stPinchThreadSetSegmentIt segmentIt;
+    stPinchThreadSet *threadSet;
+    int64_t slot;
 } stPinchThreadSetBlockIt;
 
 typedef struct _stPinchBlock stPinchBlock;
 
+typedef struct _stPinchThreadSetModifiedBlockIt {
+    stPinchBlock *block;
+} stPinchThreadSetModifiedBlockIt;
+
 typedef struct _stPinchBlockIt {
     stPinchSegment *segment;
 } stPinchBlockIt;
@@ -69,6 +74,22 @@ typedef struct _stPinch {
     bool strand;
 } stPinch;
 
+typedef struct _stPinchBatchStats {
+    int64_t splits; //Number of times a segment was split in two
+    int64_t merges; //Number of times two distinct blocks were merged
+} stPinchBatchStats;
+
+typedef struct _stPinchTrimStats {
+    int64_t destroyed; //Number of blocks too short to trim, which were destructed
+    int64_t shortened; //Number of blocks trimmed at both ends
+} stPinchTrimStats;
+
+typedef enum _stPinchFilter {
+    ST_PINCH_FILTER_SAME_BLOCK = 1, //The two segments are already aligned, being in the same block or the same segment
+    ST_PINCH_FILTER_BLOCK_MERGE = 2, //The two segments are in two distinct blocks
+    ST_PINCH_FILTER_MAX_DEGREE = 4 //The pinch would make a block of degree greater than the given maximum
+} stPinchFilter;
+
 typedef struct _stPinchInterval {
     int64_t name;
     int64_t start;
@@ -76,6 +97,17 @@ typedef struct _stPinchInterval {
     void *label;
 } stPinchInterval;
 
+typedef struct _stPinchLabelIntervals stPinchLabelIntervals;
+
+typedef struct _stPinchEndAdjacency {
+    stPinchEnd end;
+    int64_t multiplicity; //Number of segments of the queried end from which its adjacency leads to this end
+} stPinchEndAdjacency;
+
+typedef struct _stPinchEndAdjacencies stPinchEndAdjacencies;
+
+typedef struct _stPinchSortedBlockSegments stPinchSortedBlockSegments;
+
 typedef struct _stPinchUndo stPinchUndo;
 
 /*
@@ -89,11 +121,48 @@ typedef struct _stPinchUndo stPinchUndo;
  */
 stPinchThreadSet *stPinchThreadSet_construct(void);
 
+/*
+ * Construct an empty pinch graph. If useSlabAllocation is non-zero the segments
+ * and blocks of the graph are allocated from slabs owned by the graph, rather than
+ * individually from the heap. Freed segments and blocks are then recycled and all
+ * memory is released in bulk by stPinchThreadSet_destruct, which makes building and
+ * destroying graphs with very many pinches considerably cheaper.
+ *
+ * If the library is compiled with ST_PINCH_COMPACT_HANDLES defined, segments and blocks
+ * link to each other by 32-bit handles instead of pointers, shrinking a segment from 56
+ * to 32 bytes and a block from 56 to 40. Slab allocation is then always used, and a
+ * block's degree is limited to 2^32 - 1; pinching past that aborts.
+ *
+ * If the library is compiled with ST_PINCH_DOUBLY_LINKED_BLOCKS defined, each segment
+ * also links to the segment before it in its block, so that stPinchSegment_putSegmentFirstInBlock
+ * takes constant rather than linear time in the degree of the block. This grows a segment
+ * from 56 to 64 bytes, or from 32 to 40 with ST_PINCH_COMPACT_HANDLES.
+ */
+stPinchThreadSet *stPinchThreadSet_construct2(bool useSlabAllocation);
+
 /*
  * Destroy a pinch graph.
  */
 void stPinchThreadSet_destruct(stPinchThreadSet *threadSet);
 
+/*
+ * Writes a snapshot of the pinch graph to the given file: its threads, segment boundaries,
+ * block membership and orientation, and the support and flags of each block. The format is
+ * flat and versioned, and is in the native byte order.
+ */
+void stPinchThreadSet_writeBinary(stPinchThreadSet *threadSet, const char *fileName);
+
+/*
+ * Reads a pinch graph written by stPinchThreadSet_writeBinary. The file is mapped into
+ * memory and the graph rebuilt from its records: the segments and blocks are allocated
+ * afresh and linked, and each thread's segment index is built bottom up from its sorted
+ * segments, in time linear in the size of the graph plus a binary search per block segment.
+ * No pinches are replayed, but nothing in the file is used in place. The graph uses slab
+ * allocation, and iterates its threads, segments and blocks in the same order as the graph
+ * that was written. Aborts if the file is not a valid snapshot.
+ */
+stPinchThreadSet *stPinchThreadSet_readBinary(const char *fileName);
+
 /*
  * Add a thread to a pinch graph. The "name" must be an int unique
  * among the threads in this graph.
@@ -104,10 +173,63 @@ void stPinchThreadSet_destruct(stPinchThreadSet *threadSet);
 stPinchThread *stPinchThreadSet_addThread(stPinchThreadSet *threadSet, int64_t name, int64_t start, int64_t length);
 
 /*
- * Gets a thread from a pinch graph.
+ * Gets a thread from a pinch graph, or NULL if there is no thread with the name. Lookups are
+ * fastest when the names of the threads are close to contiguous, as then they index a table
+ * directly; otherwise they are hashed.
  */
 stPinchThread *stPinchThreadSet_getThread(stPinchThreadSet *threadSet, int64_t name);
 
+/*
+ * Applies each of the pinches to the graph, as stPinchThread_pinch would. The pinches
+ * are sorted in place by first thread and coordinate, so that each segment lookup can
+ * start from the segment used by the previous pinch rather than searching the thread.
+ * The resulting alignment is the same as applying the pinches one by one, in any order.
+ *
+ * Returns the number of segment splits and block merges the batch made.
+ */
+stPinchBatchStats stPinchThreadSet_pinchBatch(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber);
+
+/*
+ * As stPinchThreadSet_pinchBatch, but using up to threadNumber threads. The threads of
+ * the graph are partitioned into groups that are connected neither by existing blocks
+ * nor by any of the pinches, and the pinches of each group are applied independently.
+ * The resulting graph has the same segments and blocks as that made by
+ * stPinchThreadSet_pinchBatch, but the blocks may be numbered (see stPinchBlock_getIndex)
+ * in a different order, and the order of the modified blocks (see
+ * stPinchThreadSet_getModifiedBlockIt) depends on the scheduling of the threads.
+ * The groups are found with stPinchThreadSet_getThreadComponentIndices.
+ *
+ * The pinches array is reordered, so that the pinches of each group are contiguous
+ * and sorted.
+ */
+stPinchBatchStats stPinchThreadSet_pinchBatchParallel(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber,
+        int64_t threadNumber);
+
+/*
+ * Applies stPinchBlock_trim with the given trim to every block of the graph, using up to
+ * threadNumber threads. The blocks are grouped by the components of threads they connect
+ * (see stPinchThreadSet_getThreadComponentIndices), and the groups are trimmed concurrently.
+ * The blocks made by trimming are not themselves trimmed. As with
+ * stPinchThreadSet_pinchBatchParallel, the surviving blocks are renumbered (see
+ * stPinchBlock_getIndex), so indices taken before the trim must not be used after it.
+ *
+ * Returns the number of blocks destroyed and shortened.
+ */
+stPinchTrimStats stPinchThreadSet_trimAllBlocks(stPinchThreadSet *threadSet, int64_t trim, int64_t threadNumber);
+
+/*
+ * Evaluates a batch of pinches against the graph as it stands, without changing it, by
+ * walking the pairs of segments each pinch overlaps, as stPinchThread_filterPinch does.
+ * A pair of segments is rejected if it matches any of the predicates in the filter, an
+ * or of stPinchFilter values; maxDegree is only used by ST_PINCH_FILTER_MAX_DEGREE.
+ *
+ * Returns a bit array holding length bits for each pinch, packed in the order of the
+ * pinches, in which bit j of a pinch is set if the pinch may align position start1 + j of
+ * its first thread. The array should be freed with free.
+ */
+uint64_t *stPinchThreadSet_filterPinches(stPinchThreadSet *threadSet, stPinch *pinches, int64_t pinchNumber,
+        int filter, int64_t maxDegree);
+
 /*
  * Gets the segment which includes the specified position in the
  * specified thread. If the position is out of range for the thread,
@@ -143,10 +265,32 @@ stPinchThread *stPinchThreadSetIt_getNext(stPinchThreadSetIt *);
 void stPinchThreadSet_joinTrivialBoundaries(stPinchThreadSet *threadSet);
 
 /*
- * Get the total number of blocks in the graph.
+ * As stPinchThreadSet_joinTrivialBoundaries, but only examines the segment boundaries
+ * created or changed since the previous join, so that joining after each of a series of
+ * small changes to a large graph is cheap.
+ *
+ * The first call joins the whole graph and turns on the recording of changed boundaries,
+ * which then costs a little time and memory per change until the next join. A thread
+ * records at most about two boundaries per segment; past that it stops recording and the
+ * next join examines every boundary of the thread instead.
+ */
+void stPinchThreadSet_joinTrivialBoundariesIncremental(stPinchThreadSet *threadSet);
+
+/*
+ * Get the total number of blocks in the graph, in constant time.
  */
 int64_t stPinchThreadSet_getTotalBlockNumber(stPinchThreadSet *threadSet);
 
+/*
+ * Get an exclusive upper bound on the indices of the blocks in the graph, see stPinchBlock_getIndex.
+ */
+int64_t stPinchThreadSet_getBlockIndexBound(stPinchThreadSet *threadSet);
+
+/*
+ * Get the block with the given index, or NULL if no block has it.
+ */
+stPinchBlock *stPinchThreadSet_getBlockFromIndex(stPinchThreadSet *threadSet, int64_t index);
+
 /*
  * Get a list of adjacency-connected components for this pinch
  * graph. Each connected component is represented by a list of
@@ -162,6 +306,15 @@ stList *stPinchThreadSet_getAdjacencyComponents(stPinchThreadSet *threadSet);
  */
 stList *stPinchThreadSet_getAdjacencyComponents2(stPinchThreadSet *threadSet, stHash **edgeEndsToAdjacencyComponents);
 
+/*
+ * Computes the adjacency components of the graph using up to threadNumber threads, without
+ * constructing any stPinchEnds. Returns an array, to be freed by the caller, of length twice
+ * stPinchThreadSet_getBlockIndexBound that maps the index of each end (see stPinchEnd_getIndex)
+ * to the number of its component, or to -1 if no block has the index. Components are numbered
+ * from 0 in order of their least end index, and their number is written to componentNumber.
+ */
+int64_t *stPinchThreadSet_getAdjacencyComponentIndices(stPinchThreadSet *threadSet, int64_t threadNumber, int64_t *componentNumber);
+
 /*
  * Get a list of thread components. Each thread component is a list of
  * stPinchThreads that transitively share at least one block (although
@@ -170,6 +323,15 @@ stList *stPinchThreadSet_getAdjacencyComponents2(stPinchThreadSet *threadSet, st
  */
 stSortedSet *stPinchThreadSet_getThreadComponents(stPinchThreadSet *threadSet);
 
+/*
+ * Computes the thread components of the graph using up to threadNumber threads, which divide
+ * the blocks between them. Returns an array, to be freed by the caller, that maps the index of
+ * each thread (see stPinchThread_getIndex) to the number of its component. Components are
+ * numbered from 0 in order of their least thread index, and their number is written to
+ * componentNumber.
+ */
+int64_t *stPinchThreadSet_getThreadComponentIndices(stPinchThreadSet *threadSet, int64_t threadNumber, int64_t *componentNumber);
+
 /*
  * Get a random set of randomly named threads that share no homology.
  */
@@ -195,14 +357,45 @@ stPinchThreadSetSegmentIt stPinchThreadSet_getSegmentIt(stPinchThreadSet *thread
 stPinchSegment *stPinchThreadSetSegmentIt_getNext(stPinchThreadSetSegmentIt *segmentIt);
 
 /*
- * Get an iterator over every block in the pinch graph.
+ * Get an iterator over every block in the pinch graph, in time proportional to the number
+ * of blocks. Blocks are returned in the order they were created, except that a block may take
+ * the place of one destructed earlier, so the order is determined by the sequence of operations
+ * that built the graph. Any block may be destructed while iterating; blocks created while
+ * iterating may or may not be returned.
  */
 stPinchThreadSetBlockIt stPinchThreadSet_getBlockIt(stPinchThreadSet *threadSet);
 
 stPinchBlock *stPinchThreadSetBlockIt_getNext(stPinchThreadSetBlockIt *blockIt);
 
+/*
+ * Get an iterator over the blocks whose modified flag is set, most recently flagged first.
+ * The cost of iteration is proportional to the number of such blocks. The modified flag of
+ * the block last returned may be cleared while iterating, but the graph must not otherwise
+ * be altered.
+ */
+stPinchThreadSetModifiedBlockIt stPinchThreadSet_getModifiedBlockIt(stPinchThreadSet *threadSet);
+
+stPinchBlock *stPinchThreadSetModifiedBlockIt_getNext(stPinchThreadSetModifiedBlockIt *modifiedBlockIt);
+
+/*
+ * Get the number of blocks whose modified flag is set.
+ */
+int64_t stPinchThreadSet_getModifiedBlockNumber(stPinchThreadSet *threadSet);
+
+/*
+ * Clears the modified flag of every block, returning the list of blocks whose flag was set,
+ * in the order of stPinchThreadSet_getModifiedBlockIt.
+ */
+stList *stPinchThreadSet_consumeModifiedBlocks(stPinchThreadSet *threadSet);
+
 //Thread
 
+/*
+ * Get the index of this thread, its position in the order threads were added to the
+ * graph, from 0 to stPinchThreadSet_getSize - 1.
+ */
+int64_t stPinchThread_getIndex(stPinchThread *stPinchThread);
+
 /*
  * Get the unique integer name for this thread.
  */
@@ -220,10 +413,27 @@ int64_t stPinchThread_getLength(stPinchThread *stPinchThread);
 
 /*
  * Get the segment that overlaps the given position. If the position
- * is out of range, returns NULL.
+ * is out of range, returns NULL. The thread remembers the segment found, and the next
+ * lookup first walks a few segments from it before searching the thread, so the thread
+ * must not be looked up from two threads of execution at once.
  */
 stPinchSegment *stPinchThread_getSegment(stPinchThread *stPinchThread, int64_t coordinate);
 
+/*
+ * As stPinchThread_getSegment, but always searches the thread and leaves the remembered
+ * segment alone, so it may be called from many threads of execution at once provided none
+ * changes the graph.
+ */
+stPinchSegment *stPinchThread_getSegmentReadOnly(stPinchThread *stPinchThread, int64_t coordinate);
+
+/*
+ * Get the number of stPinchThread_getSegment lookups on the thread found by walking from
+ * the previously found segment, and the number that had to search the thread.
+ */
+int64_t stPinchThread_getFingerHits(stPinchThread *stPinchThread);
+
+int64_t stPinchThread_getFingerMisses(stPinchThread *stPinchThread);
+
 /*
  * Get the 5'-most segment in the thread.
  */
@@ -262,6 +472,31 @@ void stPinchThread_joinTrivialBoundaries(stPinchThread *thread);
  */
 void stPinchThread_pinch(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, int64_t length, bool strand2);
 
+typedef enum _stPinchAlignmentOperationType {
+    ST_PINCH_ALIGNMENT_MATCH, // Aligned positions in both threads
+    ST_PINCH_ALIGNMENT_INSERT, // Positions only in thread1
+    ST_PINCH_ALIGNMENT_DELETE // Positions only in thread2
+} stPinchAlignmentOperationType;
+
+typedef struct _stPinchAlignmentOperation {
+    stPinchAlignmentOperationType type;
+    int64_t length;
+} stPinchAlignmentOperation;
+
+/*
+ * Pinch two threads together along a gapped alignment, given as a run-length encoded list
+ * of operations. This has the same effect as calling stPinchThread_pinch for each match
+ * run, but each match is located by walking on from the segments of the previous match,
+ * only searching the threads if it is more than a few segments further on. Aborts if an
+ * operation has an unknown type or a negative length.
+ *
+ * The alignment starts at start1 on thread1 and is read 5' to 3' along thread1. If strand2
+ * is positive it starts at start2 on thread2 and is read 5' to 3' along thread2. Otherwise
+ * it occupies the same coordinates of thread2, but is read from its 3' end towards start2.
+ */
+void stPinchThread_pinchAlignment(stPinchThread *thread1, stPinchThread *thread2, int64_t start1, int64_t start2, bool strand2,
+        stPinchAlignmentOperation *operations, int64_t operationNumber);
+
 /*
  * Same as stPinchThread_pinch, but only segments for which filterFn
  * returns 0 are pinched together. This function is run for all
@@ -329,7 +564,8 @@ void stPinchSegment_setBlockOrientation(stPinchSegment *segment, bool orientatio
 void stPinchSegment_split(stPinchSegment *segment, int64_t leftSideOfSplitPoint);
 
 /*
- * Makes this segment the first segment in its block, if it has one.
+ * Makes this segment the first segment in its block, if it has one. This walks the block
+ * to find the segment before it, unless ST_PINCH_DOUBLY_LINKED_BLOCKS is defined.
  */
 void stPinchSegment_putSegmentFirstInBlock(stPinchSegment *segment);
 
@@ -397,6 +633,14 @@ stPinchSegment *stPinchBlock_getFirst(stPinchBlock *block);
  */
 uint64_t stPinchBlock_getDegree(stPinchBlock *block);
 
+/*
+ * Get the index of a block, which is unique among the blocks of the graph and less than
+ * stPinchThreadSet_getBlockIndexBound. The index of a block is fixed until it is destructed,
+ * except that stPinchThreadSet_pinchBatchParallel and stPinchThreadSet_trimAllBlocks
+ * renumber all blocks; the index of a destructed block is reused.
+ */
+int64_t stPinchBlock_getIndex(stPinchBlock *block);
+
 /*
  * Get the number of times any two segments in this block have been
  * pinched together (including any times that they were pinched
@@ -433,6 +677,17 @@ void stPinchBlock_setFilterFlag(stPinchBlock* block, bool flag);
  */
 void stPinchBlock_trim(stPinchBlock *block, int64_t blockEndTrim);
 
+/*
+ * Cuts the block at each of the offsets, which must be increasing and strictly within the
+ * block, measured from the start of the block in its own orientation. Each segment of the
+ * block is split at all the offsets in a single pass. The block keeps the first piece of
+ * each segment, the others going to offsetNumber new blocks with the same support.
+ *
+ * If blocks is not NULL it is filled with the offsetNumber + 1 resulting blocks, in order,
+ * the first being the block itself.
+ */
+void stPinchBlock_splitAt(stPinchBlock *block, const int64_t *offsets, int64_t offsetNumber, stPinchBlock **blocks);
+
 //Block ends
 
 /*
@@ -467,6 +722,11 @@ stPinchBlock *stPinchEnd_getBlock(stPinchEnd *end);
  */
 bool stPinchEnd_getOrientation(stPinchEnd *end);
 
+/*
+ * Get the index of an end, which is twice the index of its block plus its orientation.
+ */
+int64_t stPinchEnd_getIndex(stPinchEnd *end);
+
 /*
  * Returns true if the ends have the same block and orientation.
  */
@@ -511,6 +771,26 @@ stSet *stPinchEnd_getConnectedPinchEnds(stPinchEnd *end);
  */
 int64_t stPinchEnd_getNumberOfConnectedPinchEnds(stPinchEnd *end);
 
+/*
+ * Builds an index of the ends connected to each end of the graph, as given by
+ * stPinchEnd_getConnectedPinchEnds, in one pass along the threads. The index is only
+ * valid while the graph is unaltered.
+ */
+stPinchEndAdjacencies *stPinchThreadSet_getEndAdjacencies(stPinchThreadSet *threadSet);
+
+void stPinchEndAdjacencies_destruct(stPinchEndAdjacencies *endAdjacencies);
+
+/*
+ * Get the ends connected to the end, each once with the number of its adjacencies to the end,
+ * writing their number to adjacencyNumber. The array belongs to the index.
+ */
+stPinchEndAdjacency *stPinchEndAdjacencies_get(stPinchEndAdjacencies *endAdjacencies, stPinchEnd *end, int64_t *adjacencyNumber);
+
+/*
+ * Same as stPinchEnd_getNumberOfConnectedPinchEnds, from the index.
+ */
+int64_t stPinchEndAdjacencies_getNumber(stPinchEndAdjacencies *endAdjacencies, stPinchEnd *end);
+
 /*
  * Find out if the end contains a self-loop that doesn't go through
  * otherBlock. If otherBlock is the block of end, just finds out if
@@ -524,6 +804,28 @@ bool stPinchEnd_hasSelfLoopWithRespectToOtherBlock(stPinchEnd *end, stPinchBlock
  */
 stList *stPinchEnd_getSubSequenceLengthsConnectingEnds(stPinchEnd *end, stPinchEnd *otherEnd);
 
+/*
+ * For answering many stPinchEnd_hasSelfLoopWithRespectToOtherBlock and
+ * stPinchEnd_getSubSequenceLengthsConnectingEnds queries: the segments of each block are sorted
+ * once, the first time the block is queried, and each query merges the sorted segments of its
+ * two blocks. Only valid while the graph is unaltered.
+ */
+stPinchSortedBlockSegments *stPinchThreadSet_getSortedBlockSegments(stPinchThreadSet *threadSet);
+
+void stPinchSortedBlockSegments_destruct(stPinchSortedBlockSegments *sortedSegments);
+
+/*
+ * Same as stPinchEnd_hasSelfLoopWithRespectToOtherBlock.
+ */
+bool stPinchSortedBlockSegments_hasSelfLoopWithRespectToOtherBlock(stPinchSortedBlockSegments *sortedSegments, stPinchEnd *end,
+        stPinchBlock *otherBlock);
+
+/*
+ * Same as stPinchEnd_getSubSequenceLengthsConnectingEnds.
+ */
+stList *stPinchSortedBlockSegments_getSubSequenceLengthsConnectingEnds(stPinchSortedBlockSegments *sortedSegments, stPinchEnd *end,
+        stPinchEnd *otherEnd);
+
 /*
  * Pinch structure. A pinch represents a gapless alignment between two
  * threads.
@@ -611,6 +913,28 @@ stSortedSet *stPinchThreadSet_getLabelIntervals(stPinchThreadSet *threadSet, stH
  */
 stPinchInterval *stPinchIntervals_getInterval(stSortedSet *pinchIntervals, int64_t name, int64_t position);
 
+/*
+ * Same as stPinchThreadSet_getLabelIntervals, but the intervals of each thread are built by up to
+ * threadNumber threads into an array, rather than allocated individually and put in one sorted set.
+ * endLabels is indexed by the index of each end (see stPinchEnd_getIndex), for example
+ * as the labels of the components returned by stPinchThreadSet_getAdjacencyComponentIndices.
+ * The intervals are only valid while the graph is unaltered.
+ */
+stPinchLabelIntervals *stPinchThreadSet_getLabelIntervals2(stPinchThreadSet *threadSet, void **endLabels, int64_t threadNumber);
+
+void stPinchLabelIntervals_destruct(stPinchLabelIntervals *labelIntervals);
+
+/*
+ * Get the intervals of a thread, in order, writing their number to intervalNumber.
+ */
+stPinchInterval *stPinchLabelIntervals_getThreadIntervals(stPinchLabelIntervals *labelIntervals, stPinchThread *thread,
+        int64_t *intervalNumber);
+
+/*
+ * Same as stPinchIntervals_getInterval, by binary search of the thread's intervals.
+ */
+stPinchInterval *stPinchLabelIntervals_getInterval(stPinchLabelIntervals *labelIntervals, int64_t name, int64_t position);
+
 /*
  * Functions for undoing pinches. Not for undoing homologies in
  * general (this is impossible in the current code), but for allowing
@@ -680,6 +1004,40 @@ bool stPinchUndo_findOffsetForBlock(stPinchUndo *undo, stPinchThreadSet *threadS
  */
 void stPinchUndo_destruct(stPinchUndo *undo);
 
+/*
+ * Transactions. Unlike undos, a transaction covers any sequence of changes to the graph,
+ * which are recorded as they are made so that they can be reversed, restoring the graph
+ * exactly: the same segments, blocks (at the same addresses, with the same indices,
+ * supports and flags), threads and list of modified blocks. The boundaries awaiting an
+ * incremental join are restored to a superset of those before the transaction, which
+ * can only make the next incremental join examine a few more boundaries. Transactions
+ * do not nest. While one is open stPinchThreadSet_pinchBatchParallel and
+ * stPinchThreadSet_trimAllBlocks work using only the calling thread, and blocks and
+ * segments removed from the graph are only freed once it ends.
+ */
+
+/*
+ * Start recording the changes made to the graph.
+ */
+void stPinchThreadSet_beginTransaction(stPinchThreadSet *threadSet);
+
+/*
+ * Returns non-zero if a transaction is open.
+ */
+bool stPinchThreadSet_inTransaction(stPinchThreadSet *threadSet);
+
+/*
+ * Keep the changes made since stPinchThreadSet_beginTransaction, ending the transaction.
+ */
+void stPinchThreadSet_commitTransaction(stPinchThreadSet *threadSet);
+
+/*
+ * Reverse the changes made since stPinchThreadSet_beginTransaction, ending the transaction.
+ * Blocks, segments and threads made in the transaction are freed, so any references to
+ * them, including undos prepared in the transaction, are invalid.
+ */
+void stPinchThreadSet_rollbackTransaction(stPinchThreadSet *threadSet);
+
 #ifdef __cplusplus
 }
 #endif
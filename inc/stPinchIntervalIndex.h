@@ -0,0 +1,53 @@
+/*
+ * stPinchIntervalIndex.h
+ *
+ *  Immutable index answering stPinchIntervals_getInterval queries.
+ *
+ *  The intervals of each thread are laid out in Eytzinger (breadth first
+ *  binary tree) order, so that a search descends without branching on the
+ *  comparisons and the first levels of every search share cache lines.
+ *  Sorted runs of positions can instead be answered by a linear merge.
+ */
+
+#ifndef ST_PINCH_INTERVAL_INDEX_H_
+#define ST_PINCH_INTERVAL_INDEX_H_
+
+#include "sonLib.h"
+#include "stPinchGraphs.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct _stPinchIntervalIndex stPinchIntervalIndex;
+
+/*
+ * Build an index of a set of non-overlapping pinch intervals, as returned by
+ * stPinchThreadSet_getLabelIntervals. The intervals are not copied, so the index
+ * is only valid while the set is unaltered.
+ */
+stPinchIntervalIndex *stPinchIntervalIndex_construct(stSortedSet *pinchIntervals);
+
+/*
+ * Destroy the index. The intervals are not freed.
+ */
+void stPinchIntervalIndex_destruct(stPinchIntervalIndex *index);
+
+/*
+ * Same as stPinchIntervals_getInterval on the indexed set.
+ */
+stPinchInterval *stPinchIntervalIndex_getInterval(stPinchIntervalIndex *index, int64_t name, int64_t position);
+
+/*
+ * Answers stPinchIntervalIndex_getInterval for each of positionNumber positions on the named
+ * thread, which must be in non-decreasing order, writing the results to intervals. Costs a
+ * single pass over the thread's intervals, or a search per position if that is cheaper.
+ */
+void stPinchIntervalIndex_getIntervals(stPinchIntervalIndex *index, int64_t name, const int64_t *positions, int64_t positionNumber,
+        stPinchInterval **intervals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ST_PINCH_INTERVAL_INDEX_H_ */
@@ -0,0 +1,52 @@
+/*
+ * stPinchPaf.h
+ *
+ *  Streaming ingestion of PAF alignments into a pinch graph.
+ *
+ *  Each PAF record with a cg:Z CIGAR is split into the gapless pinches of its
+ *  match runs. Reading, pinch generation and pinching run on separate threads,
+ *  connected by bounded queues of batches, so that parsing overlaps with the
+ *  application of earlier pinches while memory use stays fixed.
+ */
+
+#ifndef ST_PINCH_PAF_H_
+#define ST_PINCH_PAF_H_
+
+#include "sonLib.h"
+#include "stPinchGraphs.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct _stPinchPafStats {
+    int64_t records; // PAF records read
+    int64_t pinches; // Gapless pinches applied
+    int64_t alignedBases; // Total length of the pinches
+} stPinchPafStats;
+
+/*
+ * Reads PAF records from fileHandle until the end of the file and pinches the threads of each
+ * record together along the match (M, = and X) runs of its cg:Z CIGAR, as stPinchThread_pinch would.
+ * The query sequence of a record is the first thread of its pinches.
+ *
+ * sequenceNamesToThreads maps the sequence names used in the file (strings) to the stPinchThreads
+ * they refer to. If it is NULL the sequence names must be the names of the threads, written in
+ * decimal. PAF coordinates are offsets from the start of the thread.
+ *
+ * Aborts on a record that is malformed, has no CIGAR, or does not lie within its threads.
+ */
+stPinchPafStats stPinchThreadSet_pinchPaf(stPinchThreadSet *threadSet, FILE *fileHandle, stHash *sequenceNamesToThreads);
+
+/*
+ * Writes recordNumber random PAF records between the threads of the graph to fileHandle, naming
+ * sequences by their thread names, for testing. Returns the list of stPinches that reading the
+ * records with stPinchThreadSet_pinchPaf applies, in order.
+ */
+stList *stPinchPaf_writeRandomRecords(stPinchThreadSet *threadSet, FILE *fileHandle, int64_t recordNumber);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ST_PINCH_PAF_H_ */
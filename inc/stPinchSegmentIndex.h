@@ -0,0 +1,77 @@
+/*
+ * stPinchSegmentIndex.h
+ *
+ *  Ordered index of the segments of a pinch thread, keyed by segment start.
+ *
+ *  Implemented as a B+-tree with wide nodes holding the keys contiguously,
+ *  so that a lookup touches a handful of cache lines rather than the
+ *  ~log2(n) scattered nodes of a binary search tree.
+ */
+
+#ifndef ST_PINCH_SEGMENT_INDEX_H_
+#define ST_PINCH_SEGMENT_INDEX_H_
+
+#include "sonLib.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct _stPinchSegmentIndex stPinchSegmentIndex;
+
+/*
+ * Construct an empty index.
+ */
+stPinchSegmentIndex *stPinchSegmentIndex_construct(void);
+
+/*
+ * Construct an index of the given keys, which must be strictly increasing, and their values,
+ * building the tree bottom up in time linear in the length rather than inserting each key.
+ */
+stPinchSegmentIndex *stPinchSegmentIndex_constructFromSorted(const int64_t *keys, void **values, int64_t length);
+
+/*
+ * Destroy the index. The values are not freed.
+ */
+void stPinchSegmentIndex_destruct(stPinchSegmentIndex *index);
+
+/*
+ * Number of keys in the index.
+ */
+int64_t stPinchSegmentIndex_size(stPinchSegmentIndex *index);
+
+/*
+ * Add a key with the given value, which must not be NULL. The key must not already be in the index.
+ */
+void stPinchSegmentIndex_insert(stPinchSegmentIndex *index, int64_t key, void *value);
+
+/*
+ * Remove a key from the index, returning its value, or NULL if the key is not present.
+ */
+void *stPinchSegmentIndex_remove(stPinchSegmentIndex *index, int64_t key);
+
+/*
+ * Get the value of the given key, or NULL if the key is not present.
+ */
+void *stPinchSegmentIndex_search(stPinchSegmentIndex *index, int64_t key);
+
+/*
+ * Get the value of the largest key less than or equal to the given key, or NULL if none exists.
+ */
+void *stPinchSegmentIndex_searchLessThanOrEqual(stPinchSegmentIndex *index, int64_t key);
+
+/*
+ * Get the value of the smallest key, or NULL if the index is empty.
+ */
+void *stPinchSegmentIndex_getFirst(stPinchSegmentIndex *index);
+
+/*
+ * Get the value of the largest key, or NULL if the index is empty.
+ */
+void *stPinchSegmentIndex_getLast(stPinchSegmentIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ST_PINCH_SEGMENT_INDEX_H_ */
@@ -8,5 +8,5 @@ LIBDIR ?= ${sonLibDir}
 include  ${sonLibRootDir}/include.mk
 
 CPPFLAGS += -I${sonLibRootDir}/lib
-LDLIBS = ${sonLibDir}/sonLib.a ${sonLibDir}/cuTest.a ${dblibs} ${LIBS}
+LDLIBS = ${sonLibDir}/sonLib.a ${sonLibDir}/cuTest.a ${dblibs} ${LIBS} -lpthread
 LIBDEPENDS = ${sonLibDir}/sonLib.a ${sonLibDir}/cuTest.a 
@@ -10,6 +10,9 @@
 CuSuite* stCactusGraphsTestSuite(void);
 CuSuite* stPinchGraphsTestSuite(void);
 CuSuite* stPinchPhylogenyTestSuite(void);
+CuSuite* stPinchSegmentIndexTestSuite(void);
+CuSuite* stPinchPafTestSuite(void);
+CuSuite* stPinchIntervalIndexTestSuite(void);
 
 int stPinchesAndCactiRunAllTests(void) {
     CuString *output = CuStringNew();
@@ -17,6 +20,9 @@ int stPinchesAndCactiRunAllTests(void) {
     CuSuiteAddSuite(suite, stPinchGraphsTestSuite());
     CuSuiteAddSuite(suite, stCactusGraphsTestSuite());
     CuSuiteAddSuite(suite, stPinchPhylogenyTestSuite());
+    CuSuiteAddSuite(suite, stPinchSegmentIndexTestSuite());
+    CuSuiteAddSuite(suite, stPinchPafTestSuite());
+    CuSuiteAddSuite(suite, stPinchIntervalIndexTestSuite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
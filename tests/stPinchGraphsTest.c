@@ -84,6 +84,59 @@ static void testStPinchThreadSet(CuTest *testCase) {
     teardown();
 }
 
+static int64_t getRandomThreadName(int64_t nameRange) {
+    //Mostly names from a compact range, occasionally from anywhere, including the extremes
+    if (st_random() > 0.02) {
+        return st_randomInt(-nameRange, nameRange);
+    }
+    if (st_random() > 0.2) {
+        return st_randomInt64(INT64_MIN / 4, INT64_MAX / 4);
+    }
+    return st_random() > 0.5 ? INT64_MAX - st_randomInt(0, 3) : INT64_MIN + st_randomInt(0, 3);
+}
+
+static void testStPinchThreadSet_getThread_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random get thread test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_construct();
+        int64_t threadNumber = st_randomInt(0, 300), rolledBackThreadNumber = threadNumber;
+        int64_t nameRange = st_random() > 0.5 ? threadNumber + 1 : st_randomInt(threadNumber + 1, 100000);
+        int64_t *names = st_malloc(threadNumber * sizeof(int64_t));
+        stPinchThread **threads = st_malloc(threadNumber * sizeof(stPinchThread *));
+        for (int64_t i = 0; i < threadNumber; i++) {
+            if (i == rolledBackThreadNumber || (!stPinchThreadSet_inTransaction(threadSet) && st_random() > 0.99)) {
+                //The threads added from here are removed again by the rollback
+                stPinchThreadSet_beginTransaction(threadSet);
+                rolledBackThreadNumber = i;
+            }
+            do {
+                names[i] = getRandomThreadName(nameRange);
+            } while (stPinchThreadSet_getThread(threadSet, names[i]) != NULL);
+            threads[i] = stPinchThreadSet_addThread(threadSet, names[i], 0, 1);
+        }
+        if (stPinchThreadSet_inTransaction(threadSet)) {
+            stPinchThreadSet_rollbackTransaction(threadSet);
+        }
+        CuAssertIntEquals(testCase, rolledBackThreadNumber, stPinchThreadSet_getSize(threadSet));
+        for (int64_t i = 0; i < threadNumber; i++) {
+            CuAssertPtrEquals(testCase, i < rolledBackThreadNumber ? threads[i] : NULL, stPinchThreadSet_getThread(threadSet, names[i]));
+        }
+        for (int64_t i = 0; i < 1000; i++) {
+            int64_t name = getRandomThreadName(nameRange);
+            stPinchThread *thread = NULL;
+            for (int64_t j = 0; j < rolledBackThreadNumber; j++) {
+                if (names[j] == name) {
+                    thread = threads[j];
+                }
+            }
+            CuAssertPtrEquals(testCase, thread, stPinchThreadSet_getThread(threadSet, name));
+        }
+        free(names);
+        free(threads);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
 static void testStPinchThreadAndSegment(CuTest *testCase) {
     setup();
     CuAssertIntEquals(testCase, name1, stPinchThread_getName(thread1));
@@ -641,6 +694,174 @@ static void testStPinchThread_pinch_randomTests(CuTest *testCase) {
     }
 }
 
+static int64_t getTotalSegmentNumber(stPinchThreadSet *threadSet) {
+    int64_t segmentNumber = 0;
+    stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
+    while (stPinchThreadSetSegmentIt_getNext(&segmentIt) != NULL) {
+        segmentNumber++;
+    }
+    return segmentNumber;
+}
+
+static void testStPinchThreadSet_pinchBatch_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random batch pinch test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stHash *columns = getUnalignedColumns(threadSet);
+
+        //Apply the pinches in a few batches, so later batches pinch an already pinched graph
+        int64_t batchNumber = st_randomInt(1, 3);
+        for (int64_t batch = 0; batch < batchNumber; batch++) {
+            int64_t pinchNumber = st_randomInt(0, 10);
+            stPinch *pinches = st_malloc(pinchNumber * sizeof(stPinch));
+            for (int64_t i = 0; i < pinchNumber; i++) {
+                stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+                pinches[i] = pinch;
+                for (int64_t j = 0; j < pinch.length; j++) {
+                    mergePositionsSymmetric(columns, pinch.name1, pinch.start1 + j, 1, pinch.name2,
+                            pinch.strand ? pinch.start2 + j : pinch.start2 + pinch.length - 1 - j, pinch.strand);
+                }
+            }
+            int64_t segmentNumber = getTotalSegmentNumber(threadSet);
+            stPinchBatchStats stats = stPinchThreadSet_pinchBatch(threadSet, pinches, pinchNumber);
+            //Pinching only splits segments, never joins them
+            CuAssertIntEquals(testCase, getTotalSegmentNumber(threadSet) - segmentNumber, stats.splits);
+            CuAssertTrue(testCase, stats.merges >= 0);
+            for (int64_t i = 1; i < pinchNumber; i++) { //The batch is left sorted
+                CuAssertTrue(testCase, pinches[i - 1].name1 < pinches[i].name1 ||
+                        (pinches[i - 1].name1 == pinches[i].name1 && pinches[i - 1].start1 <= pinches[i].start1));
+            }
+            free(pinches);
+        }
+        checkPinchSetsAreEquivalentAndCleanup(testCase, threadSet, columns);
+    }
+}
+
+/*
+ * Returns an empty graph with the same threads as the given graph.
+ */
+static stPinchThreadSet *copyThreads(stPinchThreadSet *threadSet, bool useSlabAllocation) {
+    stPinchThreadSet *threadSet2 = stPinchThreadSet_construct2(useSlabAllocation);
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThreadSet_addThread(threadSet2, stPinchThread_getName(thread), stPinchThread_getStart(thread),
+                stPinchThread_getLength(thread));
+    }
+    return threadSet2;
+}
+
+/*
+ * Checks the two graphs have the same segments, and that their segments are grouped into blocks, with the
+ * same orientations, in the same way.
+ */
+static void checkGraphsAreIdentical(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getSize(threadSet1), stPinchThreadSet_getSize(threadSet2));
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1), stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet1);
+    stPinchSegment *segment1;
+    while ((segment1 = stPinchThreadSetSegmentIt_getNext(&segmentIt)) != NULL) {
+        stPinchSegment *segment2 = stPinchThreadSet_getSegment(threadSet2, stPinchSegment_getName(segment1),
+                stPinchSegment_getStart(segment1));
+        CuAssertTrue(testCase, segment2 != NULL);
+        CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+        CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+        stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+        CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+        if (block1 == NULL) {
+            continue;
+        }
+        CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+        //Every segment of block1 must be in block2, with the same orientation relative to the segment
+        bool relativeOrientation = stPinchSegment_getBlockOrientation(segment1) == stPinchSegment_getBlockOrientation(segment2);
+        stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(block1);
+        stPinchSegment *segment3;
+        while ((segment3 = stPinchBlockIt_getNext(&blockIt)) != NULL) {
+            stPinchSegment *segment4 = stPinchThreadSet_getSegment(threadSet2, stPinchSegment_getName(segment3),
+                    stPinchSegment_getStart(segment3));
+            CuAssertPtrEquals(testCase, block2, stPinchSegment_getBlock(segment4));
+            CuAssertTrue(testCase, relativeOrientation ==
+                    (stPinchSegment_getBlockOrientation(segment3) == stPinchSegment_getBlockOrientation(segment4)));
+        }
+    }
+}
+
+static void testStPinchThreadSet_pinchBatchParallel_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random parallel batch pinch test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *parallelThreadSet = copyThreads(threadSet, st_random() > 0.5);
+
+        int64_t batchNumber = st_randomInt(1, 4);
+        for (int64_t batch = 0; batch < batchNumber; batch++) {
+            int64_t pinchNumber = st_randomInt(0, 20);
+            stPinch *pinches = st_malloc(pinchNumber * sizeof(stPinch));
+            stPinch *parallelPinches = st_malloc(pinchNumber * sizeof(stPinch));
+            for (int64_t i = 0; i < pinchNumber; i++) {
+                pinches[i] = stPinchThreadSet_getRandomPinch(threadSet);
+                parallelPinches[i] = pinches[i];
+            }
+            stPinchBatchStats stats = stPinchThreadSet_pinchBatch(threadSet, pinches, pinchNumber);
+            stPinchBatchStats parallelStats = stPinchThreadSet_pinchBatchParallel(parallelThreadSet, parallelPinches,
+                    pinchNumber, st_randomInt(1, 5));
+            CuAssertIntEquals(testCase, stats.splits, parallelStats.splits);
+            CuAssertIntEquals(testCase, stats.merges, parallelStats.merges);
+            free(pinches);
+            free(parallelPinches);
+        }
+        checkGraphsAreIdentical(testCase, threadSet, parallelThreadSet);
+        checkGraphsAreIdentical(testCase, parallelThreadSet, threadSet);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(parallelThreadSet);
+    }
+}
+
+/*
+ * Returns a random empty graph whose segments and blocks are slab allocated.
+ */
+static stPinchThreadSet *getRandomEmptySlabGraph() {
+    stPinchThreadSet *randomThreadSet = stPinchThreadSet_getRandomEmptyGraph();
+    stPinchThreadSet *threadSet = copyThreads(randomThreadSet, 1);
+    stPinchThreadSet_destruct(randomThreadSet);
+    return threadSet;
+}
+
+static void testStPinchThreadSet_slabAllocation_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random slab allocation test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = getRandomEmptySlabGraph();
+        stHash *columns = getUnalignedColumns(threadSet);
+
+        //Pinch, undoing some of the pinches and joining trivial boundaries as we go so that
+        //segments and blocks are repeatedly freed and reused
+        double threshold = st_random();
+        if (threshold < 0.05) {
+            threshold = 0.05; //Bounds the cost of checking the columns
+        }
+        while (st_random() > threshold) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch.name1);
+            stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch.name2);
+            stPinchUndo *undo = stPinchThread_prepareUndo(thread1, thread2, pinch.start1, pinch.start2, pinch.length,
+                    pinch.strand);
+            stPinchThread_pinch(thread1, thread2, pinch.start1, pinch.start2, pinch.length, pinch.strand);
+            if (st_random() > 0.3) {
+                for (int64_t i = 0; i < pinch.length; i++) {
+                    mergePositionsSymmetric(columns, pinch.name1, pinch.start1 + i, 1, pinch.name2,
+                            pinch.strand ? pinch.start2 + i : pinch.start2 + pinch.length - 1 - i, pinch.strand);
+                }
+            } else {
+                stPinchThreadSet_undoPinch(threadSet, undo);
+            }
+            stPinchUndo_destruct(undo);
+            if (st_random() > 0.8) {
+                stPinchThreadSet_joinTrivialBoundaries(threadSet);
+            }
+        }
+        checkPinchSetsAreEquivalentAndCleanup(testCase, threadSet, columns);
+    }
+}
+
 static bool checkIntersection(stSortedSet *names1, stSortedSet *names2) {
     stSortedSet *n12 = stSortedSet_getIntersection(names1, names2);
     bool b = stSortedSet_size(n12) > 0;
@@ -716,30 +937,389 @@ static void testStPinchThread_filterPinch_randomTests(CuTest *testCase) {
     }
 }
 
+static bool isFilteredByBlocks(stPinchSegment *segment1, stPinchSegment *segment2, int filter, int64_t maxDegree) {
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+    stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+    int64_t degree1 = block1 != NULL ? stPinchBlock_getDegree(block1) : 1;
+    int64_t degree2 = block2 != NULL ? stPinchBlock_getDegree(block2) : 1;
+    bool sameBlock = block1 != NULL && block1 == block2;
+    return ((filter & ST_PINCH_FILTER_SAME_BLOCK) && sameBlock)
+            || ((filter & ST_PINCH_FILTER_BLOCK_MERGE) && block1 != NULL && block2 != NULL && !sameBlock)
+            || ((filter & ST_PINCH_FILTER_MAX_DEGREE) && (sameBlock ? degree1 : degree1 + degree2) > maxDegree);
+}
+
+static void testStPinchThreadSet_filterPinches_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random filter pinches test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        int64_t pinchNumber = st_randomInt(0, 100);
+        stPinch *pinches = st_malloc(pinchNumber * sizeof(stPinch));
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            pinches[i] = stPinchThreadSet_getRandomPinch(threadSet);
+        }
+        int filter = st_randomInt(0, 8);
+        int64_t maxDegree = st_randomInt(1, 10);
+        uint64_t *bits = stPinchThreadSet_filterPinches(threadSet, pinches, pinchNumber, filter, maxDegree);
+        //Every position must be accepted exactly when its pair of segments passes the filter
+        int64_t k = 0;
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            stPinch *pinch = &pinches[i];
+            for (int64_t j = 0; j < pinch->length; j++, k++) {
+                stPinchSegment *segment1 = stPinchThreadSet_getSegment(threadSet, pinch->name1, pinch->start1 + j);
+                stPinchSegment *segment2 = stPinchThreadSet_getSegment(threadSet, pinch->name2,
+                        pinch->strand ? pinch->start2 + j : pinch->start2 + pinch->length - 1 - j);
+                bool accepted = (bits[k / 64] >> (k % 64)) & 1;
+                CuAssertTrue(testCase, accepted == !isFilteredByBlocks(segment1, segment2, filter, maxDegree));
+            }
+        }
+        free(bits);
+        free(pinches);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
+static void checkNoTrivialBoundaries(CuTest *testCase, stPinchThreadSet *threadSet) {
+    stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
+    stPinchSegment *segment;
+    while ((segment = stPinchThreadSetSegmentIt_getNext(&segmentIt))) {
+        if (stPinchSegment_getBlock(segment) == NULL) {
+            stPinchSegment *segment2 = stPinchSegment_get5Prime(segment);
+            CuAssertTrue(testCase, segment2 == NULL || stPinchSegment_getBlock(segment2) != NULL);
+            segment2 = stPinchSegment_get3Prime(segment);
+            CuAssertTrue(testCase, segment2 == NULL || stPinchSegment_getBlock(segment2) != NULL);
+        }
+    }
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stPinchEnd end;
+        end.block = block;
+        end.orientation = 0;
+        CuAssertTrue(testCase, !stPinchEnd_boundaryIsTrivial(end));
+        end.orientation = 1;
+        CuAssertTrue(testCase, !stPinchEnd_boundaryIsTrivial(end));
+    }
+}
+
+/*
+ * Gets the indices of the ends connected to the given end by an adjacency.
+ */
+static stList *getAdjacentEndIndices(stPinchEnd *end) {
+    stList *adjacentEndIndices = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(stPinchEnd_getBlock(end));
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&blockIt)) != NULL) {
+        bool _5PrimeTraversal = stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end), segment);
+        while ((segment = _5PrimeTraversal ? stPinchSegment_get5Prime(segment) : stPinchSegment_get3Prime(segment)) != NULL) {
+            if (stPinchSegment_getBlock(segment) != NULL) {
+                stPinchEnd end2 = stPinchEnd_constructStatic(stPinchSegment_getBlock(segment),
+                        stPinchEnd_endOrientation(_5PrimeTraversal, segment));
+                stList_append(adjacentEndIndices, stIntTuple_construct1(stPinchEnd_getIndex(&end2)));
+                break;
+            }
+        }
+    }
+    return adjacentEndIndices;
+}
+
+static void testStPinchThreadSet_getAdjacencyComponentIndices_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random adjacency component indices test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        //Destruct some blocks, so that some indices are unused
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+        stPinchBlock *block;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            if (st_random() > 0.9) {
+                stPinchBlock_destruct(block);
+            }
+        }
+        int64_t componentNumber;
+        int64_t *componentIndices = stPinchThreadSet_getAdjacencyComponentIndices(threadSet, st_randomInt(1, 5), &componentNumber);
+        int64_t endNumber = 2 * stPinchThreadSet_getBlockIndexBound(threadSet);
+
+        //Label the components by searching from each end in turn, and check the labels agree with the indices
+        int64_t *labels = st_malloc(endNumber * sizeof(int64_t));
+        for (int64_t i = 0; i < endNumber; i++) {
+            labels[i] = -1;
+        }
+        int64_t labelNumber = 0;
+        for (int64_t i = 0; i < endNumber; i++) {
+            block = stPinchThreadSet_getBlockFromIndex(threadSet, i / 2);
+            if (block == NULL) {
+                CuAssertIntEquals(testCase, -1, componentIndices[i]);
+                continue;
+            }
+            CuAssertIntEquals(testCase, i / 2, stPinchBlock_getIndex(block));
+            if (labels[i] != -1) {
+                continue;
+            }
+            //The components are numbered in order of their least ends
+            CuAssertIntEquals(testCase, labelNumber, componentIndices[i]);
+            stList *stack = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+            stList_append(stack, stIntTuple_construct1(i));
+            labels[i] = labelNumber;
+            while (stList_length(stack) > 0) {
+                stIntTuple *endIndex = stList_pop(stack);
+                int64_t j = stIntTuple_get(endIndex, 0);
+                stIntTuple_destruct(endIndex);
+                CuAssertIntEquals(testCase, labelNumber, componentIndices[j]);
+                stPinchEnd end = stPinchEnd_constructStatic(stPinchThreadSet_getBlockFromIndex(threadSet, j / 2), j % 2);
+                CuAssertIntEquals(testCase, j, stPinchEnd_getIndex(&end));
+                stList *adjacentEndIndices = getAdjacentEndIndices(&end);
+                for (int64_t k = 0; k < stList_length(adjacentEndIndices); k++) {
+                    int64_t l = stIntTuple_get(stList_get(adjacentEndIndices, k), 0);
+                    if (labels[l] == -1) {
+                        labels[l] = labelNumber;
+                        stList_append(stack, stIntTuple_construct1(l));
+                    }
+                }
+                stList_destruct(adjacentEndIndices);
+            }
+            stList_destruct(stack);
+            labelNumber++;
+        }
+        CuAssertIntEquals(testCase, labelNumber, componentNumber);
+
+        //The list of components matches
+        stList *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents(threadSet);
+        CuAssertIntEquals(testCase, componentNumber, stList_length(adjacencyComponents));
+        for (int64_t i = 0; i < stList_length(adjacencyComponents); i++) {
+            stList *adjacencyComponent = stList_get(adjacencyComponents, i);
+            for (int64_t j = 0; j < stList_length(adjacencyComponent); j++) {
+                CuAssertIntEquals(testCase, i, componentIndices[stPinchEnd_getIndex(stList_get(adjacencyComponent, j))]);
+            }
+        }
+        stList_destruct(adjacencyComponents);
+        free(labels);
+        free(componentIndices);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
 static void testStPinchThreadSet_joinTrivialBoundaries_randomTests(CuTest *testCase) {
     for (int64_t test = 0; test < 100; test++) {
         st_logInfo("Starting random trivial boundaries test %" PRIi64 "\n", test);
         stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
         stPinchThreadSet_joinTrivialBoundaries(threadSet);
-        stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
-        stPinchSegment *segment;
-        while ((segment = stPinchThreadSetSegmentIt_getNext(&segmentIt))) {
-            if (stPinchSegment_getBlock(segment) == NULL) {
-                stPinchSegment *segment2 = stPinchSegment_get5Prime(segment);
-                CuAssertTrue(testCase, segment2 == NULL || stPinchSegment_getBlock(segment2) != NULL);
-                segment2 = stPinchSegment_get3Prime(segment);
-                CuAssertTrue(testCase, segment2 == NULL || stPinchSegment_getBlock(segment2) != NULL);
+        checkNoTrivialBoundaries(testCase, threadSet);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
+static void testStPinchThreadSet_joinTrivialBoundariesIncremental_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random incremental trivial boundaries test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *expectedThreadSet = copyThreads(threadSet, 0);
+        //Rounds of pinches, each followed by a join, the first of which joins the whole graph
+        int64_t roundNumber = st_randomInt(1, 6);
+        for (int64_t round = 0; round < roundNumber; round++) {
+            int64_t pinchNumber = st_randomInt(0, 20);
+            for (int64_t i = 0; i < pinchNumber; i++) {
+                stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+                stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1), stPinchThreadSet_getThread(threadSet, pinch.name2),
+                        pinch.start1, pinch.start2, pinch.length, pinch.strand);
+                stPinchThread_pinch(stPinchThreadSet_getThread(expectedThreadSet, pinch.name1),
+                        stPinchThreadSet_getThread(expectedThreadSet, pinch.name2), pinch.start1, pinch.start2, pinch.length,
+                        pinch.strand);
+            }
+            stPinchThreadSet_joinTrivialBoundariesIncremental(threadSet);
+            stPinchThreadSet_joinTrivialBoundaries(expectedThreadSet);
+            checkNoTrivialBoundaries(testCase, threadSet);
+            checkGraphsAreIdentical(testCase, expectedThreadSet, threadSet);
+        }
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(expectedThreadSet);
+    }
+}
+
+/*
+ * Checks the block iterator returns each block of the graph once, finding the blocks from their head segments.
+ */
+static void checkBlockIt(CuTest *testCase, stPinchThreadSet *threadSet) {
+    stSet *blocks = stSet_construct();
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        CuAssertTrue(testCase, stSet_search(blocks, block) == NULL);
+        stSet_insert(blocks, block);
+    }
+    CuAssertIntEquals(testCase, stSet_size(blocks), stPinchThreadSet_getTotalBlockNumber(threadSet));
+    int64_t blockNumber = 0;
+    stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
+    stPinchSegment *segment;
+    while ((segment = stPinchThreadSetSegmentIt_getNext(&segmentIt)) != NULL) {
+        if ((block = stPinchSegment_getBlock(segment)) != NULL && stPinchBlock_getFirst(block) == segment) {
+            CuAssertTrue(testCase, stSet_search(blocks, block) == block);
+            blockNumber++;
+        }
+    }
+    CuAssertIntEquals(testCase, blockNumber, stSet_size(blocks));
+    stSet_destruct(blocks);
+}
+
+/*
+ * Returns the blocks of the graph in iteration order, each as the name and start of its first segment.
+ */
+static stList *getBlockOrder(stPinchThreadSet *threadSet) {
+    stList *blockOrder = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stPinchSegment *segment = stPinchBlock_getFirst(block);
+        stList_append(blockOrder, stIntTuple_construct2(stPinchSegment_getName(segment), stPinchSegment_getStart(segment)));
+    }
+    return blockOrder;
+}
+
+static void testStPinchThreadSet_blockIt_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random block iterator test %" PRIi64 "\n", test);
+        stPinchThreadSet *randomThreadSet = stPinchThreadSet_getRandomEmptyGraph();
+        bool useSlabAllocation = st_random() > 0.5;
+        stPinchThreadSet *threadSet = copyThreads(randomThreadSet, useSlabAllocation);
+        stPinchThreadSet *threadSet2 = copyThreads(randomThreadSet, useSlabAllocation);
+        stPinchThreadSet_destruct(randomThreadSet);
+        //Build the same graph twice, pinching in parallel with different numbers of workers
+        int64_t batchNumber = st_randomInt(1, 4);
+        for (int64_t batch = 0; batch < batchNumber; batch++) {
+            int64_t pinchNumber = st_randomInt(0, 20);
+            stPinch *pinches = st_malloc(pinchNumber * sizeof(stPinch));
+            stPinch *pinches2 = st_malloc(pinchNumber * sizeof(stPinch));
+            for (int64_t i = 0; i < pinchNumber; i++) {
+                pinches[i] = stPinchThreadSet_getRandomPinch(threadSet);
+                pinches2[i] = pinches[i];
             }
+            stPinchThreadSet_pinchBatchParallel(threadSet, pinches, pinchNumber, st_randomInt(1, 5));
+            stPinchThreadSet_pinchBatchParallel(threadSet2, pinches2, pinchNumber, st_randomInt(1, 5));
+            free(pinches);
+            free(pinches2);
+            checkBlockIt(testCase, threadSet);
+        }
+        stList *blockOrder = getBlockOrder(threadSet), *blockOrder2 = getBlockOrder(threadSet2);
+        CuAssertIntEquals(testCase, stList_length(blockOrder), stList_length(blockOrder2));
+        for (int64_t i = 0; i < stList_length(blockOrder); i++) {
+            CuAssertTrue(testCase, stIntTuple_equalsFn(stList_get(blockOrder, i), stList_get(blockOrder2, i)));
         }
+        stList_destruct(blockOrder);
+        stList_destruct(blockOrder2);
+
+        //Destruct blocks while iterating, both those returned and those not yet returned
+        int64_t blockNumber = stPinchThreadSet_getTotalBlockNumber(threadSet), destructedBlockNumber = 0;
         stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
         stPinchBlock *block;
         while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
-            stPinchEnd end;
-            end.block = block;
-            end.orientation = 0;
-            CuAssertTrue(testCase, !stPinchEnd_boundaryIsTrivial(end));
-            end.orientation = 1;
-            CuAssertTrue(testCase, !stPinchEnd_boundaryIsTrivial(end));
+            if (st_random() > 0.5) {
+                stPinchBlock_destruct(block);
+                destructedBlockNumber++;
+            }
+        }
+        CuAssertIntEquals(testCase, blockNumber - destructedBlockNumber, stPinchThreadSet_getTotalBlockNumber(threadSet));
+        checkBlockIt(testCase, threadSet);
+
+        //Reuse the emptied slots
+        stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
+        stPinchSegment *segment;
+        while ((segment = stPinchThreadSetSegmentIt_getNext(&segmentIt)) != NULL) {
+            if (stPinchSegment_getBlock(segment) == NULL && st_random() > 0.5) {
+                stPinchBlock_construct2(segment);
+            }
+        }
+        checkBlockIt(testCase, threadSet);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(threadSet2);
+    }
+}
+
+/*
+ * Checks the modified blocks iterator returns exactly the blocks of the graph with the modified flag set.
+ */
+static void checkModifiedBlocks(CuTest *testCase, stPinchThreadSet *threadSet) {
+    stSet *modifiedBlocks = stSet_construct();
+    stPinchThreadSetModifiedBlockIt modifiedBlockIt = stPinchThreadSet_getModifiedBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetModifiedBlockIt_getNext(&modifiedBlockIt)) != NULL) {
+        CuAssertTrue(testCase, stPinchBlock_getModifiedFlag(block));
+        CuAssertTrue(testCase, stSet_search(modifiedBlocks, block) == NULL);
+        stSet_insert(modifiedBlocks, block);
+    }
+    CuAssertIntEquals(testCase, stSet_size(modifiedBlocks), stPinchThreadSet_getModifiedBlockNumber(threadSet));
+    int64_t modifiedBlockNumber = 0;
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        if (stPinchBlock_getModifiedFlag(block)) {
+            CuAssertTrue(testCase, stSet_search(modifiedBlocks, block) == block);
+            modifiedBlockNumber++;
+        }
+    }
+    CuAssertIntEquals(testCase, modifiedBlockNumber, stSet_size(modifiedBlocks));
+    stSet_destruct(modifiedBlocks);
+}
+
+static void testStPinchThreadSet_modifiedBlocks_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random modified blocks test %" PRIi64 "\n", test);
+        stPinchThreadSet *randomThreadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *threadSet = copyThreads(randomThreadSet, st_random() > 0.5);
+        stPinchThreadSet_destruct(randomThreadSet);
+        int64_t roundNumber = st_randomInt(1, 6);
+        for (int64_t round = 0; round < roundNumber; round++) {
+            //Pinch, serially, in parallel or with undos
+            int64_t pinchNumber = st_randomInt(0, 20);
+            stPinch *pinches = st_malloc(pinchNumber * sizeof(stPinch));
+            for (int64_t i = 0; i < pinchNumber; i++) {
+                pinches[i] = stPinchThreadSet_getRandomPinch(threadSet);
+            }
+            double mode = st_random();
+            if (mode < 0.4) {
+                for (int64_t i = 0; i < pinchNumber; i++) {
+                    stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinches[i].name1),
+                            stPinchThreadSet_getThread(threadSet, pinches[i].name2), pinches[i].start1, pinches[i].start2,
+                            pinches[i].length, pinches[i].strand);
+                }
+            } else if (mode < 0.8) {
+                stPinchThreadSet_pinchBatchParallel(threadSet, pinches, pinchNumber, st_randomInt(1, 5));
+            } else {
+                for (int64_t i = 0; i < pinchNumber; i++) {
+                    stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinches[i].name1);
+                    stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinches[i].name2);
+                    stPinchUndo *undo = stPinchThread_prepareUndo(thread1, thread2, pinches[i].start1, pinches[i].start2,
+                            pinches[i].length, pinches[i].strand);
+                    stPinchThread_pinch(thread1, thread2, pinches[i].start1, pinches[i].start2, pinches[i].length,
+                            pinches[i].strand);
+                    if (st_random() > 0.5) {
+                        stPinchThreadSet_undoPinch(threadSet, undo);
+                    }
+                    stPinchUndo_destruct(undo);
+                }
+            }
+            free(pinches);
+            if (st_random() > 0.5) {
+                stPinchThreadSet_joinTrivialBoundaries(threadSet);
+            }
+            checkModifiedBlocks(testCase, threadSet);
+
+            //Clear some flags by hand, then consume the rest
+            stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+            stPinchBlock *block;
+            while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+                if (st_random() > 0.7) {
+                    stPinchBlock_setModifiedFlag(block, 0);
+                }
+            }
+            checkModifiedBlocks(testCase, threadSet);
+            if (st_random() > 0.5) {
+                int64_t modifiedBlockNumber = stPinchThreadSet_getModifiedBlockNumber(threadSet);
+                stList *modifiedBlocks = stPinchThreadSet_consumeModifiedBlocks(threadSet);
+                CuAssertIntEquals(testCase, modifiedBlockNumber, stList_length(modifiedBlocks));
+                for (int64_t i = 0; i < stList_length(modifiedBlocks); i++) {
+                    CuAssertTrue(testCase, !stPinchBlock_getModifiedFlag(stList_get(modifiedBlocks, i)));
+                }
+                stList_destruct(modifiedBlocks);
+                CuAssertIntEquals(testCase, 0, stPinchThreadSet_getModifiedBlockNumber(threadSet));
+                checkModifiedBlocks(testCase, threadSet);
+            }
         }
         stPinchThreadSet_destruct(threadSet);
     }
@@ -898,6 +1478,78 @@ static void testStPinchEnd_getSubSequenceLengthsConnectingEnds_randomTests(CuTes
     }
 }
 
+static void testStPinchSortedBlockSegments_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random sorted block segments test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stList *blocks = getListOfBlocks(threadSet);
+        stPinchSortedBlockSegments *sortedSegments = stPinchThreadSet_getSortedBlockSegments(threadSet);
+        //Query each block several times so that the sorted segments of most blocks are reused
+        for (int64_t i = 0; i < 5 * stList_length(blocks); i++) {
+            stPinchEnd end1 = stPinchEnd_constructStatic(st_randomChoice(blocks), st_random() > 0.5);
+            stPinchEnd end2 = stPinchEnd_constructStatic(st_random() > 0.2 ? st_randomChoice(blocks) : stPinchEnd_getBlock(&end1),
+                    st_random() > 0.5);
+            CuAssertTrue(testCase, stPinchSortedBlockSegments_hasSelfLoopWithRespectToOtherBlock(sortedSegments, &end1,
+                    stPinchEnd_getBlock(&end2)) == hasSelfLoopWithRespectToOtherBlock(&end1, stPinchEnd_getBlock(&end2)));
+            stList *lengths1 = stPinchEnd_getSubSequenceLengthsConnectingEnds(&end1, &end2);
+            stList *lengths2 = stPinchSortedBlockSegments_getSubSequenceLengthsConnectingEnds(sortedSegments, &end1, &end2);
+            CuAssertIntEquals(testCase, stList_length(lengths1), stList_length(lengths2));
+            for (int64_t j = 0; j < stList_length(lengths1); j++) {
+                CuAssertIntEquals(testCase, stIntTuple_get(stList_get(lengths1, j), 0), stIntTuple_get(stList_get(lengths2, j), 0));
+            }
+            stList_destruct(lengths1);
+            stList_destruct(lengths2);
+        }
+        stPinchSortedBlockSegments_destruct(sortedSegments);
+        stPinchThreadSet_destruct(threadSet);
+        stList_destruct(blocks);
+    }
+}
+
+static int64_t getAdjacencyMultiplicity(stPinchEnd *end1, stPinchEnd *end2) {
+    int64_t multiplicity = 0;
+    stPinchBlockIt blockIt = stPinchBlock_getSegmentIterator(stPinchEnd_getBlock(end1));
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&blockIt)) != NULL) {
+        bool traverse5Prime = stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(end1), segment);
+        do {
+            segment = traverse5Prime ? stPinchSegment_get5Prime(segment) : stPinchSegment_get3Prime(segment);
+        } while (segment != NULL && stPinchSegment_getBlock(segment) == NULL);
+        if (segment != NULL && stPinchSegment_getBlock(segment) == stPinchEnd_getBlock(end2)
+                && stPinchEnd_endOrientation(traverse5Prime, segment) == stPinchEnd_getOrientation(end2)) {
+            multiplicity++;
+        }
+    }
+    return multiplicity;
+}
+
+static void testStPinchThreadSet_getEndAdjacencies_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random end adjacencies test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stPinchEndAdjacencies *endAdjacencies = stPinchThreadSet_getEndAdjacencies(threadSet);
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+        stPinchBlock *block;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            for (int64_t orientation = 0; orientation < 2; orientation++) {
+                stPinchEnd end = stPinchEnd_constructStatic(block, orientation);
+                stSet *connectedEnds = stPinchEnd_getConnectedPinchEnds(&end);
+                int64_t adjacencyNumber;
+                stPinchEndAdjacency *adjacencies = stPinchEndAdjacencies_get(endAdjacencies, &end, &adjacencyNumber);
+                CuAssertIntEquals(testCase, stSet_size(connectedEnds), adjacencyNumber);
+                CuAssertIntEquals(testCase, adjacencyNumber, stPinchEndAdjacencies_getNumber(endAdjacencies, &end));
+                for (int64_t i = 0; i < adjacencyNumber; i++) {
+                    CuAssertTrue(testCase, stSet_search(connectedEnds, &adjacencies[i].end) != NULL);
+                    CuAssertIntEquals(testCase, getAdjacencyMultiplicity(&end, &adjacencies[i].end), adjacencies[i].multiplicity);
+                }
+                stSet_destruct(connectedEnds);
+            }
+        }
+        stPinchEndAdjacencies_destruct(endAdjacencies);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
 static void testStPinchThreadSet_getThreadComponents(CuTest *testCase) {
     for (int64_t test = 0; test < 100; test++) {
         st_logInfo("Starting random thread component test %" PRIi64 "\n", test);
@@ -936,6 +1588,61 @@ static void testStPinchThreadSet_getThreadComponents(CuTest *testCase) {
     }
 }
 
+static void testStPinchThreadSet_getThreadComponentIndices_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random thread component indices test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        int64_t componentNumber;
+        int64_t *componentIndices = stPinchThreadSet_getThreadComponentIndices(threadSet, st_randomInt(1, 5), &componentNumber);
+
+        //Compare with the components of a union-find over the threads of each block
+        stUnionFind *components = stUnionFind_construct();
+        stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+        stPinchThread *thread;
+        int64_t threadIndex = 0;
+        while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+            CuAssertIntEquals(testCase, threadIndex++, stPinchThread_getIndex(thread));
+            stUnionFind_add(components, thread);
+        }
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+        stPinchBlock *block;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(block);
+            stPinchSegment *segment;
+            while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+                stUnionFind_union(components, stPinchSegment_getThread(stPinchBlock_getFirst(block)), stPinchSegment_getThread(segment));
+            }
+        }
+        int64_t expectedComponentNumber = 0;
+        stUnionFindIt *componentsIt = stUnionFind_getIterator(components);
+        stSet *component;
+        while ((component = stUnionFindIt_getNext(componentsIt)) != NULL) {
+            expectedComponentNumber++;
+            //All the threads of the component share its number, which is that of the least thread
+            int64_t leastThreadIndex = INT64_MAX, componentIndex = -1;
+            stSetIterator *threadsIt = stSet_getIterator(component);
+            while ((thread = stSet_getNext(threadsIt)) != NULL) {
+                int64_t i = stPinchThread_getIndex(thread);
+                leastThreadIndex = i < leastThreadIndex ? i : leastThreadIndex;
+                if (componentIndex == -1) {
+                    componentIndex = componentIndices[i];
+                }
+                CuAssertIntEquals(testCase, componentIndex, componentIndices[i]);
+            }
+            stSet_destructIterator(threadsIt);
+            //Components are numbered in order of their least threads
+            for (int64_t i = 0; i < leastThreadIndex; i++) {
+                CuAssertTrue(testCase, componentIndices[i] < componentIndex);
+            }
+        }
+        stUnionFind_destructIterator(componentsIt);
+        CuAssertIntEquals(testCase, expectedComponentNumber, componentNumber);
+        stUnionFind_destruct(components);
+        free(componentIndices);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
 static void testStPinchThreadSet_trimAlignments_randomTests(CuTest *testCase) {
     //return;
     for (int64_t test = 0; test < 100; test++) {
@@ -953,6 +1660,107 @@ static void testStPinchThreadSet_trimAlignments_randomTests(CuTest *testCase) {
     }
 }
 
+static void testStPinchBlock_splitAt_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random block split test %" PRIi64 "\n", test);
+        //Two copies of the same graph, one split with stPinchBlock_splitAt and one a point at a time
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *threadSet2 = copyThreads(threadSet, st_random() > 0.5);
+        int64_t pinchNumber = st_randomInt(0, 50);
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1), stPinchThreadSet_getThread(threadSet, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet2, pinch.name1), stPinchThreadSet_getThread(threadSet2, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+        stList *blocks = stList_construct();
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+        stPinchBlock *block;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            stList_append(blocks, block);
+        }
+        for (int64_t i = 0; i < stList_length(blocks); i++) {
+            block = stList_get(blocks, i);
+            int64_t length = stPinchBlock_getLength(block);
+            if (length < 2 || st_random() > 0.5) {
+                continue;
+            }
+            int64_t offsetNumber = 0;
+            int64_t *offsets = st_malloc((length - 1) * sizeof(int64_t));
+            for (int64_t offset = 1; offset < length; offset++) {
+                if (st_random() > 0.7) {
+                    offsets[offsetNumber++] = offset;
+                }
+            }
+            stPinchSegment *segment = stPinchBlock_getFirst(block);
+            int64_t name = stPinchSegment_getName(segment), start = stPinchSegment_getStart(segment);
+            bool orientation = stPinchSegment_getBlockOrientation(segment);
+            uint64_t degree = stPinchBlock_getDegree(block);
+            stPinchBlock **pieces = st_malloc((offsetNumber + 1) * sizeof(stPinchBlock *));
+            stPinchBlock_splitAt(block, offsets, offsetNumber, pieces);
+            CuAssertPtrEquals(testCase, block, pieces[0]);
+            for (int64_t j = 0; j <= offsetNumber; j++) {
+                CuAssertIntEquals(testCase, (j < offsetNumber ? offsets[j] : length) - (j > 0 ? offsets[j - 1] : 0),
+                        stPinchBlock_getLength(pieces[j]));
+                CuAssertIntEquals(testCase, degree, stPinchBlock_getDegree(pieces[j]));
+            }
+            for (int64_t j = 0; j < offsetNumber; j++) {
+                int64_t leftSideOfSplitPoint = orientation ? start + offsets[j] - 1 : start + length - offsets[j] - 1;
+                stPinchSegment_split(stPinchThreadSet_getSegment(threadSet2, name, leftSideOfSplitPoint), leftSideOfSplitPoint);
+            }
+            free(pieces);
+            free(offsets);
+        }
+        checkGraphsAreIdentical(testCase, threadSet, threadSet2);
+        stList_destruct(blocks);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(threadSet2);
+    }
+}
+
+static void testStPinchThreadSet_trimAllBlocks_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random trim all blocks test %" PRIi64 "\n", test);
+        //Two copies of the same graph, one trimmed in parallel and one a block at a time
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *threadSet2 = copyThreads(threadSet, st_random() > 0.5);
+        int64_t pinchNumber = st_randomInt(0, 50);
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1), stPinchThreadSet_getThread(threadSet, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet2, pinch.name1), stPinchThreadSet_getThread(threadSet2, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+        int64_t trim = st_randomInt(0, 5);
+        stList *blocks = stList_construct();
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet2);
+        stPinchBlock *block;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            stList_append(blocks, block);
+        }
+        int64_t destroyed = 0, shortened = 0;
+        for (int64_t i = 0; i < stList_length(blocks); i++) {
+            block = stList_get(blocks, i);
+            if (trim > 0 && stPinchBlock_getLength(block) > 2 * trim) {
+                shortened++;
+            } else if (trim > 0) {
+                destroyed++;
+            }
+            stPinchBlock_trim(block, trim);
+        }
+        stPinchTrimStats stats = stPinchThreadSet_trimAllBlocks(threadSet, trim, st_randomInt(1, 5));
+        CuAssertIntEquals(testCase, destroyed, stats.destroyed);
+        CuAssertIntEquals(testCase, shortened, stats.shortened);
+        checkGraphsAreIdentical(testCase, threadSet, threadSet2);
+        checkBlockIt(testCase, threadSet);
+        stList_destruct(blocks);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(threadSet2);
+    }
+}
+
 static void testStPinchInterval(CuTest *testCase) {
     setup();
     stPinchInterval *interval = stPinchInterval_construct(name1, start1, length1, testCase);
@@ -1079,6 +1887,66 @@ static void testStPinchThreadSet_getLabelIntervals_randomTests(CuTest *testCase)
     }
 }
 
+static void testStPinchThreadSet_getLabelIntervals2_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random flat label intervals test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stHash *pinchEndsToAdjacencyComponents;
+        stList *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents2(threadSet,
+                &pinchEndsToAdjacencyComponents);
+        stSortedSet *intervals = stPinchThreadSet_getLabelIntervals(threadSet, pinchEndsToAdjacencyComponents);
+        //Label the ends by index with the same components
+        int64_t endNumber = 2 * stPinchThreadSet_getBlockIndexBound(threadSet);
+        void **endLabels = st_calloc(endNumber, sizeof(void *));
+        for (int64_t i = 0; i < endNumber; i++) {
+            stPinchBlock *block = stPinchThreadSet_getBlockFromIndex(threadSet, i / 2);
+            if (block != NULL) {
+                stPinchEnd end = stPinchEnd_constructStatic(block, i % 2);
+                endLabels[i] = stHash_search(pinchEndsToAdjacencyComponents, &end);
+            }
+        }
+        stPinchLabelIntervals *labelIntervals = stPinchThreadSet_getLabelIntervals2(threadSet, endLabels, st_randomInt(1, 5));
+
+        //The arrays hold the same intervals as the sorted set
+        int64_t intervalNumber = 0;
+        stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+        stPinchThread *thread;
+        while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+            int64_t threadIntervalNumber;
+            stPinchInterval *threadIntervals = stPinchLabelIntervals_getThreadIntervals(labelIntervals, thread, &threadIntervalNumber);
+            for (int64_t i = 0; i < threadIntervalNumber; i++) {
+                stPinchInterval *interval = stSortedSet_search(intervals, &threadIntervals[i]);
+                CuAssertTrue(testCase, interval != NULL);
+                CuAssertPtrEquals(testCase, stPinchInterval_getLabel(interval), stPinchInterval_getLabel(&threadIntervals[i]));
+            }
+            intervalNumber += threadIntervalNumber;
+        }
+        CuAssertIntEquals(testCase, stSortedSet_size(intervals), intervalNumber);
+
+        //Lookups agree, including outside the threads
+        stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
+        stPinchSegment *segment;
+        while ((segment = stPinchThreadSetSegmentIt_getNext(&segmentIt)) != NULL) {
+            for (int64_t i = -1; i <= stPinchSegment_getLength(segment); i++) {
+                int64_t name = stPinchSegment_getName(segment), position = stPinchSegment_getStart(segment) + i;
+                stPinchInterval *interval = stPinchIntervals_getInterval(intervals, name, position);
+                stPinchInterval *interval2 = stPinchLabelIntervals_getInterval(labelIntervals, name, position);
+                CuAssertTrue(testCase, (interval == NULL) == (interval2 == NULL));
+                if (interval != NULL) {
+                    CuAssertIntEquals(testCase, 0, stPinchInterval_compareFunction(interval, interval2));
+                    CuAssertPtrEquals(testCase, stPinchInterval_getLabel(interval), stPinchInterval_getLabel(interval2));
+                }
+            }
+        }
+        stPinchLabelIntervals_destruct(labelIntervals);
+        free(endLabels);
+        stSortedSet_destruct(intervals);
+        stHash_destruct(pinchEndsToAdjacencyComponents);
+        stList_destruct(adjacencyComponents);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
 // Check that the given thread has the number of supporting homologies
 // for each block specified in supportingHomologiesArray, which is
 // indexed by segment index along the thread.
@@ -1385,30 +2253,418 @@ static void testStPinchPartialUndo_random(CuTest *testCase) {
     }
 }
 
+/*
+ * Makes a random gapped alignment between two random threads of the graph that fits within the threads.
+ */
+static stPinchAlignmentOperation *getRandomAlignment(stPinchThreadSet *threadSet, stPinchThread **thread1, stPinchThread **thread2,
+        int64_t *start1, int64_t *start2, bool *strand2, int64_t *operationNumber) {
+    stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+    *thread1 = stPinchThreadSet_getThread(threadSet, pinch.name1);
+    *thread2 = stPinchThreadSet_getThread(threadSet, pinch.name2);
+    *start1 = pinch.start1;
+    *start2 = pinch.start2;
+    *strand2 = pinch.strand;
+    int64_t remaining1 = stPinchThread_getStart(*thread1) + stPinchThread_getLength(*thread1) - *start1;
+    int64_t remaining2 = stPinchThread_getStart(*thread2) + stPinchThread_getLength(*thread2) - *start2;
+    *operationNumber = st_randomInt(0, 20);
+    stPinchAlignmentOperation *operations = st_malloc(*operationNumber * sizeof(stPinchAlignmentOperation));
+    for (int64_t i = 0; i < *operationNumber; i++) {
+        operations[i].type = st_randomInt(0, 3);
+        int64_t remaining = operations[i].type == ST_PINCH_ALIGNMENT_INSERT ? remaining1 :
+                (operations[i].type == ST_PINCH_ALIGNMENT_DELETE ? remaining2 : (remaining1 < remaining2 ? remaining1 : remaining2));
+        operations[i].length = remaining > 0 ? st_randomInt(0, (remaining < 10 ? remaining : 10) + 1) : 0;
+        remaining1 -= operations[i].type != ST_PINCH_ALIGNMENT_DELETE ? operations[i].length : 0;
+        remaining2 -= operations[i].type != ST_PINCH_ALIGNMENT_INSERT ? operations[i].length : 0;
+    }
+    return operations;
+}
+
+static void testStPinchThread_pinchAlignment_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random alignment pinch test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *expectedThreadSet = copyThreads(threadSet, 0);
+        int64_t alignmentNumber = st_randomInt(0, 5);
+        for (int64_t i = 0; i < alignmentNumber; i++) {
+            stPinchThread *thread1, *thread2;
+            int64_t start1, start2, operationNumber;
+            bool strand2;
+            stPinchAlignmentOperation *operations = getRandomAlignment(threadSet, &thread1, &thread2, &start1, &start2, &strand2,
+                    &operationNumber);
+            stPinchThread_pinchAlignment(thread1, thread2, start1, start2, strand2, operations, operationNumber);
+
+            //Pinch the match runs one by one into the expected graph
+            stPinchThread *expectedThread1 = stPinchThreadSet_getThread(expectedThreadSet, stPinchThread_getName(thread1));
+            stPinchThread *expectedThread2 = stPinchThreadSet_getThread(expectedThreadSet, stPinchThread_getName(thread2));
+            int64_t length2 = 0;
+            for (int64_t j = 0; j < operationNumber; j++) {
+                length2 += operations[j].type != ST_PINCH_ALIGNMENT_INSERT ? operations[j].length : 0;
+            }
+            int64_t position1 = start1, position2 = strand2 ? start2 : start2 + length2;
+            for (int64_t j = 0; j < operationNumber; j++) {
+                int64_t length = operations[j].length;
+                if (operations[j].type != ST_PINCH_ALIGNMENT_INSERT) {
+                    position2 += strand2 ? 0 : -length;
+                }
+                if (operations[j].type == ST_PINCH_ALIGNMENT_MATCH) {
+                    stPinchThread_pinch(expectedThread1, expectedThread2, position1, position2, length, strand2);
+                }
+                if (operations[j].type != ST_PINCH_ALIGNMENT_DELETE) {
+                    position1 += length;
+                }
+                if (operations[j].type != ST_PINCH_ALIGNMENT_INSERT) {
+                    position2 += strand2 ? length : 0;
+                }
+            }
+            free(operations);
+        }
+        checkGraphsAreIdentical(testCase, expectedThreadSet, threadSet);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(expectedThreadSet);
+    }
+}
+
+static void testStPinchThreadSet_binary_randomTests(CuTest *testCase) {
+    const char *fileName = "testPinchGraphSnapshot.bin";
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random pinch graph snapshot test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+        stPinchBlock *block;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            stPinchBlock_setModifiedFlag(block, st_random() > 0.5);
+        }
+        stPinchThreadSet_writeBinary(threadSet, fileName);
+        stPinchThreadSet *threadSet2 = stPinchThreadSet_readBinary(fileName);
+        checkGraphsAreIdentical(testCase, threadSet, threadSet2);
+
+        //The snapshot must also preserve iteration order and the block properties
+        stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet);
+        stPinchThreadSetSegmentIt segmentIt2 = stPinchThreadSet_getSegmentIt(threadSet2);
+        stPinchSegment *segment;
+        while ((segment = stPinchThreadSetSegmentIt_getNext(&segmentIt)) != NULL) {
+            stPinchSegment *segment2 = stPinchThreadSetSegmentIt_getNext(&segmentIt2);
+            CuAssertTrue(testCase, segment2 != NULL);
+            CuAssertIntEquals(testCase, stPinchSegment_getName(segment), stPinchSegment_getName(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getBlockOrientation(segment), stPinchSegment_getBlockOrientation(segment2));
+            stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+            if ((block = stPinchSegment_getBlock(segment)) != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getNumSupportingHomologies(block), stPinchBlock_getNumSupportingHomologies(block2));
+                CuAssertIntEquals(testCase, stPinchBlock_getModifiedFlag(block), stPinchBlock_getModifiedFlag(block2));
+                CuAssertIntEquals(testCase, stPinchSegment_getName(stPinchBlock_getFirst(block)),
+                        stPinchSegment_getName(stPinchBlock_getFirst(block2)));
+                CuAssertIntEquals(testCase, stPinchSegment_getStart(stPinchBlock_getFirst(block)),
+                        stPinchSegment_getStart(stPinchBlock_getFirst(block2)));
+            }
+        }
+        CuAssertPtrEquals(testCase, NULL, stPinchThreadSetSegmentIt_getNext(&segmentIt2));
+
+        //The loaded graph must remain usable
+        for (int64_t i = 0; i < 10; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1), stPinchThreadSet_getThread(threadSet, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet2, pinch.name1), stPinchThreadSet_getThread(threadSet2, pinch.name2),
+                    pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+        checkGraphsAreIdentical(testCase, threadSet, threadSet2);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(threadSet2);
+    }
+    remove(fileName);
+}
+
+static void appendStateValue(stList *state, int64_t value) {
+    stList_append(state, stIntTuple_construct1(value));
+}
+
+/*
+ * Returns the state of the graph, including the addresses of its segments and blocks, as a list of values.
+ */
+static stList *getGraphState(stPinchThreadSet *threadSet) {
+    stList *state = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        appendStateValue(state, stPinchThread_getName(thread));
+        stPinchSegment *segment = stPinchThread_getFirst(thread);
+        while (segment != NULL) {
+            appendStateValue(state, (intptr_t) segment);
+            appendStateValue(state, stPinchSegment_getStart(segment));
+            appendStateValue(state, stPinchSegment_getLength(segment));
+            appendStateValue(state, (intptr_t) stPinchSegment_getBlock(segment));
+            appendStateValue(state, stPinchSegment_getBlockOrientation(segment));
+            segment = stPinchSegment_get3Prime(segment);
+        }
+    }
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        appendStateValue(state, (intptr_t) block);
+        appendStateValue(state, stPinchBlock_getIndex(block));
+        appendStateValue(state, stPinchBlock_getDegree(block));
+        appendStateValue(state, stPinchBlock_getNumSupportingHomologies(block));
+        appendStateValue(state, stPinchBlock_getModifiedFlag(block));
+        appendStateValue(state, stPinchBlock_getFilterFlag(block));
+        stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment *segment;
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            appendStateValue(state, (intptr_t) segment);
+        }
+    }
+    appendStateValue(state, stPinchThreadSet_getBlockIndexBound(threadSet));
+    stPinchThreadSetModifiedBlockIt modifiedBlockIt = stPinchThreadSet_getModifiedBlockIt(threadSet);
+    while ((block = stPinchThreadSetModifiedBlockIt_getNext(&modifiedBlockIt)) != NULL) {
+        appendStateValue(state, (intptr_t) block);
+    }
+    return state;
+}
+
+static void checkGraphState(CuTest *testCase, stList *state, stPinchThreadSet *threadSet) {
+    stList *state2 = getGraphState(threadSet);
+    CuAssertIntEquals(testCase, stList_length(state), stList_length(state2));
+    for (int64_t i = 0; i < stList_length(state); i++) {
+        CuAssertIntEquals(testCase, stIntTuple_get(stList_get(state, i), 0), stIntTuple_get(stList_get(state2, i), 0));
+    }
+    stList_destruct(state2);
+}
+
+static stPinchBlock *getRandomBlock(stPinchThreadSet *threadSet) {
+    stList *blocks = stList_construct();
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        stList_append(blocks, block);
+    }
+    block = stList_length(blocks) > 0 ? stList_get(blocks, st_randomInt(0, stList_length(blocks))) : NULL;
+    stList_destruct(blocks);
+    return block;
+}
+
+/*
+ * Makes a random change to the graph.
+ */
+static void changeGraphRandomly(stPinchThreadSet *threadSet) {
+    stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+    stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch.name1);
+    stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch.name2);
+    stPinchBlock *block = getRandomBlock(threadSet);
+    switch (st_randomInt(0, 10)) {
+    case 0:
+    case 1:
+        stPinchThread_pinch(thread1, thread2, pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        break;
+    case 2: {
+        int64_t pinchNumber = st_randomInt(0, 10);
+        stPinch *pinches = st_malloc(pinchNumber * sizeof(stPinch));
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            pinches[i] = stPinchThreadSet_getRandomPinch(threadSet);
+        }
+        stPinchThreadSet_pinchBatchParallel(threadSet, pinches, pinchNumber, st_randomInt(1, 4));
+        free(pinches);
+        break;
+    }
+    case 3: {
+        stPinchUndo *undo = stPinchThread_prepareUndo(thread1, thread2, pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        stPinchThread_pinch(thread1, thread2, pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        stPinchThreadSet_undoPinch(threadSet, undo);
+        stPinchUndo_destruct(undo);
+        break;
+    }
+    case 4:
+        stPinchThread_split(thread1, pinch.start1);
+        break;
+    case 5:
+        if (st_random() > 0.5) {
+            stPinchThreadSet_joinTrivialBoundariesIncremental(threadSet);
+        } else {
+            stPinchThreadSet_joinTrivialBoundaries(threadSet);
+        }
+        break;
+    case 6:
+        if (st_random() > 0.9) {
+            stPinchThreadSet_trimAllBlocks(threadSet, st_randomInt(0, 3), 2);
+        } else if (block != NULL) {
+            if (st_random() > 0.5) {
+                stPinchBlock_destruct(block);
+            } else {
+                stPinchBlock_trim(block, st_randomInt(0, 3));
+            }
+        }
+        break;
+    case 7:
+        if (block != NULL) {
+            stPinchBlock_setFilterFlag(block, !stPinchBlock_getFilterFlag(block));
+            stPinchBlock_setModifiedFlag(block, st_random() > 0.5);
+            stPinchSegment_putSegmentFirstInBlock(stPinchThread_getFirst(thread1));
+        }
+        break;
+    case 8:
+        stList_destruct(stPinchThreadSet_consumeModifiedBlocks(threadSet));
+        break;
+    default:
+        stPinchThreadSet_addThread(threadSet, INT64_MAX - stPinchThreadSet_getSize(threadSet), 0, st_randomInt(1, 100));
+        break;
+    }
+}
+
+static void testStPinchThreadSet_transaction_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random transaction test %" PRIi64 "\n", test);
+        stPinchThreadSet *randomThreadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *threadSet = copyThreads(randomThreadSet, st_random() > 0.5);
+        stPinchThreadSet *expectedThreadSet = copyThreads(randomThreadSet, 0);
+        stPinchThreadSet_destruct(randomThreadSet);
+        bool incremental = st_random() > 0.5;
+        int64_t roundNumber = st_randomInt(1, 6);
+        for (int64_t round = 0; round < roundNumber; round++) {
+            //Pinch both graphs alike
+            int64_t pinchNumber = st_randomInt(0, 20);
+            for (int64_t i = 0; i < pinchNumber; i++) {
+                stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+                stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1), stPinchThreadSet_getThread(threadSet, pinch.name2),
+                        pinch.start1, pinch.start2, pinch.length, pinch.strand);
+                stPinchThread_pinch(stPinchThreadSet_getThread(expectedThreadSet, pinch.name1),
+                        stPinchThreadSet_getThread(expectedThreadSet, pinch.name2), pinch.start1, pinch.start2, pinch.length,
+                        pinch.strand);
+            }
+
+            //Then change one and roll the changes back
+            stList *state = getGraphState(threadSet);
+            stPinchThreadSet_beginTransaction(threadSet);
+            CuAssertTrue(testCase, stPinchThreadSet_inTransaction(threadSet));
+            int64_t changeNumber = st_randomInt(0, 10);
+            for (int64_t i = 0; i < changeNumber; i++) {
+                changeGraphRandomly(threadSet);
+            }
+            stPinchThreadSet_rollbackTransaction(threadSet);
+            CuAssertTrue(testCase, !stPinchThreadSet_inTransaction(threadSet));
+            checkGraphState(testCase, state, threadSet);
+            stList_destruct(state);
+
+            //The boundaries awaiting an incremental join must have been restored too
+            if (incremental) {
+                stPinchThreadSet_joinTrivialBoundariesIncremental(threadSet);
+                stPinchThreadSet_joinTrivialBoundaries(expectedThreadSet);
+                checkNoTrivialBoundaries(testCase, threadSet);
+            }
+            checkGraphsAreIdentical(testCase, expectedThreadSet, threadSet);
+        }
+
+        //Committing keeps the changes
+        stPinchThreadSet_beginTransaction(threadSet);
+        int64_t changeNumber = st_randomInt(0, 10);
+        for (int64_t i = 0; i < changeNumber; i++) {
+            changeGraphRandomly(threadSet);
+        }
+        stList *state = getGraphState(threadSet);
+        stPinchThreadSet_commitTransaction(threadSet);
+        checkGraphState(testCase, state, threadSet);
+        stList_destruct(state);
+        checkBlockIt(testCase, threadSet);
+        checkModifiedBlocks(testCase, threadSet);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(expectedThreadSet);
+    }
+}
+
+static stPinchSegment *getSegmentByWalking(stPinchThread *thread, int64_t coordinate) {
+    for (stPinchSegment *segment = stPinchThread_getFirst(thread); segment != NULL; segment = stPinchSegment_get3Prime(segment)) {
+        if (stPinchSegment_getStart(segment) <= coordinate && coordinate < stPinchSegment_getStart(segment) + stPinchSegment_getLength(segment)) {
+            return segment;
+        }
+    }
+    return NULL;
+}
+
+static void testStPinchThread_getSegment_randomTests(CuTest *testCase) {
+    int64_t totalFingerHits = 0;
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random get segment test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        int64_t roundNumber = st_randomInt(1, 10);
+        for (int64_t round = 0; round < roundNumber; round++) {
+            //Change the graph between lookups, sometimes rolling the changes back, so that the segments last found go away
+            bool transaction = st_random() > 0.5;
+            if (transaction) {
+                stPinchThreadSet_beginTransaction(threadSet);
+            }
+            int64_t changeNumber = st_randomInt(0, 5);
+            for (int64_t i = 0; i < changeNumber; i++) {
+                changeGraphRandomly(threadSet);
+            }
+            if (transaction) {
+                stPinchThreadSet_rollbackTransaction(threadSet);
+            }
+            //Look up positions that mostly move a short way along each thread, and sometimes jump
+            stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+            stPinchThread *thread;
+            while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+                int64_t start = stPinchThread_getStart(thread), length = stPinchThread_getLength(thread);
+                int64_t coordinate = st_randomInt(start - 2, start + length + 2);
+                for (int64_t i = 0; i < 20; i++) {
+                    coordinate = st_random() > 0.1 ? coordinate + st_randomInt(-3, 4) : st_randomInt(start - 2, start + length + 2);
+                    stPinchSegment *segment = getSegmentByWalking(thread, coordinate);
+                    int64_t lookupNumber = stPinchThread_getFingerHits(thread) + stPinchThread_getFingerMisses(thread);
+                    CuAssertPtrEquals(testCase, segment, stPinchThread_getSegmentReadOnly(thread, coordinate));
+                    CuAssertPtrEquals(testCase, segment, stPinchThread_getSegment(thread, coordinate));
+                    CuAssertIntEquals(testCase, lookupNumber + 1, stPinchThread_getFingerHits(thread) + stPinchThread_getFingerMisses(thread));
+                    if (st_random() > 0.8) {
+                        stPinchThread_split(thread, coordinate);
+                    }
+                }
+                totalFingerHits += stPinchThread_getFingerHits(thread);
+            }
+        }
+        stPinchThreadSet_destruct(threadSet);
+    }
+    CuAssertTrue(testCase, totalFingerHits > 0);
+}
+
 CuSuite* stPinchGraphsTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testStPinchThreadSet);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_getThread_randomTests);
     SUITE_ADD_TEST(suite, testStPinchThreadAndSegment);
     SUITE_ADD_TEST(suite, testStPinchBlock_NoSplits);
     SUITE_ADD_TEST(suite, testStPinchBlock_Splits);
     SUITE_ADD_TEST(suite, testStPinchThread_pinch);
     SUITE_ADD_TEST(suite, testStPinchThread_pinch_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_slabAllocation_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_pinchBatch_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_pinchBatchParallel_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_binary_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThread_pinchAlignment_randomTests);
     SUITE_ADD_TEST(suite, testStPinchThread_filterPinch_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_filterPinches_randomTests);
     SUITE_ADD_TEST(suite, testStPinchThreadSet_getAdjacencyComponents);
     SUITE_ADD_TEST(suite, testStPinchThreadSet_getAdjacencyComponents_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_getAdjacencyComponentIndices_randomTests);
     SUITE_ADD_TEST(suite, testStPinchThreadSet_joinTrivialBoundaries_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_joinTrivialBoundariesIncremental_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_blockIt_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_modifiedBlocks_randomTests);
     SUITE_ADD_TEST(suite, testStPinchThreadSet_getThreadComponents);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_getThreadComponentIndices_randomTests);
     SUITE_ADD_TEST(suite, testStPinchThreadSet_trimAlignments_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchBlock_splitAt_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_trimAllBlocks_randomTests);
     SUITE_ADD_TEST(suite, testStPinchInterval);
     SUITE_ADD_TEST(suite, testStPinchThreadSet_getLabelIntervals);
     SUITE_ADD_TEST(suite, testStPinchThreadSet_getLabelIntervals_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_getLabelIntervals2_randomTests);
     SUITE_ADD_TEST(suite, testStPinchEnd_hasSelfLoopWithRespectToOtherBlock_randomTests);
     SUITE_ADD_TEST(suite, testStPinchEnd_getSubSequenceLengthsConnectingEnds_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchSortedBlockSegments_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_getEndAdjacencies_randomTests);
     SUITE_ADD_TEST(suite, testStPinchBlock_getNumSupportingHomologies);
     SUITE_ADD_TEST(suite, testStPinchUndo);
     SUITE_ADD_TEST(suite, testStPinchUndo_random);
     SUITE_ADD_TEST(suite, testStPinchUndo_chains);
     SUITE_ADD_TEST(suite, testStPinchPartialUndo_random);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_transaction_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchThread_getSegment_randomTests);
 
     return suite;
 }
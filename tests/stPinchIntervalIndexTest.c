@@ -0,0 +1,101 @@
+/*
+ * stPinchIntervalIndexTest.c
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stPinchGraphs.h"
+#include "stPinchIntervalIndex.h"
+
+static stSortedSet *getRandomIntervals(void) {
+    stSortedSet *intervals = stSortedSet_construct3((int(*)(const void *, const void *)) stPinchInterval_compareFunction,
+            (void(*)(void *)) stPinchInterval_destruct);
+    int64_t threadNumber = st_randomInt(0, 10);
+    for (int64_t name = 0; name < threadNumber; name++) {
+        //Non-overlapping intervals with random gaps between them
+        int64_t intervalNumber = st_random() > 0.2 ? st_randomInt(0, 200) : 0;
+        int64_t start = st_randomInt(-100, 100);
+        for (int64_t i = 0; i < intervalNumber; i++) {
+            start += st_random() > 0.5 ? 0 : st_randomInt(1, 5);
+            int64_t length = st_randomInt(1, 10);
+            stSortedSet_insert(intervals, stPinchInterval_construct(2 * name, start, length, NULL));
+            start += length;
+        }
+    }
+    return intervals;
+}
+
+static void testStPinchIntervalIndex(CuTest *testCase) {
+    stSortedSet *intervals = stSortedSet_construct3((int(*)(const void *, const void *)) stPinchInterval_compareFunction,
+            (void(*)(void *)) stPinchInterval_destruct);
+    stPinchInterval *interval1 = stPinchInterval_construct(1, 0, 5, NULL);
+    stPinchInterval *interval2 = stPinchInterval_construct(1, 10, 2, NULL);
+    stPinchInterval *interval3 = stPinchInterval_construct(3, -5, 5, NULL);
+    stSortedSet_insert(intervals, interval1);
+    stSortedSet_insert(intervals, interval2);
+    stSortedSet_insert(intervals, interval3);
+    stPinchIntervalIndex *index = stPinchIntervalIndex_construct(intervals);
+    CuAssertPtrEquals(testCase, NULL, stPinchIntervalIndex_getInterval(index, 1, -1));
+    CuAssertPtrEquals(testCase, interval1, stPinchIntervalIndex_getInterval(index, 1, 0));
+    CuAssertPtrEquals(testCase, interval1, stPinchIntervalIndex_getInterval(index, 1, 4));
+    CuAssertPtrEquals(testCase, NULL, stPinchIntervalIndex_getInterval(index, 1, 5));
+    CuAssertPtrEquals(testCase, interval2, stPinchIntervalIndex_getInterval(index, 1, 11));
+    CuAssertPtrEquals(testCase, NULL, stPinchIntervalIndex_getInterval(index, 1, 12));
+    CuAssertPtrEquals(testCase, NULL, stPinchIntervalIndex_getInterval(index, 2, 0));
+    CuAssertPtrEquals(testCase, interval3, stPinchIntervalIndex_getInterval(index, 3, -5));
+
+    int64_t positions[] = { -1, 0, 4, 5, 10, 11, 12 };
+    stPinchInterval *results[7];
+    stPinchIntervalIndex_getIntervals(index, 1, positions, 7, results);
+    stPinchInterval *expectedResults[] = { NULL, interval1, interval1, NULL, interval2, interval2, NULL };
+    for (int64_t i = 0; i < 7; i++) {
+        CuAssertPtrEquals(testCase, expectedResults[i], results[i]);
+    }
+    stPinchIntervalIndex_destruct(index);
+    stSortedSet_destruct(intervals);
+}
+
+static int cmpPositions(const void *a, const void *b) {
+    int64_t i = *(const int64_t *) a, j = *(const int64_t *) b;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+static void testStPinchIntervalIndex_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random interval index test %" PRIi64 "\n", test);
+        stSortedSet *intervals = getRandomIntervals();
+        stPinchIntervalIndex *index = stPinchIntervalIndex_construct(intervals);
+        for (int64_t name = -1; name < 21; name++) {
+            //Single queries
+            for (int64_t position = -150; position < 3200; position++) {
+                CuAssertPtrEquals(testCase, stPinchIntervals_getInterval(intervals, name, position),
+                        stPinchIntervalIndex_getInterval(index, name, position));
+            }
+            //Batches, both sparse and dense enough to be answered by a merge
+            int64_t positionNumber = st_random() > 0.5 ? st_randomInt(0, 5) : st_randomInt(0, 2000);
+            int64_t *positions = st_malloc(positionNumber * sizeof(int64_t));
+            for (int64_t i = 0; i < positionNumber; i++) {
+                positions[i] = st_randomInt(-150, 3200);
+            }
+            qsort(positions, positionNumber, sizeof(int64_t), cmpPositions);
+            stPinchInterval **results = st_malloc(positionNumber * sizeof(stPinchInterval *));
+            stPinchIntervalIndex_getIntervals(index, name, positions, positionNumber, results);
+            for (int64_t i = 0; i < positionNumber; i++) {
+                CuAssertPtrEquals(testCase, stPinchIntervals_getInterval(intervals, name, positions[i]), results[i]);
+            }
+            free(results);
+            free(positions);
+        }
+        stPinchIntervalIndex_destruct(index);
+        stSortedSet_destruct(intervals);
+    }
+}
+
+CuSuite* stPinchIntervalIndexTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testStPinchIntervalIndex);
+    SUITE_ADD_TEST(suite, testStPinchIntervalIndex_randomTests);
+    return suite;
+}
@@ -0,0 +1,128 @@
+/*
+ * stPinchPafTest.c
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stPinchGraphs.h"
+#include "stPinchPaf.h"
+
+static stPinchThreadSet *copyThreads(stPinchThreadSet *threadSet) {
+    stPinchThreadSet *threadSet2 = stPinchThreadSet_construct();
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThreadSet_addThread(threadSet2, stPinchThread_getName(thread), stPinchThread_getStart(thread),
+                stPinchThread_getLength(thread));
+    }
+    return threadSet2;
+}
+
+/*
+ * Checks the two graphs have the same segments and that the segments are grouped into blocks in the same way.
+ */
+static void checkGraphsAreEquivalent(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1), stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    stPinchThreadSetSegmentIt segmentIt = stPinchThreadSet_getSegmentIt(threadSet1);
+    stPinchSegment *segment1;
+    while ((segment1 = stPinchThreadSetSegmentIt_getNext(&segmentIt)) != NULL) {
+        stPinchSegment *segment2 = stPinchThreadSet_getSegment(threadSet2, stPinchSegment_getName(segment1),
+                stPinchSegment_getStart(segment1));
+        CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+        CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+        stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+        CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+        if (block1 != NULL) {
+            CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+            stPinchSegment *first1 = stPinchBlock_getFirst(block1);
+            stPinchSegment *first2 = stPinchThreadSet_getSegment(threadSet2, stPinchSegment_getName(first1),
+                    stPinchSegment_getStart(first1));
+            CuAssertPtrEquals(testCase, block2, stPinchSegment_getBlock(first2));
+            CuAssertTrue(testCase, (stPinchSegment_getBlockOrientation(segment1) == stPinchSegment_getBlockOrientation(first1))
+                    == (stPinchSegment_getBlockOrientation(segment2) == stPinchSegment_getBlockOrientation(first2)));
+        }
+    }
+}
+
+static void testStPinchThreadSet_pinchPaf(CuTest *testCase) {
+    stPinchThreadSet *threadSet = stPinchThreadSet_construct();
+    stPinchThreadSet_addThread(threadSet, 1, 10, 100);
+    stPinchThreadSet_addThread(threadSet, 2, 0, 50);
+    stHash *sequenceNamesToThreads = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, NULL, NULL);
+    stHash_insert(sequenceNamesToThreads, "query", stPinchThreadSet_getThread(threadSet, 1));
+    stHash_insert(sequenceNamesToThreads, "target", stPinchThreadSet_getThread(threadSet, 2));
+    FILE *fileHandle = tmpfile();
+    fprintf(fileHandle, "query\t100\t5\t20\t+\ttarget\t50\t0\t13\t10\t18\t60\tcg:Z:4M5I3D6M\n\n");
+    fprintf(fileHandle, "query\t100\t50\t60\t-\ttarget\t50\t30\t40\t10\t10\t60\tNM:i:0\tcg:Z:10M\n");
+    rewind(fileHandle);
+    stPinchPafStats stats = stPinchThreadSet_pinchPaf(threadSet, fileHandle, sequenceNamesToThreads);
+    fclose(fileHandle);
+    CuAssertIntEquals(testCase, 2, stats.records);
+    CuAssertIntEquals(testCase, 3, stats.pinches);
+    CuAssertIntEquals(testCase, 20, stats.alignedBases);
+
+    stPinchThreadSet *expectedThreadSet = copyThreads(threadSet);
+    stPinchThread *thread1 = stPinchThreadSet_getThread(expectedThreadSet, 1);
+    stPinchThread *thread2 = stPinchThreadSet_getThread(expectedThreadSet, 2);
+    stPinchThread_pinch(thread1, thread2, 15, 0, 4, 1);
+    stPinchThread_pinch(thread1, thread2, 24, 7, 6, 1);
+    stPinchThread_pinch(thread1, thread2, 60, 30, 10, 0);
+    checkGraphsAreEquivalent(testCase, expectedThreadSet, threadSet);
+
+    stHash_destruct(sequenceNamesToThreads);
+    stPinchThreadSet_destruct(threadSet);
+    stPinchThreadSet_destruct(expectedThreadSet);
+}
+
+static void testStPinchThreadSet_pinchPaf_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random PAF test %" PRIi64 "\n", test);
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomEmptyGraph();
+        stPinchThreadSet *expectedThreadSet = copyThreads(threadSet);
+        int64_t recordNumber = st_randomInt(0, 10);
+        FILE *fileHandle = tmpfile();
+        stList *pinches = stPinchPaf_writeRandomRecords(threadSet, fileHandle, recordNumber);
+        rewind(fileHandle);
+
+        //Either map sequence names to threads explicitly, or rely on them being thread names
+        stHash *sequenceNamesToThreads = NULL;
+        if (st_random() > 0.5) {
+            sequenceNamesToThreads = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, free, NULL);
+            stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+            stPinchThread *thread;
+            while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+                stHash_insert(sequenceNamesToThreads, stString_print("%" PRIi64, stPinchThread_getName(thread)), thread);
+            }
+        }
+        stPinchPafStats stats = stPinchThreadSet_pinchPaf(threadSet, fileHandle, sequenceNamesToThreads);
+        fclose(fileHandle);
+        CuAssertIntEquals(testCase, recordNumber, stats.records);
+        CuAssertIntEquals(testCase, stList_length(pinches), stats.pinches);
+
+        //A batch gives the same alignment whatever the order of its pinches, so the orientations within blocks
+        //of threads pinched to their own reverse complement are comparable too
+        stPinch *expectedPinches = st_malloc(stList_length(pinches) * sizeof(stPinch));
+        for (int64_t i = 0; i < stList_length(pinches); i++) {
+            expectedPinches[i] = *(stPinch *) stList_get(pinches, i);
+        }
+        stPinchThreadSet_pinchBatch(expectedThreadSet, expectedPinches, stList_length(pinches));
+        free(expectedPinches);
+        checkGraphsAreEquivalent(testCase, expectedThreadSet, threadSet);
+
+        if (sequenceNamesToThreads != NULL) {
+            stHash_destruct(sequenceNamesToThreads);
+        }
+        stList_destruct(pinches);
+        stPinchThreadSet_destruct(threadSet);
+        stPinchThreadSet_destruct(expectedThreadSet);
+    }
+}
+
+CuSuite* stPinchPafTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_pinchPaf);
+    SUITE_ADD_TEST(suite, testStPinchThreadSet_pinchPaf_randomTests);
+    return suite;
+}
@@ -0,0 +1,143 @@
+/*
+ * stPinchSegmentIndexTest.c
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stPinchSegmentIndex.h"
+
+static void *getValue(int64_t key) {
+    return (void *) (intptr_t) (2 * key + 1);
+}
+
+static void testStPinchSegmentIndex(CuTest *testCase) {
+    stPinchSegmentIndex *index = stPinchSegmentIndex_construct();
+    CuAssertIntEquals(testCase, 0, stPinchSegmentIndex_size(index));
+    CuAssertPtrEquals(testCase, NULL, stPinchSegmentIndex_getFirst(index));
+    CuAssertPtrEquals(testCase, NULL, stPinchSegmentIndex_getLast(index));
+    CuAssertPtrEquals(testCase, NULL, stPinchSegmentIndex_searchLessThanOrEqual(index, 10));
+
+    stPinchSegmentIndex_insert(index, 10, getValue(10));
+    stPinchSegmentIndex_insert(index, -5, getValue(-5));
+    stPinchSegmentIndex_insert(index, 20, getValue(20));
+    CuAssertIntEquals(testCase, 3, stPinchSegmentIndex_size(index));
+    CuAssertPtrEquals(testCase, getValue(-5), stPinchSegmentIndex_getFirst(index));
+    CuAssertPtrEquals(testCase, getValue(20), stPinchSegmentIndex_getLast(index));
+    CuAssertPtrEquals(testCase, NULL, stPinchSegmentIndex_searchLessThanOrEqual(index, -6));
+    CuAssertPtrEquals(testCase, getValue(-5), stPinchSegmentIndex_searchLessThanOrEqual(index, 9));
+    CuAssertPtrEquals(testCase, getValue(10), stPinchSegmentIndex_searchLessThanOrEqual(index, 10));
+    CuAssertPtrEquals(testCase, getValue(20), stPinchSegmentIndex_searchLessThanOrEqual(index, INT64_MAX));
+    CuAssertPtrEquals(testCase, getValue(10), stPinchSegmentIndex_search(index, 10));
+    CuAssertPtrEquals(testCase, NULL, stPinchSegmentIndex_search(index, 11));
+
+    CuAssertPtrEquals(testCase, NULL, stPinchSegmentIndex_remove(index, 11));
+    CuAssertPtrEquals(testCase, getValue(10), stPinchSegmentIndex_remove(index, 10));
+    CuAssertIntEquals(testCase, 2, stPinchSegmentIndex_size(index));
+    CuAssertPtrEquals(testCase, getValue(-5), stPinchSegmentIndex_searchLessThanOrEqual(index, 15));
+    stPinchSegmentIndex_destruct(index);
+}
+
+/*
+ * Checks the index against a bit map of the keys in [0, keyRange) it should contain.
+ */
+static void checkIndex(CuTest *testCase, stPinchSegmentIndex *index, bool *present, int64_t keyRange) {
+    int64_t size = 0;
+    void *lessThanOrEqual = NULL;
+    void *first = NULL;
+    for (int64_t key = 0; key < keyRange; key++) {
+        if (present[key]) {
+            size++;
+            lessThanOrEqual = getValue(key);
+            if (first == NULL) {
+                first = lessThanOrEqual;
+            }
+        }
+        CuAssertPtrEquals(testCase, present[key] ? getValue(key) : NULL, stPinchSegmentIndex_search(index, key));
+        CuAssertPtrEquals(testCase, lessThanOrEqual, stPinchSegmentIndex_searchLessThanOrEqual(index, key));
+    }
+    CuAssertIntEquals(testCase, size, stPinchSegmentIndex_size(index));
+    CuAssertPtrEquals(testCase, first, stPinchSegmentIndex_getFirst(index));
+    CuAssertPtrEquals(testCase, lessThanOrEqual, stPinchSegmentIndex_getLast(index));
+}
+
+static void testStPinchSegmentIndex_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random segment index test %" PRIi64 "\n", test);
+        int64_t keyRange = st_randomInt(1, 10000);
+        bool *present = st_calloc(keyRange, sizeof(bool));
+        stPinchSegmentIndex *index = stPinchSegmentIndex_construct();
+        //Alternate between growing and shrinking the index, so that nodes are split, borrowed from and merged
+        for (int64_t round = 0; round < 4; round++) {
+            double insertProb = round % 2 == 0 ? 0.8 : 0.2;
+            int64_t operations = st_randomInt(0, 3 * keyRange);
+            for (int64_t i = 0; i < operations; i++) {
+                int64_t key = st_randomInt(0, keyRange);
+                if (st_random() < insertProb) {
+                    if (!present[key]) {
+                        stPinchSegmentIndex_insert(index, key, getValue(key));
+                        present[key] = 1;
+                    }
+                } else {
+                    CuAssertPtrEquals(testCase, present[key] ? getValue(key) : NULL, stPinchSegmentIndex_remove(index, key));
+                    present[key] = 0;
+                }
+            }
+            checkIndex(testCase, index, present, keyRange);
+        }
+        stPinchSegmentIndex_destruct(index);
+        free(present);
+    }
+}
+
+static void testStPinchSegmentIndex_constructFromSorted_randomTests(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting random sorted segment index test %" PRIi64 "\n", test);
+        int64_t keyRange = st_randomInt(1, 10000);
+        bool *present = st_calloc(keyRange, sizeof(bool));
+        int64_t *keys = st_malloc(keyRange * sizeof(int64_t));
+        void **values = st_malloc(keyRange * sizeof(void *));
+        int64_t length = 0;
+        double keyProb = st_random();
+        for (int64_t key = 0; key < keyRange; key++) {
+            if (st_random() < keyProb) {
+                present[key] = 1;
+                keys[length] = key;
+                values[length++] = getValue(key);
+            }
+        }
+        stPinchSegmentIndex *index = stPinchSegmentIndex_constructFromSorted(keys, values, length);
+        checkIndex(testCase, index, present, keyRange);
+        //The bulk built tree must stay valid as it is changed
+        for (int64_t round = 0; round < 2; round++) {
+            double insertProb = round % 2 == 0 ? 0.2 : 0.8;
+            int64_t operations = st_randomInt(0, 3 * keyRange);
+            for (int64_t i = 0; i < operations; i++) {
+                int64_t key = st_randomInt(0, keyRange);
+                if (st_random() < insertProb) {
+                    if (!present[key]) {
+                        stPinchSegmentIndex_insert(index, key, getValue(key));
+                        present[key] = 1;
+                    }
+                } else {
+                    CuAssertPtrEquals(testCase, present[key] ? getValue(key) : NULL, stPinchSegmentIndex_remove(index, key));
+                    present[key] = 0;
+                }
+            }
+            checkIndex(testCase, index, present, keyRange);
+        }
+        stPinchSegmentIndex_destruct(index);
+        free(present);
+        free(keys);
+        free(values);
+    }
+}
+
+CuSuite* stPinchSegmentIndexTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testStPinchSegmentIndex);
+    SUITE_ADD_TEST(suite, testStPinchSegmentIndex_randomTests);
+    SUITE_ADD_TEST(suite, testStPinchSegmentIndex_constructFromSorted_randomTests);
+    return suite;
+}